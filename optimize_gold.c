@@ -4,6 +4,7 @@
  * Date: May 2, 2020
  *
  */
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
@@ -11,6 +12,29 @@
 #include <string.h>
 #include "pso.h"
 
+/* Random numbers of the reference engine: the sequence rand() gives after
+ * srand(seed), kept per thread so gold jobs running side by side in a batch
+ * draw independently. A gold run seeds it and then runs on one thread */
+static __thread struct random_data pso_gold_rng;
+static __thread char pso_gold_state[128];   /* Size of glibc's default rand() state */
+
+void pso_gold_seed(unsigned int seed)
+{
+    memset(&pso_gold_rng, 0, sizeof(pso_gold_rng));
+    initstate_r(seed, pso_gold_state, sizeof(pso_gold_state), &pso_gold_rng);
+}
+
+/* Next number in [0, RAND_MAX], as rand() */
+int pso_gold_rand(void)
+{
+    int32_t r;
+
+    if (pso_gold_rng.state == NULL)
+        pso_gold_seed(1);
+    random_r(&pso_gold_rng, &r);
+    return r;
+}
+
 /* Solve PSO */
 int pso_solve_gold(char *function, swarm_t *swarm, 
                     float xmax, float xmin, int max_iter)
@@ -31,8 +55,8 @@ int pso_solve_gold(char *function, swarm_t *swarm,
             particle = &swarm->particle[i];
             gbest = &swarm->particle[particle->g];  /* Best performing particle from last iteration */ 
             for (j = 0; j < particle->dim; j++) {   /* Update this particle's state */
-                r1 = (float)rand()/(float)RAND_MAX;
-                r2 = (float)rand()/(float)RAND_MAX;
+                r1 = (float)pso_gold_rand()/(float)RAND_MAX;
+                r2 = (float)pso_gold_rand()/(float)RAND_MAX;
                 /* Update particle velocity */
                 particle->v[j] = w * particle->v[j]\
                                  + c1 * r1 * (particle->pbest[j] - particle->x[j])\
@@ -78,13 +102,15 @@ int pso_solve_gold(char *function, swarm_t *swarm,
 }
 
 
-int optimize_gold(char *function, int dim, int swarm_size, 
-                  float xmin, float xmax, int max_iter)
+int optimize_gold(pso_config_t *config)
 {
+    char *function = config->function;
+    float xmin = config->xmin, xmax = config->xmax;
+
      /* Initialize PSO */
     swarm_t *swarm;
-    srand(time(NULL));
-    swarm = pso_init(function, dim, swarm_size, xmin, xmax);
+    pso_gold_seed(config->seed);
+    swarm = pso_init(function, config->dim, config->swarm_size, xmin, xmax);
     if (swarm == NULL) {
         fprintf(stderr, "Unable to initialize PSO\n");
         exit(EXIT_FAILURE);
@@ -96,10 +122,10 @@ int optimize_gold(char *function, int dim, int swarm_size,
 
     /* Solve PSO */
     int g; 
-    g = pso_solve_gold(function, swarm, xmax, xmin, max_iter);
-    if (g >= 0) {
-        fprintf(stderr, "Solution:\n");
-        pso_print_particle(&swarm->particle[g]);
+    g = pso_solve_gold(function, swarm, xmax, xmin, config->max_iter);
+    if (g >= 0 && pso_write_solution(config, &swarm->particle[g]) < 0) {
+        fprintf(stderr, "Could not write solution\n");
+        g = -1;
     }
 
     pso_free(swarm);
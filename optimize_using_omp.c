@@ -10,79 +10,499 @@
 #include <time.h>
 #include <math.h>
 #include <string.h>
+#include <limits.h>
 #include <omp.h>
 #include "pso.h"
 
-int optimize_using_omp(char *function, int dim, int swarm_size, 
-                       float xmin, float xmax, int max_iter, int num_threads)
+/* Per-thread best fitness and evaluations skipped, padded so threads do
+ * not share cache lines */
+typedef struct local_best_s {
+    float fitness;
+    int g;
+    int skipped;
+    float work, wait;       /* Seconds before and at the barrier, for the live page */
+    char pad[44];
+} local_best_t;
+
+#define PSO_MOMENT_LANES 16     /* Lane sums of the fitness moments; position lanes are a multiple */
+
+/* Moments of a block from the folded sums of the moments kernel: the sums of
+ * its positions less the shift and of their squares per dimension, then the
+ * sums of its fitness less the fitness shift and of their squares */
+static void pso_block_moments(const float *sums, int dim, int lanes, double *restrict moments)
 {
-    /* Initialize PSO */
-    swarm_t *swarm;
-    swarm = pso_init_omp(function, dim, swarm_size, xmin, xmax, num_threads);
-    if (swarm == NULL) {
-        fprintf(stderr, "Unable to initialize PSO\n");
-        exit(EXIT_FAILURE);
+    const float *f_sums = sums + 2 * lanes;
+    int j;
+
+    for (j = 0; j < dim; j++) {
+        moments[j] = sums[j];
+        moments[dim + j] = sums[lanes + j];
+    }
+    moments[2 * dim] = f_sums[0];
+    moments[2 * dim + 1] = f_sums[PSO_MOMENT_LANES];
+}
+
+/* Swarm statistics from the moments of all blocks, added in block order into
+ * the first block's. shift holds the position shift tiled over the lanes,
+ * then the fitness shift */
+static void pso_merge_stats(double *moments, int num_blocks, int n, int dim, int lanes, const float *shift,
+                            pso_stats_t *stats)
+{
+    int b, j;
+    double mean, var = 0.0;
+
+    for (b = 1; b < num_blocks; b++)
+        for (j = 0; j < 2 * dim + 2; j++)
+            moments[j] += moments[(size_t)b * (2 * dim + 2) + j];
+    for (j = 0; j < dim; j++) {
+        mean = moments[j] / n;
+        var += moments[dim + j] / n - mean * mean;
+        if (stats->centroid != NULL)
+            stats->centroid[j] = shift[j] + mean;
+    }
+    stats->diversity = (var > 0) ? sqrt(var) : 0.0;
+    mean = moments[2 * dim] / n;
+    stats->fitness_mean = shift[lanes] + mean;
+    var = moments[2 * dim + 1] / n - mean * mean;
+    stats->fitness_var = (var > 0) ? var : 0.0;
+}
+
+/* Tile the position shift gbest_x over lanes, then the fitness shift */
+static void pso_moment_shift(float *shift, const float *gbest_x, int dim, int lanes, float fitness)
+{
+    int l;
+
+    for (l = 0; l < lanes; l++)
+        shift[l] = gbest_x[l % dim];
+    for (l = 0; l < PSO_MOMENT_LANES; l++)
+        shift[lanes + l] = fitness;
+}
+
+/* Solve PSO with the parameters of config. Returns index of best performing particle.
+ *
+ * Each iteration runs inside one parallel region: update, evaluate, per-thread
+ * argmin, merge and broadcast of g. Update and evaluate use the same static
+ * schedule over blocks of config->block_size particles (PSO_BLOCK if 0) so a
+ * particle is always updated and evaluated by the same thread. The best position is copied into gbest_x
+ * at broadcast time so the update phase never reads a pbest that another
+ * thread may be writing. Random numbers are drawn from a key per particle and
+ * iteration, so results do not depend on the number of threads. If progress
+ * is not NULL its callback runs after every iteration and may stop the solve
+ * early.
+ *
+ * The arithmetic is done by the kernels selected in pso_kernels. The update
+ * rule of config->variant, with its random numbers and any state of its own
+ * (CLPSO exemplars, QPSO mean pbest, species leaders), sits behind the
+ * variant's pool (see pso_update.c); variants that read other particles'
+ * pbests get a barrier between the update and evaluate phases. Each block of
+ * particles is evaluated with one batch objective call.
+ *
+ * With config->opposition (Rahnamayan, Tizhoosh and Salama, "Opposition-based
+ * differential evolution", IEEE TEC 2008) the opposite xmin + xmax - x of
+ * every initial particle is evaluated and the better of each pair kept; then,
+ * in iterations picked with probability config->jump_rate, the evaluate pass
+ * does the same for the new positions of each block before updating pbest.
+ * The opposite points of a block are one extra batch objective call and the
+ * selection is a kernel. swarm->num_evals counts all evaluations.
+ *
+ * If progress->stats is set, the evaluate pass also sums each block's new
+ * positions and fitness and their squares, less gbest and its fitness of the
+ * previous iteration so the sums stay small as the swarm converges, while
+ * the block is still in cache. A kernel sums a block in float lanes and folds
+ * them in a fixed order; the reduce adds the block sums in double in block
+ * order and derives the centroid, diversity and fitness moments. The
+ * statistics cost no extra pass over the swarm and do not depend on the
+ * thread count or ISA; the block size moves their last bits. Iterations
+ * progress->stats_every does not pick skip the sums and the reduce.
+ *
+ * If progress->elite is set, the pbest update offers every particle whose
+ * pbest changed to its thread's candidates, and the reduce merges the
+ * threads' best into the elite archive (see pso_elite.c).
+ *
+ * If progress->dynamic is set, the objective is evaluated at x - shift,
+ * clamped to the domain, and may move before any iteration. A move signalled by the objective, or seen
+ * on the sentinel pbests, makes the evaluate pass of that iteration
+ * re-evaluate each block's pbests and redraw part of it before evaluating
+ * the new positions (see pso_dynamic.c); the re-evaluations count as
+ * evaluations.
+ *
+ * If config->types declares integer or categorical dimensions (see
+ * pso_mixed.c), the initial swarm is snapped and evaluated again, and the
+ * evaluate pass snaps each block after the update kernels, which stay
+ * continuous. With no continuous dimensions, the particles that did not move
+ * off their pbest are not evaluated; the rest of the block is packed into
+ * one batch objective call. swarm->num_skipped counts the evaluations saved.
+ * A continuous coordinate practically never lands back on its pbest, so
+ * mixed spaces evaluate every particle rather than compare rows in vain.
+ *
+ * If progress->noise is set, every evaluation is noisy: pbests keep the mean
+ * of their samples, the evaluate pass samples each block's new positions
+ * again, all of them a fixed number of times or only those too close to
+ * their pbest to call, and the reduce does the same for a new gbest against
+ * the old one (see pso_noise.c). Every sample counts as an evaluation.
+ *
+ * The iteration runs on config->num_threads threads, or, when the run holds a
+ * scheduler slot, on the cores the slot is assigned at the start of that
+ * iteration.
+ */
+int pso_solve_omp(swarm_t *swarm, pso_config_t *config, pso_progress_t *progress)
+{
+    const pso_objective_t *objective = pso_find_objective(config->function);
+    const pso_kernels_t *kernels = pso_kernels;
+    int max_iter = config->max_iter;
+    int num_threads = config->num_threads, max_threads;
+    int first_core = 0;
+    unsigned long core_epoch = 0;
+    unsigned int seed = pso_hash(config->seed);
+    int iter, g, i;
+    int dim = swarm->dim;
+    int block = pso_update_rows(dim), num_blocks;
+    size_t scratch_size;
+    float *gbest_x, *scratch;
+    pso_update_pool_t *variant = NULL;  /* State of the update rule */
+    double *moments = NULL;             /* Per-block sums for the swarm statistics */
+    float *lane_sums = NULL;            /* Per-thread lane sums of one block */
+    float *shift = NULL;                /* Previous gbest and its fitness, tiled over the moment lanes */
+    int lanes = PSO_MOMENT_LANES, width;    /* Position lanes: smallest multiple of dim and 16 */
+    pso_stats_t *stats = (progress != NULL) ? progress->stats : NULL;
+    int sampled = 0;                    /* Statistics collected in this iteration */
+    pso_elite_t *elite = (progress != NULL) ? progress->elite : NULL;
+    pso_elite_pool_t *pool = NULL;      /* Per-thread candidates of the elite archive */
+    pso_dynamic_t *dynamic = (progress != NULL) ? progress->dynamic : NULL;
+    pso_dynamic_pool_t *moving = NULL;  /* Sentinels and memory of a dynamic objective */
+    const float *drift = NULL;          /* Shift of a dynamic objective */
+    int changed = 0;                    /* Objective moved before this iteration */
+    int jump = 0;                       /* Opposition step in this iteration */
+    pso_space_t discrete;               /* Integer and categorical dimensions */
+    pso_mixed_pool_t *mixed = NULL;
+    long skipped = 0;                   /* Evaluations skipped in this iteration */
+    pso_noise_t *noise = (progress != NULL) ? progress->noise : NULL;
+    pso_noise_pool_t *noisy = NULL;     /* Sample statistics of the pbests */
+    local_best_t *local_best;
+    pso_update_t param;
+    void (*eval)(const float *, int, int, float *);
+
+    if (objective == NULL)
+        return -1;
+    if (swarm->v == NULL && pso_variant_velocity(config)) {
+        fprintf(stderr, "Variant %s needs velocities\n", pso_variant_name(config));
+        return -1;
+    }
+    if (config->variant == PSO_VARIANT_CLPSO && (size_t)swarm->num_particles * dim > INT_MAX) {
+        fprintf(stderr, "Swarm too large for CLPSO\n");
+        return -1;
+    }
+    if (elite != NULL && (elite->k < 1 || !(elite->radius > 0))) {
+        fprintf(stderr, "Elite archive needs a capacity and a positive radius\n");
+        return -1;
+    }
+    if (dynamic != NULL && (dynamic->change == NULL || dynamic->shift == NULL || elite != NULL
+                            || (dynamic->detect == PSO_DETECT_SENTINEL && dynamic->sentinels < 1)
+                            || !(dynamic->rediversify >= 0 && dynamic->rediversify <= 1) || dynamic->memory < 0)) {
+        fprintf(stderr, "Dynamic objective needs a change hook, a shift, sentinels to detect by, a redraw fraction "
+                        "between 0 and 1 and no elite archive\n");
+        return -1;
+    }
+    if (noise != NULL && (!(noise->sigma >= 0) || noise->samples < 0 || (noise->samples == 0 && noise->max_samples < 2)
+                          || dynamic != NULL || config->opposition)) {
+        fprintf(stderr, "Noisy objective needs a noise level, samples per point or a limit of at least 2 to race, "
+                        "and no dynamic objective or opposition\n");
+        return -1;
+    }
+    if (config->types != NULL && pso_parse_space(config->types, dim, config->xmin, config->xmax, &discrete) < 0) {
+        fprintf(stderr, "Invalid dimension types %s for %d dimensions\n", config->types, dim);
+        return -1;
+    }
+    eval = pso_objective_batch(objective);
+    /* Power of two between the update rows and PSO_BLOCK; results do not depend on it */
+    while (block < PSO_BLOCK && block < ((config->block_size > 0) ? config->block_size : PSO_BLOCK))
+        block *= 2;
+    num_blocks = (swarm->num_particles + block - 1) / block;
+    /* Fitness of a block, current and best, opposite points of a block,
+     * shifted points of a block */
+    scratch_size = (2 * (size_t)block
+                    + (config->opposition ? (size_t)block * (dim + 1) : 0)
+                    + ((dynamic != NULL) ? (size_t)block * dim : 0) + 15) & ~(size_t)15;
+
+    gbest_x = (float *)malloc(dim * sizeof(float));
+    max_threads = (config->slot != NULL) ? omp_get_num_procs() : num_threads;
+    local_best = (local_best_t *)malloc(max_threads * sizeof(local_best_t));
+    scratch = (float *)malloc(max_threads * scratch_size * sizeof(float));
+    variant = pso_update_pool_create(config, swarm, block, max_threads);
+    while (lanes % dim != 0)
+        lanes += PSO_MOMENT_LANES;
+    width = 2 * lanes + 2 * PSO_MOMENT_LANES;
+    if (stats != NULL) {
+        moments = (double *)malloc((size_t)num_blocks * (2 * dim + 2) * sizeof(double));
+        lane_sums = (float *)malloc((size_t)max_threads * width * sizeof(float));
+        shift = (float *)malloc((lanes + PSO_MOMENT_LANES) * sizeof(float));
+    }
+    if (dynamic != NULL) {
+        drift = dynamic->shift;
+        moving = pso_dynamic_pool_create(dynamic, swarm->num_particles, dim, config->seed);
+    }
+    if (config->types != NULL)
+        mixed = pso_mixed_pool_create(&discrete, noise == NULL, dim, block, max_threads);
+    if (noise != NULL)
+        noisy = pso_noise_pool_create(noise, swarm->num_particles, block, dim, max_threads, config->seed);
+    if (elite != NULL)
+        pool = pso_elite_pool_create(elite->k, elite->radius, config->xmin, swarm->num_particles, dim, max_threads);
+    if (gbest_x == NULL || local_best == NULL || scratch == NULL || variant == NULL
+        || (stats != NULL && (moments == NULL || lane_sums == NULL || shift == NULL))
+        || (elite != NULL && pool == NULL)
+        || (dynamic != NULL && moving == NULL)
+        || (config->types != NULL && mixed == NULL)
+        || (noise != NULL && noisy == NULL)) {
+        fprintf(stderr, "Malloc error\n");
+        free((void *)gbest_x);
+        free((void *)local_best);
+        free((void *)scratch);
+        pso_update_pool_destroy(variant);
+        free((void *)moments);
+        free((void *)lane_sums);
+        free((void *)shift);
+        pso_elite_pool_destroy(pool);
+        pso_dynamic_pool_destroy(moving);
+        pso_mixed_pool_destroy(mixed);
+        pso_noise_pool_destroy(noisy);
+        return -1;
+    }
+    if (elite != NULL)
+        elite->count = 0;
+    if (noise != NULL)
+        noise->resamples = noise->decisions = noise->correct = 0;
+
+    pso_update_param(variant, config, &param);
+    iter = swarm->num_iters;            /* Not 0 when resuming from a checkpoint */
+    g = swarm->particle[0].g;
+
+    /* Start from snapped positions, which are the pbests */
+    if (mixed != NULL && iter == 0) {
+        pso_mixed_start(mixed, swarm, eval, &param, num_threads);
+        g = pso_get_best_fitness_omp(swarm, num_threads);
+        for (i = 0; i < swarm->num_particles; i++)
+            swarm->particle[i].g = g;
+    }
+
+    /* Sample the initial pbests of a noisy objective */
+    if (noisy != NULL) {
+#pragma omp parallel num_threads(num_threads)
+    {
+        int b;
+
+        #pragma omp for schedule(static)
+        for (b = 0; b < num_blocks; b++)
+            pso_noise_start(noisy, omp_get_thread_num(), swarm, b * block,
+                            (b == num_blocks - 1) ? swarm->num_particles - b * block : block, eval);
+    }
+        swarm->num_evals += pso_noise_end(noisy, swarm, max_threads);
+        g = pso_get_best_fitness_omp(swarm, num_threads);
+        for (i = 0; i < swarm->num_particles; i++)
+            swarm->particle[i].g = g;
     }
 
-    int iter;
-    float w, c1, c2;
-    float curr_fitness;
-    float r1, r2;
-    unsigned int seed = time(NULL);
-    particle_t *particle, *gbest;
+    /* Keep the better of each initial particle and its opposite */
+    if (config->opposition && iter == 0) {
+#pragma omp parallel num_threads(num_threads)
+    {
+        int b, i, n;
+        float *opposite = scratch + omp_get_thread_num() * scratch_size;
+        float *opposite_fitness = opposite + (size_t)block * dim;
+        float *fitness = opposite_fitness + block;
+        size_t offset;
 
-    w = 0.79;
-    c1 = 1.49;
-    c2 = 1.49;
-    iter = 0;
-    int g=-1;
+        #pragma omp for schedule(static)
+        for (b = 0; b < num_blocks; b++) {
+            n = (b == num_blocks - 1) ? swarm->num_particles - b * block : block;
+            offset = (size_t)b * block * dim;
+            for (i = 0; i < n; i++)
+                fitness[i] = swarm->particle[b * block + i].fitness;
+            kernels->opposite(swarm->x + offset, opposite, n * dim, &param);
+            if (mixed != NULL)
+                pso_mixed_snap(mixed, opposite, NULL, n, &param);
+            eval(opposite, n, dim, opposite_fitness);
+            kernels->select(swarm->x + offset, fitness, opposite, opposite_fitness, n, dim);
+            memcpy(swarm->pbest + offset, swarm->x + offset, (size_t)n * dim * sizeof(float));
+            for (i = 0; i < n; i++)
+                swarm->particle[b * block + i].fitness = fitness[i];
+        }
+    }
+        swarm->num_evals += swarm->num_particles;
+        g = pso_get_best_fitness_omp(swarm, num_threads);
+        for (i = 0; i < swarm->num_particles; i++)
+            swarm->particle[i].g = g;
+    }
+    memcpy(gbest_x, swarm->particle[g].pbest, dim * sizeof(float));
+    if (shift != NULL)
+        pso_moment_shift(shift, gbest_x, dim, lanes, swarm->particle[g].fitness);
+    pso_update_start(variant, swarm, num_threads);
 
     while (iter < max_iter) {
-    #pragma omp parallel num_threads(num_threads) shared (g) private(particle, gbest, r1, r2, curr_fitness, seed)
+        pso_trace_iter(iter);
+        if (config->slot != NULL) {
+            num_threads = pso_sched_threads(config->slot, &first_core, &core_epoch);
+            if (num_threads > max_threads)
+                num_threads = max_threads;
+        }
+        pso_update_iteration(variant, &param, iter, max_iter);
+        /* Statistics only for the iterations the caller reads them after */
+        sampled = moments != NULL && (progress->stats_every <= 1 || (iter + 1) % progress->stats_every == 0
+                                      || iter + 1 == max_iter);
+        /* Generation jumping, drawn from the seed and iteration */
+        jump = config->opposition && pso_hash(seed ^ pso_hash(iter)) < config->jump_rate * 4294967296.0;
+        /* Moves of a dynamic objective */
+        if (moving != NULL)
+            changed = pso_dynamic_begin(moving, swarm, eval, &param, iter, g, gbest_x);
+#pragma omp parallel num_threads(num_threads)
     {
-        int i, j;
-        #pragma omp for
-        for (i = 0; i < swarm->num_particles; i++) {
-            seed += i;  //Get different seed for each threads
-            particle = &swarm->particle[i];
-            gbest = &swarm->particle[particle->g];  /* Best performing particle from last iteration */ 
-            for (j = 0; j < particle->dim; j++) {   /* Update this particle's state */
-                r1 = (float)rand_r(&seed)/(float)RAND_MAX;    // Use rand_r instead for different seed
-                r2 = (float)rand_r(&seed)/(float)RAND_MAX;
-                /* Update particle velocity */
-                particle->v[j] = w * particle->v[j]\
-                                + c1 * r1 * (particle->pbest[j] - particle->x[j])\
-                                + c2 * r2 * (gbest->x[j] - particle->x[j]);
-                /* Clamp velocity */
-                if ((particle->v[j] < -fabsf(xmax - xmin)) || (particle->v[j] > fabsf(xmax - xmin))) 
-                    particle->v[j] = uniform_omp(-fabsf(xmax - xmin), fabsf(xmax - xmin), &seed); // Call uniform_omp with customized seed
-
-                /* Update particle position */
-                particle->x[j] = particle->x[j] + particle->v[j];
-                if (particle->x[j] > xmax)
-                    particle->x[j] = xmax;
-                if (particle->x[j] < xmin)
-                    particle->x[j] = xmin;
-            } /* State update */
-            
-            /* Evaluate current fitness */
-            pso_eval_fitness(function, particle, &curr_fitness);
+        int b, i, n, t, best;
+        int tid = omp_get_thread_num();
+        float *curr_fitness = scratch + tid * scratch_size;    /* Fitness of one block */
+        float *best_fitness = curr_fitness + block;
+        float *opposite = best_fitness + block;
+        float *opposite_fitness = opposite + (size_t)block * dim;
+        float *shifted = opposite + (config->opposition ? (size_t)block * (dim + 1) : 0);
+        particle_t *particle;
+        double work_start = (config->live != NULL) ? omp_get_wtime() : 0.0, wait_start = 0.0;
+
+        if (config->slot != NULL)
+            pso_sched_pin(config->slot, first_core, num_threads, core_epoch);
+        pso_update_begin(variant, tid, gbest_x);
+
+        PSO_TRACE_BEGIN(PSO_PHASE_UPDATE);
+        #pragma omp for schedule(static) nowait
+        for (b = 0; b < num_blocks; b++)
+            pso_update_block(variant, tid, swarm, b, iter, gbest_x, &param);
+        /* Evaluation may not overwrite pbests still being read */
+        if (pso_update_shared(variant)) {
+            #pragma omp barrier
+        }
+        PSO_TRACE_END(PSO_PHASE_UPDATE);
+
+        PSO_TRACE_BEGIN(PSO_PHASE_EVALUATE);
+        local_best[tid].fitness = INFINITY;
+        local_best[tid].g = -1;
+        local_best[tid].skipped = 0;
+        if (pool != NULL)
+            pso_elite_begin(pool, tid);
+        #pragma omp for schedule(static) nowait
+        for (b = 0; b < num_blocks; b++) {
+            n = (b == num_blocks - 1) ? swarm->num_particles - b * block : block;
+            if (changed)
+                pso_dynamic_block(moving, swarm, eval, &param, b * block, n, g, shifted, curr_fitness);
+
+            /* Evaluate current fitness of the block */
+            if (mixed != NULL)
+                local_best[tid].skipped += pso_mixed_eval(mixed, tid, swarm, b * block, n, eval, drift, &param,
+                                                          shifted, curr_fitness);
+            else
+                pso_eval_rows(eval, swarm->x + (size_t)b * block * dim, n, dim, drift, &param, shifted, curr_fitness);
+
+            /* Mean of the samples of a noisy objective */
+            if (noisy != NULL)
+                pso_noise_block(noisy, tid, swarm, b * block, n, eval, curr_fitness);
+
+            /* Move to the opposite points that are better */
+            if (jump) {
+                kernels->opposite(swarm->x + (size_t)b * block * dim, opposite, n * dim, &param);
+                if (mixed != NULL)
+                    pso_mixed_snap(mixed, opposite, NULL, n, &param);
+                pso_eval_rows(eval, opposite, n, dim, drift, &param, shifted, opposite_fitness);
+                kernels->select(swarm->x + (size_t)b * block * dim, curr_fitness, opposite, opposite_fitness, n, dim);
+            }
 
             /* Update pbest */
-            if (curr_fitness < particle->fitness) {
-                particle->fitness = curr_fitness;
-                for (j = 0; j < particle->dim; j++)
-                    particle->pbest[j] = particle->x[j];
+            for (i = 0; i < n; i++) {
+                particle = &swarm->particle[b * block + i];
+                if (noisy != NULL)
+                    pso_noise_decide(noisy, tid, b * block + i, i, curr_fitness[i] < particle->fitness);
+                pso_update_stall(variant, b * block + i, curr_fitness[i] < particle->fitness);
+                if (curr_fitness[i] < particle->fitness) {
+                    particle->fitness = curr_fitness[i];
+                    memcpy(particle->pbest, particle->x, dim * sizeof(float));
+                    if (pool != NULL)
+                        pso_elite_offer(pool, tid, particle->fitness, b * block + i);
+                } else if (pool != NULL && iter == 0) {
+                    /* The initial pbests are candidates too */
+                    pso_elite_offer(pool, tid, particle->fitness, b * block + i);
+                }
+                best_fitness[i] = particle->fitness;
             }
-        } /* Particle loop */
-        /* Identify best performing particle */
-    #pragma omp single
-        g = pso_get_best_fitness_omp(swarm, num_threads);
-    #pragma omp for
+
+            /* Moments of the block's positions and fitness for the statistics */
+            if (sampled) {
+                float *sums = lane_sums + (size_t)tid * width;
+
+                kernels->moments(swarm->x + (size_t)b * block * dim, shift, n * dim, lanes, dim, sums, sums + lanes);
+                kernels->moments(curr_fitness, shift + lanes, n, PSO_MOMENT_LANES, 1, sums + 2 * lanes,
+                                 sums + 2 * lanes + PSO_MOMENT_LANES);
+                pso_block_moments(sums, dim, lanes, moments + (size_t)b * (2 * dim + 2));
+            }
+
+            /* Column sums of the block's pbests for the variant */
+            pso_update_sum(variant, tid, swarm, b);
+
+            /* Track this thread's best particle */
+            best = kernels->argmin(best_fitness, n);
+            if (best >= 0 && best_fitness[best] < local_best[tid].fitness) {
+                local_best[tid].fitness = best_fitness[best];
+                local_best[tid].g = b * block + best;
+            }
+        } /* Block loop */
+        if (pool != NULL)
+            pso_elite_end(pool, tid);
+        PSO_TRACE_END(PSO_PHASE_EVALUATE);
+
+        PSO_TRACE_BEGIN(PSO_PHASE_BARRIER);
+        if (config->live != NULL)
+            wait_start = omp_get_wtime();
+        #pragma omp barrier
+        if (config->live != NULL) {
+            local_best[tid].work = wait_start - work_start;
+            local_best[tid].wait = omp_get_wtime() - wait_start;
+        }
+        PSO_TRACE_END(PSO_PHASE_BARRIER);
+
+        /* Identify best performing particle; merge in thread order so ties
+         * resolve to the lowest index as in pso_get_best_fitness */
+        #pragma omp single
+        {
+            int incumbent = g;
+
+            PSO_TRACE_BEGIN(PSO_PHASE_REDUCE);
+            skipped = 0;
+            for (t = 0; t < omp_get_num_threads(); t++) {
+                if (local_best[t].g >= 0 && local_best[t].fitness < swarm->particle[g].fitness)
+                    g = local_best[t].g;
+                skipped += local_best[t].skipped;
+            }
+            /* A noisy new best must beat the old one on more samples */
+            if (noisy != NULL)
+                g = pso_noise_gbest(noisy, tid, swarm, eval, incumbent, g);
+            memcpy(gbest_x, swarm->particle[g].pbest, dim * sizeof(float));
+            if (sampled)
+                pso_merge_stats(moments, num_blocks, swarm->num_particles, dim, lanes, shift, stats);
+            if (moments != NULL)
+                pso_moment_shift(shift, gbest_x, dim, lanes, swarm->particle[g].fitness);
+            pso_update_reduce(variant, swarm);
+            PSO_TRACE_END(PSO_PHASE_REDUCE);
+            if (pool != NULL) {
+                PSO_TRACE_BEGIN(PSO_PHASE_ELITE);
+                pso_elite_merge(pool, omp_get_num_threads(), swarm, elite);
+                PSO_TRACE_END(PSO_PHASE_ELITE);
+            }
+        }
+
+        /* Species leaders of the new pbests */
+        pso_update_leaders(variant, swarm);
+
+        PSO_TRACE_BEGIN(PSO_PHASE_BROADCAST);
+        #pragma omp for schedule(static) nowait
         for (i = 0; i < swarm->num_particles; i++) {
             particle = &swarm->particle[i];
             particle->g = g;
         }
+        PSO_TRACE_END(PSO_PHASE_BROADCAST);
     }
 
 #ifdef SIMPLE_DEBUG
@@ -90,15 +510,232 @@ int optimize_using_omp(char *function, int dim, int swarm_size,
         fprintf(stderr, "\nIteration %d:\n", iter);
         pso_print_particle(&swarm->particle[g]);
 #endif
+        swarm->num_evals += (jump ? 2 : 1) * (long)swarm->num_particles - skipped;
+        swarm->num_skipped += skipped;
+        if (noisy != NULL)
+            swarm->num_evals += pso_noise_end(noisy, swarm, max_threads);
+        if (moving != NULL)
+            pso_dynamic_end(moving, swarm);
         iter++;
+        swarm->num_iters = iter;
+        if (config->live != NULL) {
+            double work = 0.0, wait = 0.0;
+
+            for (i = 0; i < num_threads; i++) {
+                work += local_best[i].work;
+                wait += local_best[i].wait;
+            }
+            if (pso_live_publish(config->live, swarm, g, num_threads, stats, work, wait))
+                break;
+        }
+        if (progress != NULL && progress->callback(progress->arg, iter, g, swarm))
+            break;
     } /* End of iteration */
 
-    /* Solve PSO */
-    if (g >= 0) {
-        fprintf(stderr, "Solution:\n");
-        pso_print_particle(&swarm->particle[g]);
+    /* Hand the pooled threads back unpinned; the slot's cores are about to
+     * go to other optimizations */
+    if (config->slot != NULL) {
+#pragma omp parallel num_threads(max_threads)
+        pso_sched_unpin(config->slot);
+    }
+
+    free((void *)gbest_x);
+    free((void *)local_best);
+    free((void *)scratch);
+    pso_update_pool_destroy(variant);
+    free((void *)moments);
+    free((void *)lane_sums);
+    free((void *)shift);
+    pso_elite_pool_destroy(pool);
+    pso_dynamic_pool_destroy(moving);
+    pso_mixed_pool_destroy(mixed);
+    if (noisy != NULL)
+        pso_noise_finish(noisy, g);
+    pso_noise_pool_destroy(noisy);
+    return g;
+}
+
+/* Evaluations-to-target tracking of a single run */
+typedef struct pso_target_s {
+    float target;
+    int iter;           /* Iterations run */
+    int reached;
+} pso_target_t;
+
+static int pso_check_target(void *arg, int iter, int g, swarm_t *swarm)
+{
+    pso_target_t *target = (pso_target_t *)arg;
+
+    target->iter = iter;
+    target->reached = (swarm->particle[g].fitness <= target->target);
+    return target->reached;
+}
+
+int optimize_using_omp(pso_config_t *config)
+{
+    /* Initialize PSO */
+    swarm_t *swarm;
+    swarm = pso_alloc(NULL, config->dim, config->swarm_size, pso_variant_velocity(config));
+    if (swarm != NULL && config->resume_path != NULL) {
+        /* Continue a stopped run */
+        if (pso_checkpoint_read(config->resume_path, swarm, config) < 0) {
+            pso_free(swarm);
+            return -1;
+        }
+        fprintf(stderr, "Resuming from %s after iteration %d of %d\n", config->resume_path, swarm->num_iters,
+                config->max_iter);
+        if (config->live != NULL)
+            config->live->window_evals = swarm->num_evals;
+    } else if (swarm != NULL && pso_init_swarm_omp(swarm, config->function, config->xmin, config->xmax,
+                                                   config->num_threads, config->seed) < 0) {
+        pso_free(swarm);
+        swarm = NULL;
+    }
+    if (swarm == NULL) {
+        fprintf(stderr, "Unable to initialize PSO\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Solve PSO, stopping at the target fitness if there is one */
+    int g, i;
+    pso_target_t target = { config->target, 0, 0 };
+    pso_elite_t elite = { config->elite, pso_elite_radius(config), 0, NULL, NULL };
+    particle_t *member = NULL;
+    double timing[2];
+    pso_progress_t progress = { pso_check_target, &target, NULL, 0, NULL, NULL, NULL };
+    pso_stats_t stats = { NULL, 0.0, 0.0, 0.0 };
+    pso_noise_t noise = { config->noise, config->noise_samples, config->max_samples, 0, 0, 0, 0.0f, 0.0f };
+    pso_drift_t drift;
+    pso_dynamic_t dynamic = { pso_drift_change, &drift, NULL, config->detect, config->sentinels,
+                              config->rediversify, config->memory, 0, 0 };
+    pso_track_t track = { pso_find_objective(config->function), &dynamic, &drift, config->xmin, config->xmax, NULL,
+                          0.0, 0, 0.0, 0, 0.0, 0 };
+    if (config->elite > 0) {
+        elite.fitness = (float *)malloc(config->elite * sizeof(float));
+        elite.x = (float *)malloc((size_t)config->elite * config->dim * sizeof(float));
+        member = (particle_t *)malloc(config->elite * sizeof(particle_t));
+        if (elite.fitness == NULL || elite.x == NULL || member == NULL) {
+            fprintf(stderr, "Malloc error\n");
+            g = -1;
+            goto done;
+        }
+        progress.elite = &elite;
+    }
+    if (config->dynamic_period > 0) {
+        /* Measure the tracking error in place of checking a target */
+        pso_drift_init(&drift, config);
+        dynamic.shift = (float *)calloc(config->dim, sizeof(float));
+        track.x = (float *)malloc(config->dim * sizeof(float));
+        if (dynamic.shift == NULL || track.x == NULL) {
+            fprintf(stderr, "Malloc error\n");
+            g = -1;
+            goto done;
+        }
+        progress.callback = pso_track;
+        progress.arg = &track;
+        progress.dynamic = &dynamic;
+    }
+    if (config->noise > 0)
+        progress.noise = &noise;
+    if (config->live != NULL)
+        progress.stats = &stats;    /* Diversity for the live page */
+    g = pso_solve_omp(swarm, config, (config->target > -INFINITY || config->elite > 0 || config->dynamic_period > 0
+                                      || config->noise > 0 || config->live != NULL) ? &progress : NULL);
+    if (g >= 0 && config->dynamic_period > 0) {
+        fprintf(stderr, "Dynamic: %d moves of %g every %d iterations, %d detected (%s, mean delay %.2f iterations)\n",
+                drift.changes, drift.step, drift.period, dynamic.changes,
+                (config->detect == PSO_DETECT_SIGNAL) ? "signal" : (config->detect == PSO_DETECT_SENTINEL) ? "sentinels" : "none",
+                (track.detected > 0) ? track.delay_sum / track.detected : 0.0);
+        fprintf(stderr, "Tracking error: offline %g, before moves %g; %ld re-evaluations, %.2f%% of %ld evaluations\n",
+                track.error_sum / track.iters, (track.befores > 0) ? track.before_sum / track.befores : NAN,
+                dynamic.reevals, 100.0 * dynamic.reevals / swarm->num_evals, swarm->num_evals);
+    }
+    if (g >= 0 && config->live != NULL && config->live->stop)
+        fprintf(stderr, "Stopped by signal after iteration %d of %d\n", swarm->num_iters, config->max_iter);
+    if (g >= 0 && (config->checkpoint_path != NULL || (config->live != NULL && config->live->stop))) {
+        const char *path = (config->checkpoint_path != NULL) ? config->checkpoint_path : PSO_CHECKPOINT_DEFAULT;
+
+        if (pso_checkpoint_write(path, swarm, config) == 0)
+            fprintf(stderr, "Checkpoint written to %s\n", path);
+        else
+            fprintf(stderr, "Could not write checkpoint %s\n", path);
+    }
+    if (g >= 0 && config->noise > 0) {
+        if (config->noise_samples > 0)
+            fprintf(stderr, "Noise: sigma %g, %d samples per point", config->noise, config->noise_samples);
+        else
+            fprintf(stderr, "Noise: sigma %g, racing up to %d samples", config->noise, config->max_samples);
+        fprintf(stderr, " (estimated %g); %ld pbest decisions, %.2f%% correct\n", noise.sigma_hat, noise.decisions,
+                (noise.decisions > 0) ? 100.0 * noise.correct / noise.decisions : 0.0);
+        fprintf(stderr, "Resamples: %ld, %.2f%% of %ld evaluations; noise-free fitness of the best %.9g\n",
+                noise.resamples, 100.0 * noise.resamples / swarm->num_evals, swarm->num_evals, noise.truth);
+    }
+    if (g >= 0 && config->types != NULL) {
+        pso_space_t space;
+
+        if (pso_parse_space(config->types, config->dim, config->xmin, config->xmax, &space) == 0
+            && space.num_continuous > 0)
+            fprintf(stderr, "Mixed: %s; no evaluations skipped, continuous dimensions rarely land back on pbest\n",
+                    config->types);
+        else
+            fprintf(stderr, "Mixed: %s; %ld evaluations skipped on pbests, %.2f%% of %ld\n", config->types,
+                    swarm->num_skipped, 100.0 * swarm->num_skipped / (swarm->num_evals + swarm->num_skipped),
+                    swarm->num_evals + swarm->num_skipped);
+        free((void *)space.options);
+    }
+    if (g >= 0 && config->variant == PSO_VARIANT_SPECIES) {
+        int *niche = (int *)malloc(config->swarm_size * sizeof(int));
+        int num_niches = (niche != NULL) ? pso_find_niches(swarm, config, niche, timing) : -1;
+        particle_t *optimum = (num_niches > 0) ? (particle_t *)malloc(num_niches * sizeof(particle_t)) : NULL;
+
+        if (optimum != NULL) {
+            fprintf(stderr, "Niches: %d optima with radius %g; grid rebuild %.3f ms, queries %.3f ms for %d particles\n",
+                    num_niches, pso_niche_radius(config), timing[0] * 1e3, timing[1] * 1e3, config->swarm_size);
+            for (i = 0; i < num_niches; i++)
+                optimum[i] = swarm->particle[niche[i]];
+            if (pso_write_solutions(config, optimum, num_niches, "Optimum") < 0) {
+                fprintf(stderr, "Could not write solution\n");
+                g = -1;
+            }
+        }
+        if (optimum == NULL)
+            g = -1;
+        free((void *)niche);
+        free((void *)optimum);
+        goto done;
+    }
+    if (g >= 0 && config->target > -INFINITY) {
+        if (target.reached)
+            fprintf(stderr, "Target %g reached after %ld evaluations (%d iterations)\n", config->target,
+                    swarm->num_evals, target.iter);
+        else
+            fprintf(stderr, "Target %g not reached in %ld evaluations\n", config->target, swarm->num_evals);
+    }
+    if (g >= 0 && config->elite > 0) {
+        /* The archive in place of the best solution, which leads it */
+        fprintf(stderr, "Elite: %d of %d solutions more than %g apart\n", elite.count, elite.k, elite.radius);
+        for (i = 0; i < elite.count; i++) {
+            member[i].dim = config->dim;
+            member[i].x = member[i].pbest = elite.x + (size_t)i * config->dim;
+            member[i].v = NULL;
+            member[i].fitness = elite.fitness[i];
+            member[i].g = g;
+        }
+        if (pso_write_solutions(config, member, elite.count, "Elite") < 0) {
+            fprintf(stderr, "Could not write solution\n");
+            g = -1;
+        }
+    } else if (g >= 0 && pso_write_solution(config, &swarm->particle[g]) < 0) {
+        fprintf(stderr, "Could not write solution\n");
+        g = -1;
     }
 
+done:
+    free((void *)dynamic.shift);
+    free((void *)track.x);
+    free((void *)elite.fitness);
+    free((void *)elite.x);
+    free((void *)member);
     pso_free(swarm);
     return g;
-}
\ No newline at end of file
+}
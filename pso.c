@@ -14,58 +14,537 @@
  * Student/team: Dinh Nguyen, Tri Pham, Phi Manh Cuong
  * Date: Feb 9 2021
  */  
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <math.h>
 #include <omp.h>
 #include <sys/time.h>
 #include "pso.h"
 
-int main(int argc, char **argv)
+static void usage(char *name)
 {
-    if (argc < 8) {
-        fprintf(stderr, "Usage: %s function-name dimension swarm-size xmin xmax max-iter num-threads\n", argv[0]);
-        fprintf(stderr, "function-name: name of function to optimize\n");
-        fprintf(stderr, "dimension: dimensionality of search space\n");
-        fprintf(stderr, "swarm-size: number of particles in swarm\n");
-        fprintf(stderr, "xmin, xmax: lower and upper bounds on search domain\n");
-        fprintf(stderr, "max-iter: number of iterations to run the optimizer\n");
-        fprintf(stderr, "num-threads: number of threads to create\n");
-        exit(EXIT_FAILURE);
+    const pso_objective_t *objective;
+
+    fprintf(stderr, "Usage: %s [options] [function-name [dimension [swarm-size [xmin [xmax [max-iter [num-threads]]]]]]]\n", name);
+    fprintf(stderr, "  -f, --function NAME     name of function to optimize\n");
+    fprintf(stderr, "  -d, --dim D             dimensionality of search space\n");
+    fprintf(stderr, "  -n, --swarm-size N      number of particles in swarm (default 1000)\n");
+    fprintf(stderr, "      --xmin X, --xmax X  lower and upper bounds on search domain\n");
+    fprintf(stderr, "  -i, --max-iter N        number of iterations to run the optimizer (default 1000)\n");
+    fprintf(stderr, "  -t, --num-threads N     number of threads to create (default: number of processors); auto picks\n");
+    fprintf(stderr, "                          the count for the problem size from a calibrated cost model\n");
+    fprintf(stderr, "  -e, --engine NAME       engine to run: gold (serial reference) or omp (default)\n");
+    fprintf(stderr, "      --variant NAME      update rule of the OpenMP engine: gbest (default), fips (fully informed),\n"
+                    "                          clpso (comprehensive learning), barebones (Gaussian sampling,\n"
+                    "                          no velocities), qpso (quantum behaved, no velocities) or species\n"
+                    "                          (niching: reports every optimum found)\n");
+    fprintf(stderr, "      --topology NAME     neighborhood of fips: ring (default) or lattice (von Neumann)\n");
+    fprintf(stderr, "      --inertia W         inertia weight of the gbest and species updates (default 0.79)\n");
+    fprintf(stderr, "      --c1 C, --c2 C      pulls towards pbest and gbest of those updates (default 1.49 each)\n");
+    fprintf(stderr, "      --niche-radius R    species radius of the species variant (default: a tenth of the domain)\n");
+    fprintf(stderr, "      --elite K           report the K best solutions found that are more than the elite radius apart\n");
+    fprintf(stderr, "      --elite-radius R    distance under which a solution duplicates a better one (default: a\n"
+                    "                          thousandth of the domain)\n");
+    fprintf(stderr, "      --opposition RATE   evaluate the opposite points of the initial swarm, and of the swarm in a\n");
+    fprintf(stderr, "                          fraction RATE of iterations (0.3 is typical), keeping the better ones\n");
+    fprintf(stderr, "      --target F          stop once the best fitness is at most F and report the evaluations used\n");
+    fprintf(stderr, "      --dynamic PERIOD    move the optimum every PERIOD iterations and report the tracking error\n");
+    fprintf(stderr, "      --severity S        length of a move as a fraction of the domain (default 0.02)\n");
+    fprintf(stderr, "      --detect METHOD     how moves are detected: signal (default, the objective tells), sentinel\n"
+                    "                          (re-evaluated pbests) or none (fitness goes stale)\n");
+    fprintf(stderr, "      --sentinels N       pbests re-evaluated every iteration by sentinel detection (default 4)\n");
+    fprintf(stderr, "      --rediversify F     fraction of the particles redrawn on a move (default 0.2)\n");
+    fprintf(stderr, "      --memory M          best positions before the last M moves re-injected on a move (default 4)\n");
+    fprintf(stderr, "      --types SPEC        kinds of the dimensions, continuous first, then integer, then categorical:\n"
+                    "                          runs of COUNT*c, COUNT*i or COUNT*kK (K options), e.g. 4*c,6*i,2*k3\n");
+    fprintf(stderr, "      --noise SIGMA       add normal noise of standard deviation SIGMA to every evaluation\n");
+    fprintf(stderr, "      --noise-samples N   evaluate every point N times, or 0 (default) to resample only close\n"
+                    "                          pbest and gbest comparisons\n");
+    fprintf(stderr, "      --max-samples N     samples of one point at most when resampling close comparisons (default 16)\n");
+    fprintf(stderr, "      --checkpoint FILE   write the swarm state to FILE at the end of the run (default: only when\n"
+                    "                          stopped by SIGINT or SIGTERM, to " PSO_CHECKPOINT_DEFAULT ")\n");
+    fprintf(stderr, "      --resume FILE       continue the run saved in the checkpoint FILE; give the same options\n");
+    fprintf(stderr, "      --metrics FILE      export the live statistics (see pso_top) to the Prometheus textfile FILE\n");
+    fprintf(stderr, "      --metrics-every S   seconds between exports (default 10)\n");
+    fprintf(stderr, "      --expr EXPR         optimize the expression EXPR over x[0] .. x[D-1] as the function expr,\n"
+                    "                          e.g. 'sum(x[i]^2)' (see pso_expr.c; default D = %d, [-10, 10])\n",
+            PSO_EXPR_DIM);
+    fprintf(stderr, "      --compile           evaluate the expression with a C module built for it and D by $CC\n"
+                    "                          (default cc) and cached; interpreted if it cannot be built\n");
+    fprintf(stderr, "      --expr-cache DIR    directory of the cached modules (default: $PSO_CACHE or ~/.cache/pso)\n");
+    fprintf(stderr, "  -c, --compare           run the reference engine first and then the selected engine\n");
+    fprintf(stderr, "  -s, --seed N            random seed (default: current time)\n");
+    fprintf(stderr, "      --jobs FILE         run the JSON job specs of FILE (- for stdin), one result line per job\n");
+    fprintf(stderr, "      --jobs-order ORDER  report batch results in input order (input, default) or as they complete (completion)\n");
+    fprintf(stderr, "      --tune FILE         race the candidate job specs of FILE on seeds from --seed and print the\n"
+                    "                          winner as a job spec\n");
+    fprintf(stderr, "      --tune-budget N     runs the race may spend (default 20 per candidate)\n");
+    fprintf(stderr, "      --tune-out FILE     write the winner to FILE (default: stdout)\n");
+    fprintf(stderr, "      --config FILE       load the parameters of the first job spec of FILE, such as a --tune winner;\n"
+                    "                          later options override them\n");
+    fprintf(stderr, "      --serve SOCKET      serve optimization requests on a Unix domain socket (see pso_serve.c)\n");
+    fprintf(stderr, "      --trace FILE        write a Chrome trace of the OpenMP solver threads to FILE\n");
+    fprintf(stderr, "      --trace-every N     trace every Nth iteration (default 100)\n");
+    fprintf(stderr, "  -o, --output FILE       write the solution to FILE (- for stdout; default: stderr)\n");
+    fprintf(stderr, "      --format FORMAT     solution format: text (default), csv, json or binary\n");
+    fprintf(stderr, "      --isa ISA           kernels of the OpenMP engine: auto (default: best the CPU supports), sse2, avx2 or avx512\n");
+    fprintf(stderr, "  -h, --help              print this message\n");
+    fprintf(stderr, "Dimension and bounds default to the values registered for the function:\n");
+    for (objective = pso_objectives; objective->name != NULL; objective++)
+        fprintf(stderr, "  %-14s D = %-3d [%g, %g]\n", objective->name, objective->dim, objective->xmin, objective->xmax);
+}
+
+/* Count argument name (dimension, swarm size, iterations or threads); only an
+ * omitted argument takes the default, so values below 1 are reported and
+ * returned for the caller to reject */
+static int pso_count_arg(const char *arg, const char *name)
+{
+    int value = atoi(arg);
+
+    if (value < 1)
+        fprintf(stderr, "%s must be at least 1, not %s\n", name, arg);
+    return value;
+}
+
+/* Fill config from command line. Named options may be followed by the old
+ * positional form function-name dimension swarm-size xmin xmax max-iter num-threads;
+ * option parsing stops at the first positional argument so negative bounds
+ * are not mistaken for options. Options given by name win. Return 0 on
+ * success, -1 otherwise.
+ */
+int pso_parse_args(int argc, char **argv, pso_config_t *config)
+{
+    static struct option long_options[] = {
+        { "function",    required_argument, NULL, 'f' },
+        { "dim",         required_argument, NULL, 'd' },
+        { "swarm-size",  required_argument, NULL, 'n' },
+        { "xmin",        required_argument, NULL, 'x' },
+        { "xmax",        required_argument, NULL, 'X' },
+        { "max-iter",    required_argument, NULL, 'i' },
+        { "num-threads", required_argument, NULL, 't' },
+        { "engine",      required_argument, NULL, 'e' },
+        { "compare",     no_argument,       NULL, 'c' },
+        { "seed",        required_argument, NULL, 's' },
+        { "jobs",        required_argument, NULL, 'J' },
+        { "jobs-order",  required_argument, NULL, 'O' },
+        { "serve",       required_argument, NULL, 'S' },
+        { "trace",       required_argument, NULL, 'T' },
+        { "trace-every", required_argument, NULL, 'E' },
+        { "output",      required_argument, NULL, 'o' },
+        { "format",      required_argument, NULL, 'F' },
+        { "isa",         required_argument, NULL, 'I' },
+        { "variant",     required_argument, NULL, 'V' },
+        { "topology",    required_argument, NULL, 'P' },
+        { "target",      required_argument, NULL, 'G' },
+        { "opposition",  required_argument, NULL, 'B' },
+        { "niche-radius", required_argument, NULL, 'R' },
+        { "elite",       required_argument, NULL, 'K' },
+        { "elite-radius", required_argument, NULL, 'W' },
+        { "dynamic",     required_argument, NULL, 'D' },
+        { "severity",    required_argument, NULL, 'Z' },
+        { "detect",      required_argument, NULL, 'M' },
+        { "sentinels",   required_argument, NULL, 'N' },
+        { "rediversify", required_argument, NULL, 'U' },
+        { "memory",      required_argument, NULL, 'Y' },
+        { "types",       required_argument, NULL, 'L' },
+        { "noise",       required_argument, NULL, 'Q' },
+        { "noise-samples", required_argument, NULL, 'A' },
+        { "max-samples", required_argument, NULL, 'H' },
+        { "inertia",     required_argument, NULL, 'w' },
+        { "c1",          required_argument, NULL, 'p' },
+        { "c2",          required_argument, NULL, 'q' },
+        { "config",      required_argument, NULL, 'C' },
+        { "tune",        required_argument, NULL, 'r' },
+        { "tune-budget", required_argument, NULL, 'b' },
+        { "tune-out",    required_argument, NULL, 'u' },
+        { "checkpoint",  required_argument, NULL, 'k' },
+        { "resume",      required_argument, NULL, 'g' },
+        { "metrics",     required_argument, NULL, 'm' },
+        { "metrics-every", required_argument, NULL, 'v' },
+        { "expr",        required_argument, NULL, 'a' },
+        { "compile",     no_argument,       NULL, 'j' },
+        { "expr-cache",  required_argument, NULL, 'l' },
+        { "help",        no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    char *function = NULL;
+    int dim = 0, swarm_size = 0, max_iter = 0, num_threads = 0;
+    int have_xmin = 0, have_xmax = 0;
+    float xmin = 0, xmax = 0;
+    int opt, npos;
+    const pso_objective_t *objective;
+    pso_job_t *loaded;
+
+    memset(config, 0, sizeof(pso_config_t));
+    config->engine = PSO_ENGINE_OMP;
+    config->seed = time(NULL);
+    config->trace_every = 100;
+    config->jobs_in_order = 1;
+    config->target = -INFINITY;
+    pso_dynamic_defaults(config);
+    config->max_samples = 16;
+
+    while ((opt = getopt_long(argc, argv, "+f:d:n:i:t:e:s:o:ch", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'f': function = optarg; break;
+        case 'd':
+            if ((dim = pso_count_arg(optarg, "D")) < 1)
+                return -1;
+            break;
+        case 'n':
+            if ((swarm_size = pso_count_arg(optarg, "Swarm size")) < 1)
+                return -1;
+            break;
+        case 'x': xmin = atof(optarg); have_xmin = 1; break;
+        case 'X': xmax = atof(optarg); have_xmax = 1; break;
+        case 'i':
+            if ((max_iter = pso_count_arg(optarg, "Max iterations")) < 1)
+                return -1;
+            break;
+        case 't':
+            if (strcmp(optarg, "auto") == 0)
+                config->auto_threads = 1;
+            else if ((num_threads = pso_count_arg(optarg, "Threads")) < 1)
+                return -1;
+            break;
+        case 'c': config->compare = 1; break;
+        case 's': config->seed = strtoul(optarg, NULL, 10); break;
+        case 'J': config->jobs_path = optarg; break;
+        case 'O':
+            if (strcmp(optarg, "input") == 0)
+                config->jobs_in_order = 1;
+            else if (strcmp(optarg, "completion") == 0)
+                config->jobs_in_order = 0;
+            else {
+                fprintf(stderr, "Unknown result order %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'S': config->serve_path = optarg; break;
+        case 'G': config->target = atof(optarg); break;
+        case 'B':
+            config->opposition = 1;
+            config->jump_rate = atof(optarg);
+            break;
+        case 'R': config->niche_radius = atof(optarg); break;
+        case 'K': config->elite = atoi(optarg); break;
+        case 'W': config->elite_radius = atof(optarg); break;
+        case 'D': config->dynamic_period = atoi(optarg); break;
+        case 'Z': config->severity = atof(optarg); break;
+        case 'M':
+            if (pso_parse_detect(optarg, config) < 0) {
+                fprintf(stderr, "Unknown detection method %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'N': config->sentinels = atoi(optarg); break;
+        case 'U': config->rediversify = atof(optarg); break;
+        case 'Y': config->memory = atoi(optarg); break;
+        case 'L': config->types = optarg; break;
+        case 'Q': config->noise = atof(optarg); break;
+        case 'A': config->noise_samples = atoi(optarg); break;
+        case 'H': config->max_samples = atoi(optarg); break;
+        case 'w': config->inertia = atof(optarg); break;
+        case 'p': config->c1 = atof(optarg); break;
+        case 'q': config->c2 = atof(optarg); break;
+        case 'C':
+            /* A saved configuration, such as the winner of --tune; later
+             * options override it */
+            loaded = pso_read_jobs(optarg, &npos);
+            if (loaded == NULL || npos < 1 || loaded[0].status < 0) {
+                fprintf(stderr, "Could not load a configuration from %s%s%s\n", optarg,
+                        (loaded != NULL && npos > 0) ? ": " : "", (loaded != NULL && npos > 0) ? loaded[0].error : "");
+                free((void *)loaded);
+                return -1;
+            }
+            function = loaded[0].config.function;
+            dim = loaded[0].config.dim;
+            swarm_size = loaded[0].config.swarm_size;
+            xmin = loaded[0].config.xmin;
+            xmax = loaded[0].config.xmax;
+            have_xmin = have_xmax = 1;
+            max_iter = loaded[0].config.max_iter;
+            if (loaded[0].seeded)
+                config->seed = loaded[0].config.seed;
+            config->engine = loaded[0].config.engine;
+            config->variant = loaded[0].config.variant;
+            config->topology = loaded[0].config.topology;
+            config->inertia = loaded[0].config.inertia;
+            config->c1 = loaded[0].config.c1;
+            config->c2 = loaded[0].config.c2;
+            config->opposition = loaded[0].config.opposition;
+            config->jump_rate = loaded[0].config.jump_rate;
+            config->niche_radius = loaded[0].config.niche_radius;
+            free((void *)loaded);
+            break;
+        case 'r': config->tune_path = optarg; break;
+        case 'b': config->tune_budget = atoi(optarg); break;
+        case 'u': config->tune_out = optarg; break;
+        case 'k': config->checkpoint_path = optarg; break;
+        case 'g': config->resume_path = optarg; break;
+        case 'm': config->metrics_path = optarg; break;
+        case 'v': config->metrics_every = atoi(optarg); break;
+        case 'a': config->expr = optarg; break;
+        case 'j': config->compile = 1; break;
+        case 'l': config->expr_cache = optarg; break;
+        case 'T': config->trace_path = optarg; break;
+        case 'E': config->trace_every = atoi(optarg); break;
+        case 'o': config->output_path = optarg; break;
+        case 'I': config->isa = optarg; break;
+        case 'V':
+            if (pso_parse_variant(optarg, config) < 0) {
+                fprintf(stderr, "Unknown variant %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'P':
+            if (pso_parse_topology(optarg, config) < 0) {
+                fprintf(stderr, "Unknown topology %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'F':
+            if (pso_parse_format(optarg, &config->output_format) < 0) {
+                fprintf(stderr, "Unknown output format %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'e':
+            if (strcmp(optarg, "gold") == 0)
+                config->engine = PSO_ENGINE_GOLD;
+            else if (strcmp(optarg, "omp") == 0)
+                config->engine = PSO_ENGINE_OMP;
+            else {
+                fprintf(stderr, "Unknown engine %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'h':
+        default:
+            return -1;
+        }
     }
 
-    char *function = argv[1];
-    int dim = atoi(argv[2]);
-    int swarm_size = atoi(argv[3]);
-    float xmin = atof(argv[4]);
-    float xmax = atof(argv[5]);
-    int max_iter = atoi(argv[6]);
-    int num_threads = atoi(argv[7]);
+    /* Old positional form */
+    npos = argc - optind;
+    if (npos > 7) {
+        fprintf(stderr, "Too many arguments\n");
+        return -1;
+    }
+    if (npos > 0 && function == NULL) function = argv[optind];
+    if (npos > 1 && dim == 0 && (dim = pso_count_arg(argv[optind + 1], "D")) < 1)
+        return -1;
+    if (npos > 2 && swarm_size == 0 && (swarm_size = pso_count_arg(argv[optind + 2], "Swarm size")) < 1)
+        return -1;
+    if (npos > 3 && !have_xmin) { xmin = atof(argv[optind + 3]); have_xmin = 1; }
+    if (npos > 4 && !have_xmax) { xmax = atof(argv[optind + 4]); have_xmax = 1; }
+    if (npos > 5 && max_iter == 0 && (max_iter = pso_count_arg(argv[optind + 5], "Max iterations")) < 1)
+        return -1;
+    if (npos > 6 && num_threads == 0 && !config->auto_threads) {
+        if (strcmp(argv[optind + 6], "auto") == 0)
+            config->auto_threads = 1;
+        else if ((num_threads = pso_count_arg(argv[optind + 6], "Threads")) < 1)
+            return -1;
+    }
 
-    struct timeval start, stop;
+    /* Job specs carry their own parameters */
+    if (config->jobs_path != NULL || config->serve_path != NULL || config->tune_path != NULL) {
+        if (npos > 0 || config->expr != NULL) {
+            fprintf(stderr, "Positional arguments and --expr cannot be combined with --jobs, --serve or --tune\n");
+            return -1;
+        }
+        config->num_threads = (num_threads > 0) ? num_threads : omp_get_num_procs();
+        return 0;
+    }
+
+    /* An expression is checked and built for its dimension before the
+     * registry lookup finds it */
+    if (config->expr != NULL) {
+        if (function != NULL && strcmp(function, PSO_EXPR_NAME) != 0) {
+            fprintf(stderr, "--expr defines the function %s; no other function can be given\n", PSO_EXPR_NAME);
+            return -1;
+        }
+        function = PSO_EXPR_NAME;
+        if (pso_expr_load(config->expr, (dim > 0) ? dim : PSO_EXPR_DIM, config->compile, config->expr_cache,
+                          NULL) == NULL)
+            return -1;
+    } else if (config->compile) {
+        fprintf(stderr, "--compile needs --expr\n");
+        return -1;
+    }
+
+    if (function == NULL) {
+        fprintf(stderr, "No function to optimize given\n");
+        return -1;
+    }
+    objective = pso_find_objective(function);
+    if (objective == NULL) {
+        fprintf(stderr, "Unknown function %s\n", function);
+        return -1;
+    }
+
+    /* Defaults from the function registry */
+    config->function = function;
+    config->dim = (dim > 0) ? dim : objective->dim;
+    config->swarm_size = (swarm_size > 0) ? swarm_size : 1000;
+    config->xmin = have_xmin ? xmin : objective->xmin;
+    config->xmax = have_xmax ? xmax : objective->xmax;
+    config->max_iter = (max_iter > 0) ? max_iter : 1000;
+    config->num_threads = (num_threads > 0) ? num_threads : omp_get_num_procs();
+
+    if (config->dim < objective->min_dim) {
+        fprintf(stderr, "Function %s needs at least %d dimensions\n", function, objective->min_dim);
+        return -1;
+    }
+    if (config->xmin >= config->xmax) {
+        fprintf(stderr, "xmin must be smaller than xmax\n");
+        return -1;
+    }
+    if (config->variant != PSO_VARIANT_GBEST && config->engine == PSO_ENGINE_GOLD) {
+        fprintf(stderr, "The gold engine only runs the gbest variant\n");
+        return -1;
+    }
+    if (config->inertia < 0 || config->c1 < 0 || config->c2 < 0
+        || ((config->inertia > 0 || config->c1 > 0 || config->c2 > 0) && config->engine == PSO_ENGINE_GOLD)) {
+        fprintf(stderr, "--inertia, --c1 and --c2 need the OpenMP engine and must be positive\n");
+        return -1;
+    }
+    if (config->target > -INFINITY && config->engine == PSO_ENGINE_GOLD) {
+        fprintf(stderr, "--target needs the OpenMP engine\n");
+        return -1;
+    }
+    if (config->opposition && (config->engine == PSO_ENGINE_GOLD || config->jump_rate < 0 || config->jump_rate > 1)) {
+        fprintf(stderr, "--opposition needs the OpenMP engine and a jump rate between 0 and 1\n");
+        return -1;
+    }
+    if (config->niche_radius < 0) {
+        fprintf(stderr, "--niche-radius must be positive\n");
+        return -1;
+    }
+    if (config->elite < 0 || config->elite_radius < 0 || (config->elite > 0 && config->engine == PSO_ENGINE_GOLD)) {
+        fprintf(stderr, "--elite needs the OpenMP engine, and --elite and --elite-radius must be positive\n");
+        return -1;
+    }
+    if (config->dynamic_period < 0 || (config->dynamic_period > 0
+                                       && (config->engine == PSO_ENGINE_GOLD || config->elite > 0
+                                           || config->target > -INFINITY || config->expr != NULL))) {
+        fprintf(stderr, "--dynamic needs the OpenMP engine and does not combine with --elite, --target or --expr\n");
+        return -1;
+    }
+    if (config->severity < 0 || config->severity > 1 || config->sentinels < 1 || config->rediversify < 0
+        || config->rediversify > 1 || config->memory < 0) {
+        fprintf(stderr, "--severity and --rediversify must be between 0 and 1, --sentinels at least 1 and --memory at least 0\n");
+        return -1;
+    }
+    if (config->noise < 0 || config->noise_samples < 0 || config->max_samples < 2
+        || (config->noise > 0 && (config->engine == PSO_ENGINE_GOLD || config->opposition
+                                  || config->dynamic_period > 0))) {
+        fprintf(stderr, "--noise needs the OpenMP engine and does not combine with --opposition or --dynamic;\n"
+                        "--noise-samples must be at least 0 and --max-samples at least 2\n");
+        return -1;
+    }
+    if ((config->checkpoint_path != NULL || config->resume_path != NULL || config->metrics_path != NULL)
+        && config->engine == PSO_ENGINE_GOLD) {
+        fprintf(stderr, "--checkpoint, --resume and --metrics need the OpenMP engine\n");
+        return -1;
+    }
+    if (config->metrics_every < 0) {
+        fprintf(stderr, "--metrics-every must be positive\n");
+        return -1;
+    }
+    if (config->resume_path != NULL && (config->compare || config->elite > 0 || config->dynamic_period > 0
+                                        || config->noise > 0)) {
+        fprintf(stderr, "--resume does not combine with --compare, --elite, --dynamic or --noise\n");
+        return -1;
+    }
+    if (config->types != NULL) {
+        pso_space_t space;
+
+        if (config->engine == PSO_ENGINE_GOLD
+            || pso_parse_space(config->types, config->dim, config->xmin, config->xmax, &space) < 0) {
+            fprintf(stderr, "--types needs the OpenMP engine and must declare all %d dimensions, grouped as\n"
+                            "continuous, integer, categorical, with integers in the domain\n", config->dim);
+            return -1;
+        }
+        free((void *)space.options);
+    }
+    return 0;
+}
 
-    /* Optimize using reference version */
+/* Run one engine and report its execution time. Return engine status */
+static int run_engine(pso_config_t *config, pso_engine_t engine)
+{
     int status;
+    struct timeval start, stop;
+
     gettimeofday(&start, NULL);
-    status = optimize_gold(function, dim, swarm_size, xmin, xmax, max_iter);
+    if (engine == PSO_ENGINE_GOLD)
+        status = optimize_gold(config);
+    else
+        status = optimize_using_omp(config);
     gettimeofday(&stop, NULL);
     if (status < 0) {
-        fprintf(stderr, "Error optimizing function using reference code\n");
-        exit (EXIT_FAILURE);
+        fprintf(stderr, "Error optimizing function using %s\n", (engine == PSO_ENGINE_GOLD) ? "reference code" : "OpenMP");
+        return status;
     }
     fprintf(stderr, "Execution time = %fs\n", (float)(stop.tv_sec - start.tv_sec + (stop.tv_usec - start.tv_usec)/(float)1000000));
+    return status;
+}
 
-    /* FIXME: Complete this function to perform PSO using OpenMP. 
-     * Return -1 on error, 0 on success. Print best-performing 
-     * particle within the function prior to returning. 
-     */
-    gettimeofday(&start, NULL);
-    status = optimize_using_omp(function, dim, swarm_size, xmin, xmax, max_iter, num_threads);
-    gettimeofday(&stop, NULL);
-    if (status < 0) {
-        fprintf(stderr, "Error optimizing function using OpenMP\n");
-        exit (EXIT_FAILURE);
+int main(int argc, char **argv)
+{
+    pso_config_t config;
+
+    if (pso_parse_args(argc, argv, &config) < 0) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
     }
-    fprintf(stderr, "Execution time = %fs\n", (float)(stop.tv_sec - start.tv_sec + (stop.tv_usec - start.tv_usec)/(float)1000000));
+
+    /* Pick the kernel variants once, before any thread starts */
+    if (pso_kernels_select(config.isa) < 0)
+        exit(EXIT_FAILURE);
+    fprintf(stderr, "Kernels: %s (uniform, update, argmin, batch objectives), %s sums\n", pso_kernels->isa,
+            pso_sum_policy);
+
+    if (config.jobs_path != NULL)
+        exit((pso_run_jobs(&config) < 0) ? EXIT_FAILURE : EXIT_SUCCESS);
+    if (config.tune_path != NULL)
+        exit((pso_tune(&config) < 0) ? EXIT_FAILURE : EXIT_SUCCESS);
+    if (config.serve_path != NULL)
+        exit((pso_serve(&config) < 0) ? EXIT_FAILURE : EXIT_SUCCESS);
+
+    /* Live statistics page; SIGUSR1 prints a snapshot, SIGINT and SIGTERM
+     * stop after the current iteration. Set up before any thread starts */
+    if (config.engine == PSO_ENGINE_OMP && pso_live_start(&config) < 0)
+        fprintf(stderr, "Could not set up the live statistics and signal monitor\n");
+
+    if (config.auto_threads && config.engine == PSO_ENGINE_OMP && pso_auto_threads(&config) < 0)
+        fprintf(stderr, "Could not calibrate; using %d threads\n", config.num_threads);
+
+    /* A buffer for every thread a solve can run on: a scheduler slot may
+     * grow a solve to all cores */
+    if (config.trace_path != NULL) {
+        if (pso_trace_init(config.trace_path, (config.num_threads > omp_get_num_procs()) ? config.num_threads
+                                                                                          : omp_get_num_procs(),
+                           config.trace_every) < 0)
+            fprintf(stderr, "Could not enable tracing\n");
+    }
+
+    /* Optimize using reference version only when asked for */
+    if (config.compare && config.engine != PSO_ENGINE_GOLD) {
+        if (run_engine(&config, PSO_ENGINE_GOLD) < 0)
+            exit(EXIT_FAILURE);
+    }
+
+    if (run_engine(&config, config.engine) < 0)
+        exit(EXIT_FAILURE);
+
+    if (config.trace_path != NULL && pso_trace_finish() == 0)
+        fprintf(stderr, "Trace written to %s\n", config.trace_path);
     exit(EXIT_SUCCESS);
 }
 
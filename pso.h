@@ -21,24 +21,513 @@ typedef struct particle_s {
 typedef struct swarm_s {
     int num_particles;          /* Number of particles */
     particle_t *particle;       /* Particle within swarm */
+    int dim;                    /* Dimension of particles */
+    float *x;                   /* num_particles x dim matrix of positions */
+    float *v;                   /* num_particles x dim matrix of velocities, NULL without velocities */
+    float *pbest;               /* num_particles x dim matrix of best positions */
+    float *mem;                 /* Storage backing x, v and pbest */
+    size_t capacity;            /* Elements available per matrix in mem */
+    int max_particles;          /* Particle structures available */
+    int velocity;               /* Whether mem has room for velocities */
+    long num_evals;             /* Objective evaluations since initialization */
+    long num_skipped;           /* Evaluations skipped as the particle sat on its pbest */
+    int num_iters;              /* Iterations run since initialization */
 } swarm_t;
 
+/* Statistics of the swarm's current positions and their fitness */
+typedef struct pso_stats_s {
+    float *centroid;        /* Mean position (dim elements), NULL if not wanted */
+    double diversity;       /* Root mean square distance of the positions to the centroid */
+    double fitness_mean;
+    double fitness_var;     /* Population variance of the fitness */
+} pso_stats_t;
+
+/* Elite archive: the best solutions found so far, best first, no two within
+ * radius of each other. The caller provides the arrays */
+typedef struct pso_elite_s {
+    int k;                  /* Capacity */
+    float radius;           /* Distance under which a solution duplicates a better one; must be positive */
+    int count;              /* Members */
+    float *fitness;         /* k fitness values */
+    float *x;               /* k x dim positions */
+} pso_elite_t;
+
+/* How the solver learns that a dynamic objective changed */
+typedef enum {
+    PSO_DETECT_SIGNAL,      /* The objective says so */
+    PSO_DETECT_SENTINEL,    /* Re-evaluated pbests no longer match their fitness */
+    PSO_DETECT_NONE         /* Never: fitness values go stale */
+} pso_detect_t;
+
+/* Objective that changes over time: the solver evaluates it at x - shift,
+ * clamped to the domain.
+ * Before every iteration the solver calls change, which may move shift and
+ * returns nonzero if the objective changed; shift is zero at the start. On a
+ * detected change the solver re-evaluates every pbest and redraws part of
+ * the swarm; see pso_dynamic.c */
+typedef struct pso_dynamic_s {
+    int (*change)(void *arg, int iter, float *shift);
+    void *arg;
+    float *shift;           /* dim elements */
+    pso_detect_t detect;
+    int sentinels;          /* Pbests re-evaluated every iteration to detect changes */
+    float rediversify;      /* Fraction of the particles redrawn at random on a change */
+    int memory;             /* Optima before the last changes re-injected on a change */
+    int changes;            /* Changes detected, set by the solver */
+    long reevals;           /* Evaluations of sentinels and pbests, set by the solver */
+} pso_dynamic_t;
+
+/* Noisy objective: every evaluation returns the fitness plus normal noise,
+ * so one sample can make a worse point look better than its pbest. The
+ * solver keeps the mean of the samples of each pbest, and either takes a
+ * fixed number of samples of every point or races the comparisons it cannot
+ * decide yet with extra samples; see pso_noise.c */
+typedef struct pso_noise_s {
+    float sigma;            /* Standard deviation of the noise added to every evaluation */
+    int samples;            /* Samples of every point, 0 to race close comparisons */
+    int max_samples;        /* Racing: samples of one point at most */
+    long resamples;         /* Evaluations beyond the first of each point, set by the solver */
+    long decisions;         /* Pbest comparisons, set by the solver */
+    long correct;           /* Those decided as the noise-free objective would, set by the solver */
+    float sigma_hat;        /* Estimated noise at the end, set by the solver */
+    float truth;            /* Noise-free fitness of the best pbest at the end, set by the solver */
+} pso_noise_t;
+
+/* Progress hook called by the solver after every iteration with the index
+ * of the best particle; a nonzero return stops the solve after that
+ * iteration. If elite is not NULL it is filled in before every call; the
+ * solver empties elite when it starts. If stats is not NULL it is filled in
+ * before the calls of iterations that are multiples of stats_every (every
+ * call if stats_every is at most 1) and of the last iteration, and keeps
+ * its values in between. If dynamic is not NULL the objective changes over
+ * time, and if noise is not NULL it is noisy */
+typedef struct pso_progress_s {
+    int (*callback)(void *arg, int iter, int g, swarm_t *swarm);
+    void *arg;
+    pso_stats_t *stats;
+    int stats_every;
+    pso_elite_t *elite;
+    pso_dynamic_t *dynamic;
+    pso_noise_t *noise;
+} pso_progress_t;
+
+/* Live statistics page of a running solve: the solver publishes its progress
+ * and best particle after every iteration under a sequence lock and stops
+ * once stop is set. The page is shared memory /dev/shm/pso.<pid> that
+ * pso_top reads; see pso_signal.c. Times are seconds since the epoch */
+#define PSO_LIVE_VERSION 1
+typedef struct pso_live_s {
+    char magic[4];          /* "PSOL" */
+    int version;            /* PSO_LIVE_VERSION */
+    unsigned int seq;       /* Odd while the solver writes the page */
+    int stop;               /* Stop after the current iteration */
+    int pid;
+    char function[32];
+    int dim;
+    int swarm_size;
+    int num_threads;        /* Threads of the last iteration */
+    int iter;               /* Iterations completed */
+    int max_iter;
+    long num_evals;
+    double evals_per_sec;   /* Over the last rate window */
+    double busy;            /* Fraction of the threads' time not spent waiting at the barrier, same window */
+    float fitness;          /* Best fitness */
+    double diversity;       /* RMS distance of the positions to their centroid */
+    double start;           /* Time the solve started */
+    double time;            /* Time of the last update */
+    double window_time;     /* Solver side: start of the rate window */
+    long window_evals;      /*   and its counts so far */
+    double window_work, window_wait;
+    float x[];              /* Best position, dim elements */
+} pso_live_t;
+
+/* Checkpoint of a run stopped by a signal without --checkpoint */
+#define PSO_CHECKPOINT_DEFAULT "pso.checkpoint"
+
+/* Uniform hash grid for radius queries over particle positions; see pso_niche.c */
+typedef struct pso_grid_s pso_grid_t;
+
+/* Per-thread candidates of the elite archive; see pso_elite.c */
+typedef struct pso_elite_pool_s pso_elite_pool_t;
+
+/* Sample statistics of a noisy objective's points; see pso_noise.c */
+typedef struct pso_noise_pool_s pso_noise_pool_t;
+
+/* Per-solve state of the update variants; see pso_update.c */
+typedef struct pso_update_pool_s pso_update_pool_t;
+
+/* Sentinels and memory of a dynamic objective; see pso_dynamic.c */
+typedef struct pso_dynamic_pool_s pso_dynamic_pool_t;
+
+/* Parsed mixed space and packed rows of its blocks; see pso_mixed.c */
+typedef struct pso_mixed_pool_s pso_mixed_pool_t;
+
+/* Core-partitioning scheduler shared by concurrent optimizations */
+typedef struct pso_sched_s pso_sched_t;
+typedef struct pso_sched_slot_s pso_sched_slot_t;
+
+/* Entry of the test function registry */
+typedef struct pso_objective_s {
+    const char *name;
+    float (*eval)(particle_t *);
+    int dim;            /* Default dimension */
+    int min_dim;        /* Smallest dimension the function accepts */
+    float xmin, xmax;   /* Default search domain */
+    float fmin;         /* Known global minimum */
+    /* Batch objective, NULL to use the kernel of the registry entry (see
+     * pso_kernels_t) */
+    void (*batch)(const float *x, int n, int dim, float *fitness);
+} pso_objective_t;
+
+extern const pso_objective_t pso_objectives[];
+#define PSO_NUM_OBJECTIVES 5
+
+/* Objective given as an expression with --expr; see pso_expr.c */
+#define PSO_EXPR_NAME "expr"
+#define PSO_EXPR_DIM 10     /* Default dimension */
+extern const pso_objective_t *pso_expr_objective;
+
+/* Moving optimum for dynamic runs of the test functions: every period
+ * iterations the shift takes a step of the given length in a random
+ * direction, reflected to stay within limit in every coordinate */
+typedef struct pso_drift_s {
+    int period;
+    float step;
+    float limit;
+    unsigned int key;
+    int dim;
+    int changes;            /* Steps taken */
+    int last_change;        /* Iteration of the last step */
+} pso_drift_t;
+
+/* Tracking error of a dynamic run, measured by the progress hook pso_track
+ * with an extra evaluation of the best pbest per iteration */
+typedef struct pso_track_s {
+    const pso_objective_t *objective;
+    pso_dynamic_t *dynamic;
+    pso_drift_t *drift;
+    float xmin, xmax;       /* Domain */
+    float *x;               /* dim elements of scratch */
+    double error_sum;       /* Sum over iterations of best fitness - fmin */
+    int iters;
+    double before_sum;      /* Sum of the errors just before each change */
+    int befores;
+    double delay_sum;       /* Sum of iterations from a change to its detection */
+    int detected;
+} pso_track_t;
+
+/* Search space with integer and categorical dimensions, grouped by kind:
+ * the first num_continuous dimensions are continuous, the next num_integer
+ * take the integers in [imin, imax] and the last num_categorical take one of
+ * options[j] levels each, the centers of equal slices of the domain; see
+ * pso_mixed.c */
+typedef struct pso_space_s {
+    int num_continuous;
+    int num_integer;
+    int num_categorical;
+    int *options;
+    float imin, imax;
+} pso_space_t;
+
+/* Coefficients of the velocity and position update */
+typedef struct pso_update_s {
+    float w, c1, c2;        /* Inertia and pull towards pbest and gbest */
+    float vmax;             /* Velocity bound */
+    float xmin, xmax;       /* Bounds on search domain */
+} pso_update_t;
+
+/* Compute kernels of the OpenMP engine built for one instruction set; see pso_kernels.c */
+typedef struct pso_kernels_s {
+    const char *isa;
+    void (*uniform)(float *r, int n, unsigned int key);
+    void (*normal)(float *r, int n, unsigned int key);
+    void (*update)(float *x, float *v, const float *pbest, const float *gbest,
+                   const float *r, int n, const pso_update_t *param);
+    void (*fips_update)(float *x, float *v, const float *const *neighbor, int k,
+                        float *r, int n, const pso_update_t *param);
+    void (*clpso_update)(float *x, float *v, const float *pbest, const int *exemplar,
+                         const float *r, int n, const pso_update_t *param);
+    void (*barebones_update)(float *x, const float *pbest, const float *gbest, const float *z,
+                             int n, const pso_update_t *param);
+    void (*qpso_update)(float *x, const float *pbest, const float *gbest, const float *mbest,
+                        const float *r, int n, const pso_update_t *param);
+    void (*opposite)(const float *x, float *y, int n, const pso_update_t *param);
+    void (*select)(float *x, float *fitness, const float *y, const float *y_fitness, int n, int dim);
+    int (*argmin)(const float *fitness, int n);
+    void (*moments)(const float *x, const float *shift, int n, int lanes, int width, float *sum, float *sum_sq);
+    void (*snap)(float *x, float *v, int n, int dim, const pso_space_t *space, const pso_update_t *param);
+    /* Batch objectives in registry order: fitness of n particles whose
+     * positions are the rows of the n x dim matrix x */
+    void (*eval[PSO_NUM_OBJECTIVES])(const float *x, int n, int dim, float *fitness);
+} pso_kernels_t;
+
+extern const pso_kernels_t *pso_kernels;
+extern const char *const pso_sum_policy;  /* Summation of the objective kernels, see pso_kernels.c */
+
+/* Largest number of particles the OpenMP engine evaluates per batch call */
+#define PSO_BLOCK 64
+
+/* Engines selectable from the command line */
+typedef enum {
+    PSO_ENGINE_GOLD,    /* Serial reference version */
+    PSO_ENGINE_OMP      /* OpenMP version */
+} pso_engine_t;
+
+/* Formats solutions can be written in */
+typedef enum {
+    PSO_FORMAT_TEXT,    /* Labelled lines, as printed to the terminal */
+    PSO_FORMAT_CSV,     /* One row per vector, field name first */
+    PSO_FORMAT_JSON,    /* One JSON object */
+    PSO_FORMAT_BINARY   /* Raw float32 vectors, see pso_output.c */
+} pso_format_t;
+
+/* Buffered output stream; see pso_output.c */
+typedef struct pso_writer_s pso_writer_t;
+
+/* Velocity update rules of the OpenMP engine */
+typedef enum {
+    PSO_VARIANT_GBEST,      /* Pulled towards own and swarm best, the original algorithm */
+    PSO_VARIANT_FIPS,       /* Fully informed: pulled towards the pbests of all neighbors */
+    PSO_VARIANT_CLPSO,      /* Comprehensive learning: each dimension learns from its own exemplar pbest */
+    PSO_VARIANT_BAREBONES,  /* Bare bones: positions sampled around pbest and gbest, no velocities */
+    PSO_VARIANT_QPSO,       /* Quantum behaved: positions sampled around pbest, gbest and mean pbest */
+    PSO_VARIANT_SPECIES     /* Species niching: pulled towards the best pbest within the niche radius */
+} pso_variant_t;
+
+/* Neighborhoods of the variants that use one */
+typedef enum {
+    PSO_TOPOLOGY_RING,      /* Particle and its two neighbors by index */
+    PSO_TOPOLOGY_LATTICE    /* Particle and its four von Neumann neighbors on a 2D torus */
+} pso_topology_t;
+
+/* Run configuration filled in from the command line */
+typedef struct pso_config_s {
+    char *function;         /* Name of function to optimize */
+    int dim;                /* Dimensionality of search space */
+    int swarm_size;         /* Number of particles */
+    float xmin, xmax;       /* Bounds on search domain */
+    int max_iter;           /* Number of iterations */
+    int num_threads;        /* Number of threads for the OpenMP engine */
+    pso_sched_slot_t *slot; /* Cores assigned by the scheduler, overrides num_threads; NULL if unscheduled */
+    pso_engine_t engine;    /* Engine to run */
+    int compare;            /* Run the reference engine as well and compare */
+    unsigned int seed;      /* Random seed */
+    char *trace_path;       /* Chrome trace output file, NULL to disable */
+    int trace_every;        /* Trace every Nth iteration */
+    char *jobs_path;        /* Batch job-spec file, NULL for a single run */
+    char *serve_path;       /* Unix socket to serve optimization requests on, NULL for a single run */
+    int jobs_in_order;      /* Report batch results in input order rather than as they complete */
+    char *output_path;      /* Solution output file, "-" for stdout, NULL for stderr */
+    pso_format_t output_format; /* Format of the solution output */
+    char *isa;              /* Kernel instruction set, NULL to pick the best supported */
+    int auto_threads;       /* Choose num_threads and block_size from a cost model */
+    int block_size;         /* Particles per unit of work of the OpenMP engine, 0 for PSO_BLOCK */
+    pso_variant_t variant;  /* Velocity update rule of the OpenMP engine */
+    pso_topology_t topology; /* Neighborhood of the FIPS variant */
+    float target;           /* Stop once the best fitness reaches target, -INFINITY to run max_iter */
+    int opposition;         /* Opposition-based initialization and generation jumping */
+    float jump_rate;        /* Probability of an opposition step in an iteration */
+    float niche_radius;     /* Species radius of the species variant, 0 for a tenth of the domain */
+    int elite;              /* Distinct best solutions to report, 0 for just the best */
+    float elite_radius;     /* Duplicate distance of the elite archive, 0 for a thousandth of the domain */
+    int dynamic_period;     /* Iterations between moves of the optimum, 0 for a static objective */
+    float severity;         /* Length of a move as a fraction of the domain */
+    pso_detect_t detect;    /* How the solver learns of a move */
+    int sentinels;          /* Pbests re-evaluated per iteration by sentinel detection */
+    float rediversify;      /* Fraction of the particles redrawn on a move */
+    int memory;             /* Optima before the last moves re-injected on a move */
+    char *types;            /* Kinds of the dimensions (see pso_parse_space), NULL if all continuous */
+    float noise;            /* Standard deviation of the noise added to the objective, 0 for none */
+    int noise_samples;      /* Samples of every point of a noisy objective, 0 to race */
+    int max_samples;        /* Samples of one point at most when racing */
+    float inertia;          /* Inertia weight of the gbest and species updates, 0 for the default */
+    float c1, c2;           /* Pulls towards pbest and gbest of those updates, 0 for the defaults */
+    char *tune_path;        /* Candidate job specs to race, NULL for a single run */
+    char *tune_out;         /* File for the winning candidate, NULL for stdout */
+    int tune_budget;        /* Runs the race may spend, 0 for 20 per candidate */
+    pso_live_t *live;       /* Statistics page and stop request of a single run, NULL if none */
+    char *metrics_path;     /* Prometheus textfile the page is exported to, NULL for none */
+    int metrics_every;      /* Seconds between exports */
+    char *checkpoint_path;  /* Swarm state written at the end of the run, NULL to write it only on a stop */
+    char *resume_path;      /* Checkpoint to continue from, NULL to start afresh */
+    char *expr;             /* Expression of the objective PSO_EXPR_NAME, NULL for none */
+    int compile;            /* Evaluate the expression with a compiled module rather than interpret it */
+    char *expr_cache;       /* Directory of the compiled modules, NULL for the default */
+} pso_config_t;
+
+/* One optimization of a batch job-spec file */
+typedef struct pso_job_s {
+    int index;              /* Line number of the job in the batch */
+    char id[64];            /* Caller supplied identifier */
+    char function[32];      /* Function name as given */
+    pso_config_t config;    /* Parameters of the optimization */
+    int seeded;             /* "seed" was given; otherwise it is the time plus the job's index */
+    int weight;             /* Share of cores relative to concurrent jobs */
+    int status;             /* 0 on success, -1 on error */
+    char error[128];        /* Reason for failure */
+    double time;            /* Execution time */
+    float fitness;          /* Best fitness found */
+    float *position;        /* Best position found */
+    float threads;          /* Mean number of threads the job ran on */
+} pso_job_t;
+
 /* Function prototypes */
 void print_args(char *, int, int, float, float);
+int pso_parse_args(int, char **, pso_config_t *);
 void pso_print_swarm(swarm_t *);
 void pso_print_particle(particle_t *);
 float uniform(float, float);
 float uniform_omp(float, float, unsigned int *);
 swarm_t *pso_init(char *, int, int, float, float);
-swarm_t *pso_init_omp(char *, int, int, float, float, int);
+swarm_t *pso_init_omp(char *, int, int, float, float, int, unsigned int);
+int pso_init_swarm_omp(swarm_t *, char *, float, float, int, unsigned int);
+swarm_t *pso_alloc(swarm_t *, int, int, int);
+unsigned int pso_hash(unsigned int);
+const pso_objective_t *pso_find_objective(const char *);
+void (*pso_objective_batch(const pso_objective_t *))(const float *, int, int, float *);
+void pso_cpu_model(char *, size_t);
+unsigned long long pso_expr_hash(const char *);
+const pso_objective_t *pso_expr_load(const char *, int, int, const char *, double *);
+void pso_expr_interpret(const float *, int, int, float *);
 int pso_eval_fitness(char *, particle_t *, float *);
+void pso_gold_seed(unsigned int);
+int pso_gold_rand(void);
 int pso_solve_gold(char *, swarm_t *, float, float, int);
 void pso_free(swarm_t *);
 int pso_get_best_fitness(swarm_t *);
 int pso_get_best_fitness_omp(swarm_t *, int);
 float min(float *, int);
-int optimize_gold(char *, int, int, float, float, int);
-int optimize_using_omp(char *, int, int, float, float, int, int);
+int optimize_gold(pso_config_t *);
+int optimize_using_omp(pso_config_t *);
+int pso_solve_omp(swarm_t *, pso_config_t *, pso_progress_t *);
+int pso_update_rows(int);
+int pso_parse_variant(const char *, pso_config_t *);
+int pso_parse_topology(const char *, pso_config_t *);
+const char *pso_variant_name(pso_config_t *);
+int pso_variant_velocity(pso_config_t *);
+pso_update_pool_t *pso_update_pool_create(pso_config_t *, swarm_t *, int, int);
+void pso_update_pool_destroy(pso_update_pool_t *);
+void pso_update_param(pso_update_pool_t *, pso_config_t *, pso_update_t *);
+void pso_update_iteration(pso_update_pool_t *, pso_update_t *, int, int);
+int pso_update_shared(pso_update_pool_t *);
+void pso_update_start(pso_update_pool_t *, swarm_t *, int);
+void pso_update_begin(pso_update_pool_t *, int, const float *);
+void pso_update_block(pso_update_pool_t *, int, swarm_t *, int, int, const float *, const pso_update_t *);
+void pso_update_stall(pso_update_pool_t *, int, int);
+void pso_update_sum(pso_update_pool_t *, int, swarm_t *, int);
+void pso_update_reduce(pso_update_pool_t *, swarm_t *);
+void pso_update_leaders(pso_update_pool_t *, swarm_t *);
+int pso_auto_threads(pso_config_t *);
+int pso_json_next(const char **, char *, int, char *, int);
+void pso_json_string(FILE *, const char *);
+void pso_job_defaults(pso_job_t *);
+int pso_job_set(pso_job_t *, const char *, const char *);
+int pso_job_check(pso_job_t *);
+int pso_parse_job(const char *, pso_job_t *);
+int pso_run_jobs(pso_config_t *);
+pso_job_t *pso_read_jobs(const char *, int *);
+double pso_run_batch(pso_job_t *, int, int, void (*)(pso_job_t *, void *), void *);
+int pso_tune(pso_config_t *);
+int pso_live_start(pso_config_t *);
+int pso_live_publish(pso_live_t *, swarm_t *, int, int, const pso_stats_t *, double, double);
+double pso_live_clock(void);
+int pso_checkpoint_write(const char *, swarm_t *, pso_config_t *);
+int pso_checkpoint_read(const char *, swarm_t *, pso_config_t *);
+void pso_run_job(pso_job_t *, swarm_t **, pso_progress_t *);
+void pso_print_job(FILE *, pso_job_t *);
+int pso_compare_double(const void *, const void *);
+int pso_serve(pso_config_t *);
+pso_sched_t *pso_sched_create(int);
+void pso_sched_destroy(pso_sched_t *);
+pso_sched_slot_t *pso_sched_join(pso_sched_t *, int);
+void pso_sched_leave(pso_sched_slot_t *);
+int pso_sched_threads(pso_sched_slot_t *, int *, unsigned long *);
+void pso_sched_pin(pso_sched_slot_t *, int, int, unsigned long);
+void pso_sched_unpin(pso_sched_slot_t *);
+float pso_sched_mean_threads(pso_sched_slot_t *);
+int pso_kernels_select(const char *);
+pso_grid_t *pso_grid_create(int, int);
+void pso_grid_destroy(pso_grid_t *);
+void pso_grid_build(pso_grid_t *, swarm_t *, float, float);
+int pso_grid_leader(pso_grid_t *, swarm_t *, int);
+float pso_niche_radius(pso_config_t *);
+int pso_find_niches(swarm_t *, pso_config_t *, int *, double *);
+void pso_grid_clear(pso_grid_t *, int, float, float);
+void pso_grid_insert(pso_grid_t *, int, const float *, int);
+void pso_grid_remove(pso_grid_t *, int);
+int pso_grid_within(pso_grid_t *, const float *, int, int *);
+pso_elite_pool_t *pso_elite_pool_create(int, float, float, int, int, int);
+void pso_elite_pool_destroy(pso_elite_pool_t *);
+void pso_elite_begin(pso_elite_pool_t *, int);
+void pso_elite_offer(pso_elite_pool_t *, int, float, int);
+void pso_elite_end(pso_elite_pool_t *, int);
+void pso_elite_merge(pso_elite_pool_t *, int, swarm_t *, pso_elite_t *);
+float pso_elite_radius(pso_config_t *);
+int pso_parse_detect(const char *, pso_config_t *);
+void pso_dynamic_defaults(pso_config_t *);
+void pso_drift_init(pso_drift_t *, pso_config_t *);
+int pso_drift_change(void *, int, float *);
+int pso_track(void *, int, int, swarm_t *);
+void pso_eval_rows(void (*)(const float *, int, int, float *), const float *, int, int, const float *,
+                   const pso_update_t *, float *, float *);
+pso_dynamic_pool_t *pso_dynamic_pool_create(pso_dynamic_t *, int, int, unsigned int);
+void pso_dynamic_pool_destroy(pso_dynamic_pool_t *);
+int pso_dynamic_begin(pso_dynamic_pool_t *, swarm_t *, void (*)(const float *, int, int, float *),
+                      const pso_update_t *, int, int, const float *);
+void pso_dynamic_block(pso_dynamic_pool_t *, swarm_t *, void (*)(const float *, int, int, float *),
+                       const pso_update_t *, int, int, int, float *, float *);
+void pso_dynamic_end(pso_dynamic_pool_t *, swarm_t *);
+int pso_parse_space(const char *, int, float, float, pso_space_t *);
+pso_mixed_pool_t *pso_mixed_pool_create(pso_space_t *, int, int, int, int);
+void pso_mixed_pool_destroy(pso_mixed_pool_t *);
+void pso_mixed_snap(pso_mixed_pool_t *, float *, float *, int, const pso_update_t *);
+void pso_mixed_start(pso_mixed_pool_t *, swarm_t *, void (*)(const float *, int, int, float *),
+                     const pso_update_t *, int);
+int pso_mixed_eval(pso_mixed_pool_t *, int, swarm_t *, int, int, void (*)(const float *, int, int, float *),
+                   const float *, const pso_update_t *, float *, float *);
+pso_noise_pool_t *pso_noise_pool_create(pso_noise_t *, int, int, int, int, unsigned int);
+void pso_noise_pool_destroy(pso_noise_pool_t *);
+void pso_noise_start(pso_noise_pool_t *, int, swarm_t *, int, int, void (*)(const float *, int, int, float *));
+void pso_noise_block(pso_noise_pool_t *, int, swarm_t *, int, int, void (*)(const float *, int, int, float *),
+                     float *);
+void pso_noise_decide(pso_noise_pool_t *, int, int, int, int);
+int pso_noise_gbest(pso_noise_pool_t *, int, swarm_t *, void (*)(const float *, int, int, float *), int, int);
+long pso_noise_end(pso_noise_pool_t *, swarm_t *, int);
+void pso_noise_finish(pso_noise_pool_t *, int);
+int pso_format_float(char *, float);
+pso_writer_t *pso_writer_open(const char *);
+void pso_writer_flush(pso_writer_t *);
+int pso_writer_close(pso_writer_t *);
+void pso_write_bytes(pso_writer_t *, const void *, size_t);
+void pso_write_str(pso_writer_t *, const char *);
+void pso_write_float(pso_writer_t *, float);
+void pso_write_int(pso_writer_t *, long);
+void pso_write_particle(pso_writer_t *, particle_t *, pso_format_t);
+int pso_parse_format(const char *, pso_format_t *);
+int pso_write_solution(pso_config_t *, particle_t *);
+int pso_write_solutions(pso_config_t *, particle_t *, int, const char *);
+
+/* Solver phases recorded by the timeline tracer */
+enum {
+    PSO_PHASE_UPDATE,
+    PSO_PHASE_EVALUATE,
+    PSO_PHASE_REDUCE,
+    PSO_PHASE_BROADCAST,
+    PSO_PHASE_BARRIER,
+    PSO_PHASE_NICHE,
+    PSO_PHASE_ELITE,
+    PSO_NUM_PHASES
+};
+
+/* Tracer; the macros cost a single branch on iterations that are not sampled */
+extern int pso_trace_on;
+#define PSO_TRACE_BEGIN(phase) do { if (pso_trace_on) pso_trace_begin(phase); } while (0)
+#define PSO_TRACE_END(phase) do { if (pso_trace_on) pso_trace_end(phase); } while (0)
+int pso_trace_init(const char *, int, int);
+void pso_trace_iter(int);
+void pso_trace_begin(int);
+void pso_trace_end(int);
+int pso_trace_finish(void);
 
 
 /* Optimization test functions */
@@ -0,0 +1,218 @@
+/* Automatic thread count for the OpenMP engine.
+ *
+ * One iteration on p threads is modelled as
+ *
+ *      T(p) = ceil(blocks / p) * block * cost + sync(p)
+ *
+ * where cost is the time to update and evaluate one particle, measured by
+ * running the solver on a small swarm of the same function and dimension,
+ * and sync(p) is the fork/join, barrier and reduction overhead of one
+ * iteration on p threads, measured with empty parallel regions. The thread
+ * count and block size (particles per unit of work) with the smallest T(p)
+ * are chosen; smaller blocks let small swarms spread over more threads.
+ *
+ * Measurements are cached in $XDG_CACHE_HOME/pso/calibration (default
+ * ~/.cache/pso/calibration), one tab-separated line per CPU model, kernel
+ * instruction set, function and variant, and dimension, so only the first run of a
+ * configuration pays for calibration.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <omp.h>
+#include "pso.h"
+
+#define SYNC_REPS 200           /* Parallel regions timed per thread count */
+#define CALIBRATION_TIME 0.02   /* Seconds spent measuring particle cost */
+
+/* Path of the calibration cache; creates its directory. Returns -1 if there is no home */
+static int pso_cache_path(char *path, size_t len)
+{
+    const char *base = getenv("XDG_CACHE_HOME");
+    char dir[4000];
+
+    if (base != NULL && base[0] != '\0')
+        snprintf(dir, sizeof(dir), "%.3990s", base);
+    else if ((base = getenv("HOME")) != NULL)
+        snprintf(dir, sizeof(dir), "%.3990s/.cache", base);
+    else
+        return -1;
+    mkdir(dir, 0755);
+    snprintf(path, len, "%s/pso", dir);
+    if (mkdir(path, 0755) < 0 && errno != EEXIST)
+        return -1;
+    snprintf(path, len, "%s/pso/calibration", dir);
+    return 0;
+}
+
+/* Look up key in the cache; the last matching line wins. Return 0 if found */
+static int pso_cache_get(const char *key, double *value)
+{
+    char path[4096], line[512];
+    size_t key_len = strlen(key);
+    int found = -1;
+    FILE *fp;
+
+    if (pso_cache_path(path, sizeof(path)) < 0 || (fp = fopen(path, "r")) == NULL)
+        return -1;
+    while (fgets(line, sizeof(line), fp) != NULL)
+        if (strncmp(line, key, key_len) == 0 && line[key_len] == '\t') {
+            *value = atof(line + key_len + 1);
+            found = 0;
+        }
+    fclose(fp);
+    return found;
+}
+
+static void pso_cache_put(const char *key, double value)
+{
+    char path[4096];
+    FILE *fp;
+
+    if (pso_cache_path(path, sizeof(path)) < 0 || (fp = fopen(path, "a")) == NULL)
+        return;
+    fprintf(fp, "%s\t%.6g\n", key, value);
+    fclose(fp);
+}
+
+/* Seconds per particle-iteration of config's function and dimension on one thread */
+static double pso_measure_cost(pso_config_t *config)
+{
+    pso_config_t trial = *config;
+    int num_particles, iters;
+    double start, elapsed;
+    swarm_t *swarm;
+
+    /* Enough particles for a few blocks, few enough to stay in cache */
+    num_particles = 65536 / config->dim;
+    num_particles = (num_particles < 4) ? 4 : (num_particles > 4 * PSO_BLOCK) ? 4 * PSO_BLOCK : num_particles;
+    if (num_particles > config->swarm_size)
+        num_particles = config->swarm_size;
+
+    trial.num_threads = 1;
+    trial.slot = NULL;
+    trial.block_size = 0;
+    trial.live = NULL;          /* Neither published nor stopped by signals; they are for the real run */
+    swarm = pso_init_omp(config->function, config->dim, num_particles, config->xmin, config->xmax, 1, config->seed);
+    if (swarm == NULL)
+        return -1.0;
+
+    /* Warm up, then run long enough to time reliably */
+    trial.max_iter = 2;
+    start = omp_get_wtime();
+    pso_solve_omp(swarm, &trial, NULL);
+    elapsed = omp_get_wtime() - start;
+    iters = (elapsed > 0) ? (int)(CALIBRATION_TIME / (elapsed / 2)) : 1000;
+    trial.max_iter = (iters < 2) ? 2 : (iters > 1000) ? 1000 : iters;
+    start = omp_get_wtime();
+    pso_solve_omp(swarm, &trial, NULL);
+    elapsed = omp_get_wtime() - start;
+
+    pso_free(swarm);
+    return elapsed / ((double)trial.max_iter * num_particles);
+}
+
+/* Seconds of fork/join, barrier and reduction per iteration on p threads */
+static double pso_measure_sync(int p)
+{
+    int rep;
+    double start = 0.0;
+    volatile int sink = 0;
+
+    for (rep = -10; rep < SYNC_REPS; rep++) {
+        if (rep == 0)
+            start = omp_get_wtime();
+#pragma omp parallel num_threads(p)
+        {
+            #pragma omp barrier
+            #pragma omp single
+            sink++;
+        }
+    }
+    return (omp_get_wtime() - start) / SYNC_REPS;
+}
+
+/* Cached or measured value of key */
+static double pso_calibrated(const char *key, pso_config_t *config, int p, int *measured)
+{
+    double value;
+
+    if (pso_cache_get(key, &value) == 0)
+        return value;
+    value = (p > 0) ? pso_measure_sync(p) : pso_measure_cost(config);
+    if (value > 0)
+        pso_cache_put(key, value);
+    (*measured)++;
+    return value;
+}
+
+/* Choose config->num_threads and config->block_size for a single OpenMP run
+ * and report the choice on stderr. Return 0 on success, -1 otherwise */
+int pso_auto_threads(pso_config_t *config)
+{
+    char model[128], key[384], function[64];
+    int max_threads = omp_get_num_procs();
+    int rows = pso_update_rows(config->dim);
+    int p, block, num_blocks, best_p = 1, best_block = PSO_BLOCK, measured = 0;
+    double cost, sync1, sync2, syncn, sync, t, best_t = INFINITY, t_max = 0;
+
+    pso_cpu_model(model, sizeof(model));
+    /* Expressions share one function name; tell them apart by their text */
+    snprintf(function, sizeof(function), "%s", config->function);
+    if (config->expr != NULL)
+        snprintf(function, sizeof(function), "%s-%016llx%s", PSO_EXPR_NAME, pso_expr_hash(config->expr),
+                 config->compile ? "-compiled" : "");
+    snprintf(key, sizeof(key), "%s\t%s\t%s/%s\t%d", model, pso_kernels->isa, function,
+             pso_variant_name(config), config->dim);
+    cost = pso_calibrated(key, config, 0, &measured);
+    if (cost <= 0)
+        return -1;
+
+    /* Linear model through the overhead measured at 2 and max_threads threads */
+    snprintf(key, sizeof(key), "%s\t%s\tsync\t1", model, pso_kernels->isa);
+    sync1 = pso_calibrated(key, config, 1, &measured);
+    sync2 = syncn = sync1;
+    if (max_threads > 1) {
+        snprintf(key, sizeof(key), "%s\t%s\tsync\t2", model, pso_kernels->isa);
+        sync2 = pso_calibrated(key, config, 2, &measured);
+        snprintf(key, sizeof(key), "%s\t%s\tsync\t%d", model, pso_kernels->isa, max_threads);
+        syncn = (max_threads > 2) ? pso_calibrated(key, config, max_threads, &measured) : sync2;
+    }
+
+    for (p = 1; p <= max_threads; p++) {
+        /* Largest block that still gives every thread work */
+        for (block = PSO_BLOCK; block > rows && (config->swarm_size + block - 1) / block < p; block /= 2)
+            ;
+        num_blocks = (config->swarm_size + block - 1) / block;
+        if (num_blocks < p)
+            break;
+        if (p == 1)
+            sync = sync1;
+        else if (max_threads > 2)
+            sync = sync2 + (syncn - sync2) * (p - 2) / (max_threads - 2);
+        else
+            sync = sync2;
+        t = (double)((num_blocks + p - 1) / p) * block * cost + sync;
+        if (p == max_threads)
+            t_max = t;
+        if (t < best_t * 0.97) {    /* Extra threads must pay off by 3% */
+            best_t = t;
+            best_p = p;
+            best_block = block;
+        }
+    }
+
+    config->num_threads = best_p;
+    config->block_size = best_block;
+    fprintf(stderr, "Auto threads: %d of %d, blocks of %d particles: predicted %.3g ms/iteration", best_p,
+            max_threads, best_block, best_t * 1e3);
+    if (t_max > 0 && best_p != max_threads)
+        fprintf(stderr, " (%.3g ms on %d threads)", t_max * 1e3, max_threads);
+    fprintf(stderr, "; particle update+evaluate %.3g us, sync %.3g us on 1 thread, %.3g us on %d threads (%s)\n",
+            cost * 1e6, sync1 * 1e6, syncn * 1e6, max_threads, measured ? "calibrated now" : "cached");
+    return 0;
+}
@@ -0,0 +1,915 @@
+/* Benchmark driver for the PSO engines.
+ *
+ *  pso_bench run results-file trials function dim swarm-size xmin xmax max-iter num-threads
+ *      Runs the OpenMP engine trials times on one configuration and appends one
+ *      line per trial (configuration, execution time, best fitness) to results-file.
+ *      The kernel variants are the best the CPU supports unless the PSO_ISA
+ *      environment variable names one (see pso --isa).
+ *
+ *  pso_bench target fitness trials function dim swarm-size xmin xmax max-iter num-threads [variant...]
+ *      Runs each variant (default gbest and clpso, see pso --variant) trials
+ *      times, stopping a trial once its best fitness is at most fitness, and
+ *      reports how many trials reached the target and the median number of
+ *      evaluations they took. A variant written name+obl runs with
+ *      opposition-based learning at jump rate 0.3 (see pso --opposition).
+ *
+ *  pso_bench stats trials function dim swarm-size xmin xmax max-iter num-threads [stats-every]
+ *      Times trials runs with the swarm statistics of the progress hook (see
+ *      pso_stats_t), collected every stats-every iterations (default 1),
+ *      against as many without, alternating, and reports the median overhead. The centroid and diversity of the last iteration are
+ *      checked against a separate two-pass computation over the positions.
+ *
+ *  pso_bench dynamic trials function dim swarm-size xmin xmax max-iter num-threads period [severity]
+ *      Moves the optimum every period iterations (see pso --dynamic) and
+ *      runs each response strategy trials times: no detection, re-evaluating
+ *      the pbests on the objective's signal, adding the redraw and the memory,
+ *      and sentinel detection with 1, 4 and 16 sentinels. Reports the median
+ *      offline error, error before moves, share of evaluations spent on
+ *      re-evaluation and time of each, so tracking error can be weighed
+ *      against the cost of re-evaluation.
+ *
+ *  pso_bench noise trials function dim swarm-size xmin xmax max-iter num-threads sigma [max-evals]
+ *      Adds normal noise of standard deviation sigma to the objective (see
+ *      pso --noise) and runs each sampling strategy trials times: one sample
+ *      per point, 2, 4 and 8 samples per point, and racing close comparisons
+ *      with up to 4, 16 and 64 samples. A trial stops after max-iter
+ *      iterations or once it has spent max-evals evaluations, so the
+ *      strategies can be given the same budget. Reports the median
+ *      evaluations, iterations, share of pbest decisions that agree with the
+ *      noise-free objective, share of resamples and noise-free fitness of the
+ *      best pbest of each.
+ *
+ *  pso_bench expr evals dim expression [function]
+ *      Loads the expression (see pso --expr) for dim coordinates, builds its
+ *      compiled module in an empty cache and loads it again from the cache,
+ *      reporting both latencies, then runs evals evaluations each of the
+ *      interpreter and the module on the same random points and reports
+ *      their evaluations per second and whether their fitness agrees bit for
+ *      bit. A registered function, such as rastrigin for its expression, is
+ *      timed alongside with its hand-written kernel.
+ *
+ *  pso_bench compare baseline-file new-file [threshold] [alpha]
+ *      Aligns configurations found in both files and compares their execution
+ *      times with a two-sided Mann-Whitney U test. A configuration regresses when
+ *      its median time grows by more than threshold (default 0.05, i.e. 5%) and
+ *      the difference is significant at level alpha (default 0.05). Exits with
+ *      status 1 if any configuration regresses.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "pso.h"
+
+#define MAX_KEY 256
+
+/* Trials of one configuration */
+typedef struct bench_config_s {
+    char key[MAX_KEY];      /* function dim swarm-size xmin xmax max-iter num-threads */
+    double *time;           /* Execution time of each trial */
+    int num_trials;
+    int capacity;
+} bench_config_t;
+
+typedef struct bench_results_s {
+    bench_config_t *config;
+    int num_configs;
+    int capacity;
+} bench_results_t;
+
+static void usage(char *name)
+{
+    fprintf(stderr, "Usage: %s run results-file trials function dim swarm-size xmin xmax max-iter num-threads\n", name);
+    fprintf(stderr, "       %s target fitness trials function dim swarm-size xmin xmax max-iter num-threads [variant...]\n", name);
+    fprintf(stderr, "       %s stats trials function dim swarm-size xmin xmax max-iter num-threads [stats-every]\n", name);
+    fprintf(stderr, "       %s dynamic trials function dim swarm-size xmin xmax max-iter num-threads period [severity]\n", name);
+    fprintf(stderr, "       %s noise trials function dim swarm-size xmin xmax max-iter num-threads sigma [max-evals]\n", name);
+    fprintf(stderr, "       %s expr evals dim expression [function]\n", name);
+    fprintf(stderr, "       %s compare baseline-file new-file [threshold] [alpha]\n", name);
+    exit(EXIT_FAILURE);
+}
+
+/* Return configuration with given key, adding it if needed */
+static bench_config_t *bench_find(bench_results_t *results, const char *key, int add)
+{
+    int i;
+    bench_config_t *config;
+
+    for (i = 0; i < results->num_configs; i++)
+        if (strcmp(results->config[i].key, key) == 0)
+            return &results->config[i];
+    if (!add)
+        return NULL;
+
+    if (results->num_configs == results->capacity) {
+        results->capacity = (results->capacity > 0) ? 2 * results->capacity : 16;
+        results->config = (bench_config_t *)realloc(results->config, results->capacity * sizeof(bench_config_t));
+        if (results->config == NULL) {
+            fprintf(stderr, "Malloc error\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    config = &results->config[results->num_configs++];
+    memset(config, 0, sizeof(bench_config_t));
+    snprintf(config->key, MAX_KEY, "%s", key);
+    return config;
+}
+
+static void bench_add_trial(bench_config_t *config, double time)
+{
+    if (config->num_trials == config->capacity) {
+        config->capacity = (config->capacity > 0) ? 2 * config->capacity : 16;
+        config->time = (double *)realloc(config->time, config->capacity * sizeof(double));
+        if (config->time == NULL) {
+            fprintf(stderr, "Malloc error\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    config->time[config->num_trials++] = time;
+}
+
+/* Load results file. Lines: function dim swarm-size xmin xmax max-iter num-threads time fitness */
+static int bench_load(const char *path, bench_results_t *results)
+{
+    FILE *fp;
+    char line[1024], key[MAX_KEY], function[64];
+    int dim, swarm_size, max_iter, num_threads;
+    float xmin, xmax, fitness;
+    double time;
+
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "Could not open results file %s\n", path);
+        return -1;
+    }
+    memset(results, 0, sizeof(bench_results_t));
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        if (sscanf(line, "%63s %d %d %f %f %d %d %lf %f", function, &dim, &swarm_size,
+                   &xmin, &xmax, &max_iter, &num_threads, &time, &fitness) != 9) {
+            fprintf(stderr, "Skipping malformed line in %s: %s", path, line);
+            continue;
+        }
+        snprintf(key, MAX_KEY, "%s %d %d %g %g %d %d", function, dim, swarm_size,
+                 xmin, xmax, max_iter, num_threads);
+        bench_add_trial(bench_find(results, key, 1), time);
+    }
+    fclose(fp);
+    return 0;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double median(double *x, int n)
+{
+    double *sorted = (double *)malloc(n * sizeof(double));
+    double m;
+
+    memcpy(sorted, x, n * sizeof(double));
+    qsort(sorted, n, sizeof(double), compare_double);
+    m = (n % 2) ? sorted[n / 2] : 0.5 * (sorted[n / 2 - 1] + sorted[n / 2]);
+    free((void *)sorted);
+    return m;
+}
+
+/* Two-sided Mann-Whitney U test using the normal approximation with tie
+ * correction. Returns the p-value.
+ */
+static double mann_whitney(double *a, int na, double *b, int nb)
+{
+    int i, j, k, n = na + nb;
+    double *value = (double *)malloc(n * sizeof(double));
+    double *rank = (double *)malloc(n * sizeof(double));
+    int *from_a = (int *)malloc(n * sizeof(int));
+    double rank_sum_a = 0.0, tie_term = 0.0;
+    double u, mean, var, z;
+
+    /* Sort the pooled sample (insertion sort keeps the a/b labels together) */
+    for (i = 0; i < n; i++) {
+        double x = (i < na) ? a[i] : b[i - na];
+        int label = (i < na);
+        for (j = i; j > 0 && value[j - 1] > x; j--) {
+            value[j] = value[j - 1];
+            from_a[j] = from_a[j - 1];
+        }
+        value[j] = x;
+        from_a[j] = label;
+    }
+
+    /* Average ranks over ties */
+    for (i = 0; i < n; i = j) {
+        for (j = i + 1; j < n && value[j] == value[i]; j++)
+            ;
+        for (k = i; k < j; k++)
+            rank[k] = 0.5 * (i + j + 1);
+        tie_term += pow(j - i, 3) - (j - i);
+    }
+    for (i = 0; i < n; i++)
+        if (from_a[i])
+            rank_sum_a += rank[i];
+
+    u = rank_sum_a - na * (na + 1) / 2.0;
+    mean = na * nb / 2.0;
+    var = na * nb / 12.0 * ((n + 1) - tie_term / ((double)n * (n - 1)));
+
+    free((void *)value);
+    free((void *)rank);
+    free((void *)from_a);
+
+    if (var <= 0.0)
+        return 1.0;
+    z = (fabs(u - mean) - 0.5) / sqrt(var);  /* Continuity correction */
+    if (z < 0.0)
+        z = 0.0;
+    return erfc(z / sqrt(2.0));
+}
+
+static int bench_run(int argc, char **argv)
+{
+    if (argc < 11)
+        usage(argv[0]);
+
+    char *path = argv[2];
+    int trials = atoi(argv[3]);
+    char *function = argv[4];
+    int dim = atoi(argv[5]);
+    int swarm_size = atoi(argv[6]);
+    float xmin = atof(argv[7]);
+    float xmax = atof(argv[8]);
+    int max_iter = atoi(argv[9]);
+    int num_threads = atoi(argv[10]);
+    int trial, g;
+    float fitness;
+    pso_config_t config;
+    double time;
+    struct timeval start, stop;
+    swarm_t *swarm;
+    FILE *fp;
+
+    memset(&config, 0, sizeof(config));
+    config.function = function;
+    config.dim = dim;
+    config.swarm_size = swarm_size;
+    config.xmin = xmin;
+    config.xmax = xmax;
+    config.max_iter = max_iter;
+    config.num_threads = num_threads;
+
+    if (pso_kernels_select(getenv("PSO_ISA")) < 0)
+        return EXIT_FAILURE;
+    fprintf(stderr, "Kernels: %s, %s sums\n", pso_kernels->isa, pso_sum_policy);
+
+    fp = fopen(path, "a");
+    if (fp == NULL) {
+        fprintf(stderr, "Could not open results file %s\n", path);
+        return EXIT_FAILURE;
+    }
+    if (ftell(fp) == 0)
+        fprintf(fp, "# function dim swarm-size xmin xmax max-iter num-threads time fitness\n");
+
+    for (trial = 0; trial < trials; trial++) {
+        gettimeofday(&start, NULL);
+        swarm = pso_init_omp(function, dim, swarm_size, xmin, xmax, num_threads, trial);
+        if (swarm == NULL) {
+            fprintf(stderr, "Unable to initialize PSO\n");
+            fclose(fp);
+            return EXIT_FAILURE;
+        }
+        config.seed = trial;
+        g = pso_solve_omp(swarm, &config, NULL);
+        gettimeofday(&stop, NULL);
+        fitness = (g >= 0) ? swarm->particle[g].fitness : NAN;
+        pso_free(swarm);
+
+        time = stop.tv_sec - start.tv_sec + (stop.tv_usec - start.tv_usec) / 1000000.0;
+        fprintf(fp, "%s %d %d %g %g %d %d %f %f\n", function, dim, swarm_size,
+                xmin, xmax, max_iter, num_threads, time, fitness);
+        fflush(fp);
+        fprintf(stderr, "Trial %d: time = %fs, fitness = %.4f\n", trial, time, fitness);
+    }
+
+    fclose(fp);
+    return EXIT_SUCCESS;
+}
+
+/* Progress hook of bench_target: stop once the target is reached */
+static int bench_check_target(void *arg, int iter, int g, swarm_t *swarm)
+{
+    float *target = (float *)arg;
+
+    (void)iter;
+    return swarm->particle[g].fitness <= *target;
+}
+
+static int bench_target(int argc, char **argv)
+{
+    if (argc < 11)
+        usage(argv[0]);
+
+    float target = atof(argv[2]);
+    int trials = atoi(argv[3]);
+    char *function = argv[4];
+    static char *default_variants[] = { "gbest", "clpso" };
+    char **variants = (argc > 11) ? argv + 11 : default_variants;
+    int num_variants = (argc > 11) ? argc - 11 : 2;
+    int trial, g, i, num_reached;
+    char name[64], *suffix;
+    double *evals, *time, *fitness, start;
+    pso_config_t config;
+    pso_progress_t progress;
+    swarm_t *swarm;
+
+    progress.callback = bench_check_target;
+    progress.arg = &target;
+    progress.stats = NULL;
+    progress.stats_every = 0;
+    progress.elite = NULL;
+    progress.dynamic = NULL;
+    progress.noise = NULL;
+    memset(&config, 0, sizeof(config));
+    config.function = function;
+    config.dim = atoi(argv[5]);
+    config.swarm_size = atoi(argv[6]);
+    config.xmin = atof(argv[7]);
+    config.xmax = atof(argv[8]);
+    config.max_iter = atoi(argv[9]);
+    config.num_threads = atoi(argv[10]);
+    if (trials < 1 || pso_find_objective(function) == NULL)
+        usage(argv[0]);
+
+    if (pso_kernels_select(getenv("PSO_ISA")) < 0)
+        return EXIT_FAILURE;
+    fprintf(stderr, "Kernels: %s, %s sums\n", pso_kernels->isa, pso_sum_policy);
+
+    evals = (double *)malloc(trials * sizeof(double));
+    time = (double *)malloc(trials * sizeof(double));
+    fitness = (double *)malloc(trials * sizeof(double));
+    if (evals == NULL || time == NULL || fitness == NULL) {
+        fprintf(stderr, "Malloc error\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("%s %d, target %g, at most %d iterations of %d particles\n", function, config.dim, target,
+           config.max_iter, config.swarm_size);
+    printf("%-14s %8s %14s %10s %14s\n", "variant", "reached", "evaluations", "time(s)", "fitness");
+    for (i = 0; i < num_variants; i++) {
+        snprintf(name, sizeof(name), "%s", variants[i]);
+        suffix = strstr(name, "+obl");
+        config.opposition = (suffix != NULL && suffix[4] == '\0');
+        config.jump_rate = 0.3;
+        if (config.opposition)
+            *suffix = '\0';
+        if (pso_parse_variant(name, &config) < 0) {
+            fprintf(stderr, "Unknown variant %s\n", variants[i]);
+            return EXIT_FAILURE;
+        }
+        num_reached = 0;
+        for (trial = 0; trial < trials; trial++) {
+            start = omp_get_wtime();
+            swarm = pso_init_omp(function, config.dim, config.swarm_size, config.xmin, config.xmax,
+                                 config.num_threads, trial);
+            if (swarm == NULL) {
+                fprintf(stderr, "Unable to initialize PSO\n");
+                return EXIT_FAILURE;
+            }
+            config.seed = trial;
+            g = pso_solve_omp(swarm, &config, &progress);
+            time[trial] = omp_get_wtime() - start;
+            fitness[trial] = (g >= 0) ? swarm->particle[g].fitness : NAN;
+            /* Runs that miss the target sort after every run that reached it */
+            if (fitness[trial] <= target) {
+                evals[trial] = swarm->num_evals;
+                num_reached++;
+            } else {
+                evals[trial] = INFINITY;
+            }
+            pso_free(swarm);
+        }
+        printf("%-14s %5d/%-3d %14.0f %10.4f %14.6g\n", variants[i], num_reached, trials,
+               median(evals, trials), median(time, trials), median(fitness, trials));
+    }
+
+    free((void *)evals);
+    free((void *)time);
+    free((void *)fitness);
+    return EXIT_SUCCESS;
+}
+
+/* Progress hook of bench_stats: run to the end */
+static int bench_continue(void *arg, int iter, int g, swarm_t *swarm)
+{
+    (void)arg;
+    (void)iter;
+    (void)g;
+    (void)swarm;
+    return 0;
+}
+
+static int bench_stats(int argc, char **argv)
+{
+    if (argc < 10)
+        usage(argv[0]);
+
+    int trials = atoi(argv[2]);
+    int trial, with, i, j, k, dim;
+    double *time[2], *ratio, start, mean, dist, var, error = 0.0;
+    float *centroid;
+    pso_config_t config;
+    pso_stats_t stats;
+    pso_progress_t progress = { bench_continue, NULL, NULL, 0, NULL, NULL, NULL };
+    swarm_t *swarm;
+
+    memset(&config, 0, sizeof(config));
+    config.function = argv[3];
+    config.dim = dim = atoi(argv[4]);
+    config.swarm_size = atoi(argv[5]);
+    config.xmin = atof(argv[6]);
+    config.xmax = atof(argv[7]);
+    config.max_iter = atoi(argv[8]);
+    config.num_threads = atoi(argv[9]);
+    progress.stats_every = (argc > 10) ? atoi(argv[10]) : 1;
+    if (trials < 1 || dim < 1 || progress.stats_every < 1 || pso_find_objective(config.function) == NULL)
+        usage(argv[0]);
+
+    if (pso_kernels_select(getenv("PSO_ISA")) < 0)
+        return EXIT_FAILURE;
+    fprintf(stderr, "Kernels: %s, %s sums\n", pso_kernels->isa, pso_sum_policy);
+
+    time[0] = (double *)malloc(trials * sizeof(double));
+    time[1] = (double *)malloc(trials * sizeof(double));
+    ratio = (double *)malloc(trials * sizeof(double));
+    centroid = (float *)malloc(dim * sizeof(float));
+    if (time[0] == NULL || time[1] == NULL || ratio == NULL || centroid == NULL) {
+        fprintf(stderr, "Malloc error\n");
+        return EXIT_FAILURE;
+    }
+    stats.centroid = centroid;
+
+    for (trial = 0; trial < trials; trial++) {
+        for (i = 0; i < 2; i++) {
+            with = (trial + i) % 2;     /* Alternate which run goes first */
+            swarm = pso_init_omp(config.function, dim, config.swarm_size, config.xmin, config.xmax,
+                                 config.num_threads, trial);
+            if (swarm == NULL) {
+                fprintf(stderr, "Unable to initialize PSO\n");
+                return EXIT_FAILURE;
+            }
+            config.seed = trial;
+            progress.stats = with ? &stats : NULL;
+            start = omp_get_wtime();
+            pso_solve_omp(swarm, &config, &progress);
+            time[with][trial] = omp_get_wtime() - start;
+
+            if (with) {
+                /* Two passes over the final positions */
+                for (var = 0.0, j = 0; j < dim; j++) {
+                    for (mean = 0.0, k = 0; k < swarm->num_particles; k++)
+                        mean += swarm->x[(size_t)k * dim + j];
+                    mean /= swarm->num_particles;
+                    error = fmax(error, fabs(mean - centroid[j]));
+                    for (k = 0; k < swarm->num_particles; k++) {
+                        dist = swarm->x[(size_t)k * dim + j] - mean;
+                        var += dist * dist;
+                    }
+                }
+                error = fmax(error, fabs(sqrt(var / swarm->num_particles) - stats.diversity));
+            }
+            pso_free(swarm);
+        }
+        ratio[trial] = time[1][trial] / time[0][trial];
+    }
+
+    /* Runs of a trial share their seed, so the overhead is the median ratio
+     * of the pairs, which is steadier than the ratio of the medians */
+    printf("%s %d, %d particles, %d iterations, %d threads, statistics every %d\n", config.function, dim,
+           config.swarm_size, config.max_iter, config.num_threads, progress.stats_every);
+    printf("without statistics %.4fs, with %.4fs (medians of %d): overhead %.2f%%\n", median(time[0], trials),
+           median(time[1], trials), trials, 100.0 * (median(ratio, trials) - 1.0));
+    printf("last iteration: diversity %.6g, fitness mean %.6g sd %.6g; largest difference from two passes %.3g\n",
+           stats.diversity, stats.fitness_mean, sqrt(stats.fitness_var), error);
+
+    free((void *)time[0]);
+    free((void *)time[1]);
+    free((void *)ratio);
+    free((void *)centroid);
+    return EXIT_SUCCESS;
+}
+
+/* Response strategies of bench_dynamic */
+typedef struct bench_strategy_s {
+    const char *name;
+    pso_detect_t detect;
+    int sentinels;
+    float rediversify;
+    int memory;
+} bench_strategy_t;
+
+static const bench_strategy_t bench_strategies[] = {
+    { "none",              PSO_DETECT_NONE,     0,  0.0, 0 },
+    { "signal",            PSO_DETECT_SIGNAL,   0,  0.0, 0 },
+    { "signal+redraw",     PSO_DETECT_SIGNAL,   0,  0.2, 0 },
+    { "signal+memory",     PSO_DETECT_SIGNAL,   0,  0.2, 4 },
+    { "sentinel-1",        PSO_DETECT_SENTINEL, 1,  0.2, 4 },
+    { "sentinel-4",        PSO_DETECT_SENTINEL, 4,  0.2, 4 },
+    { "sentinel-16",       PSO_DETECT_SENTINEL, 16, 0.2, 4 },
+};
+
+static int bench_dynamic(int argc, char **argv)
+{
+    if (argc < 11)
+        usage(argv[0]);
+
+    int trials = atoi(argv[2]);
+    int num_strategies = sizeof(bench_strategies) / sizeof(bench_strategies[0]);
+    int trial, i, moves = 0, detected;
+    double *offline, *before, *share, *time, start;
+    const bench_strategy_t *strategy;
+    pso_config_t config;
+    pso_drift_t drift;
+    pso_dynamic_t dynamic;
+    pso_track_t track;
+    pso_progress_t progress = { pso_track, &track, NULL, 0, NULL, &dynamic, NULL };
+    swarm_t *swarm;
+
+    memset(&config, 0, sizeof(config));
+    pso_dynamic_defaults(&config);
+    config.function = argv[3];
+    config.dim = atoi(argv[4]);
+    config.swarm_size = atoi(argv[5]);
+    config.xmin = atof(argv[6]);
+    config.xmax = atof(argv[7]);
+    config.max_iter = atoi(argv[8]);
+    config.num_threads = atoi(argv[9]);
+    config.dynamic_period = atoi(argv[10]);
+    if (argc > 11)
+        config.severity = atof(argv[11]);
+    if (trials < 1 || config.dim < 1 || config.dynamic_period < 1 || pso_find_objective(config.function) == NULL)
+        usage(argv[0]);
+
+    if (pso_kernels_select(getenv("PSO_ISA")) < 0)
+        return EXIT_FAILURE;
+    fprintf(stderr, "Kernels: %s, %s sums\n", pso_kernels->isa, pso_sum_policy);
+
+    offline = (double *)malloc(trials * sizeof(double));
+    before = (double *)malloc(trials * sizeof(double));
+    share = (double *)malloc(trials * sizeof(double));
+    time = (double *)malloc(trials * sizeof(double));
+    dynamic.shift = (float *)malloc(config.dim * sizeof(float));
+    track.x = (float *)malloc(config.dim * sizeof(float));
+    if (offline == NULL || before == NULL || share == NULL || time == NULL || dynamic.shift == NULL || track.x == NULL) {
+        fprintf(stderr, "Malloc error\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("%s %d, %d particles, %d iterations, optimum moves %g of the domain every %d iterations\n",
+           config.function, config.dim, config.swarm_size, config.max_iter, config.severity, config.dynamic_period);
+    printf("%-16s %9s %14s %14s %9s %10s\n", "strategy", "detected", "offline error", "before moves",
+           "re-eval", "time(s)");
+    for (i = 0; i < num_strategies; i++) {
+        strategy = &bench_strategies[i];
+        detected = 0;
+        for (trial = 0; trial < trials; trial++) {
+            swarm = pso_init_omp(config.function, config.dim, config.swarm_size, config.xmin, config.xmax,
+                                 config.num_threads, trial);
+            if (swarm == NULL) {
+                fprintf(stderr, "Unable to initialize PSO\n");
+                return EXIT_FAILURE;
+            }
+            config.seed = trial;
+            pso_drift_init(&drift, &config);
+            memset(dynamic.shift, 0, config.dim * sizeof(float));
+            dynamic.change = pso_drift_change;
+            dynamic.arg = &drift;
+            dynamic.detect = strategy->detect;
+            dynamic.sentinels = strategy->sentinels;
+            dynamic.rediversify = strategy->rediversify;
+            dynamic.memory = strategy->memory;
+            track.objective = pso_find_objective(config.function);
+            track.dynamic = &dynamic;
+            track.drift = &drift;
+            track.xmin = config.xmin;
+            track.xmax = config.xmax;
+            track.error_sum = track.before_sum = track.delay_sum = 0.0;
+            track.iters = track.befores = track.detected = 0;
+            start = omp_get_wtime();
+            if (pso_solve_omp(swarm, &config, &progress) < 0)
+                return EXIT_FAILURE;
+            time[trial] = omp_get_wtime() - start;
+            offline[trial] = track.error_sum / track.iters;
+            before[trial] = (track.befores > 0) ? track.before_sum / track.befores : NAN;
+            share[trial] = 100.0 * dynamic.reevals / swarm->num_evals;
+            moves = drift.changes;
+            detected += dynamic.changes;
+            pso_free(swarm);
+        }
+        printf("%-16s %4d/%-4d %14.6g %14.6g %8.2f%% %10.4f\n", strategy->name, detected, moves * trials,
+               median(offline, trials), median(before, trials), median(share, trials), median(time, trials));
+    }
+
+    free((void *)offline);
+    free((void *)before);
+    free((void *)share);
+    free((void *)time);
+    free((void *)dynamic.shift);
+    free((void *)track.x);
+    return EXIT_SUCCESS;
+}
+
+/* Sampling strategies of bench_noise */
+typedef struct bench_sampling_s {
+    const char *name;
+    int samples;
+    int max_samples;
+} bench_sampling_t;
+
+static const bench_sampling_t bench_samplings[] = {
+    { "1 sample",  1, 2 },
+    { "2 samples", 2, 2 },
+    { "4 samples", 4, 2 },
+    { "8 samples", 8, 2 },
+    { "race-4",    0, 4 },
+    { "race-16",   0, 16 },
+    { "race-64",   0, 64 },
+};
+
+/* Evaluation budget and iterations of a bench_noise trial */
+typedef struct bench_budget_s {
+    long max_evals;
+    int iter;
+} bench_budget_t;
+
+/* Progress hook of bench_noise: stop once the budget is spent */
+static int bench_spent(void *arg, int iter, int g, swarm_t *swarm)
+{
+    bench_budget_t *budget = (bench_budget_t *)arg;
+
+    (void)g;
+    budget->iter = iter;
+    return budget->max_evals > 0 && swarm->num_evals >= budget->max_evals;
+}
+
+static int bench_noise(int argc, char **argv)
+{
+    if (argc < 11)
+        usage(argv[0]);
+
+    int trials = atoi(argv[2]);
+    int num_samplings = sizeof(bench_samplings) / sizeof(bench_samplings[0]);
+    int trial, i;
+    double *evals, *iters, *accuracy, *share, *truth;
+    pso_config_t config;
+    pso_noise_t noise;
+    bench_budget_t budget;
+    pso_progress_t progress = { bench_spent, &budget, NULL, 0, NULL, NULL, &noise };
+    swarm_t *swarm;
+
+    memset(&config, 0, sizeof(config));
+    config.function = argv[3];
+    config.dim = atoi(argv[4]);
+    config.swarm_size = atoi(argv[5]);
+    config.xmin = atof(argv[6]);
+    config.xmax = atof(argv[7]);
+    config.max_iter = atoi(argv[8]);
+    config.num_threads = atoi(argv[9]);
+    noise.sigma = atof(argv[10]);
+    budget.max_evals = (argc > 11) ? atol(argv[11]) : 0;
+    if (trials < 1 || config.dim < 1 || !(noise.sigma >= 0) || pso_find_objective(config.function) == NULL)
+        usage(argv[0]);
+
+    if (pso_kernels_select(getenv("PSO_ISA")) < 0)
+        return EXIT_FAILURE;
+    fprintf(stderr, "Kernels: %s, %s sums\n", pso_kernels->isa, pso_sum_policy);
+
+    evals = (double *)malloc(trials * sizeof(double));
+    iters = (double *)malloc(trials * sizeof(double));
+    accuracy = (double *)malloc(trials * sizeof(double));
+    share = (double *)malloc(trials * sizeof(double));
+    truth = (double *)malloc(trials * sizeof(double));
+    if (evals == NULL || iters == NULL || accuracy == NULL || share == NULL || truth == NULL) {
+        fprintf(stderr, "Malloc error\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("%s %d, %d particles, noise sigma %g, at most %d iterations", config.function, config.dim,
+           config.swarm_size, noise.sigma, config.max_iter);
+    if (budget.max_evals > 0)
+        printf(" or %ld evaluations", budget.max_evals);
+    printf("\n%-10s %12s %8s %9s %10s %14s\n", "sampling", "evaluations", "iters", "correct", "resamples",
+           "true fitness");
+    for (i = 0; i < num_samplings; i++) {
+        noise.samples = bench_samplings[i].samples;
+        noise.max_samples = bench_samplings[i].max_samples;
+        for (trial = 0; trial < trials; trial++) {
+            swarm = pso_init_omp(config.function, config.dim, config.swarm_size, config.xmin, config.xmax,
+                                 config.num_threads, trial);
+            if (swarm == NULL) {
+                fprintf(stderr, "Unable to initialize PSO\n");
+                return EXIT_FAILURE;
+            }
+            config.seed = trial;
+            budget.iter = 0;
+            if (pso_solve_omp(swarm, &config, &progress) < 0)
+                return EXIT_FAILURE;
+            evals[trial] = swarm->num_evals;
+            iters[trial] = budget.iter;
+            accuracy[trial] = (noise.decisions > 0) ? 100.0 * noise.correct / noise.decisions : 0.0;
+            share[trial] = 100.0 * noise.resamples / swarm->num_evals;
+            truth[trial] = noise.truth;
+            pso_free(swarm);
+        }
+        printf("%-10s %12.0f %8.0f %8.2f%% %9.2f%% %14.6g\n", bench_samplings[i].name, median(evals, trials),
+               median(iters, trials), median(accuracy, trials), median(share, trials), median(truth, trials));
+    }
+
+    free((void *)evals);
+    free((void *)iters);
+    free((void *)accuracy);
+    free((void *)share);
+    free((void *)truth);
+    return EXIT_SUCCESS;
+}
+
+/* Evaluations per second of the batch objective eval, called on blocks of
+ * the num_points rows of x in turn until evals evaluations. The fitness of
+ * every row is left in fitness */
+static double bench_eval_rate(void (*eval)(const float *, int, int, float *), const float *x, int num_points,
+                              int dim, long evals, float *fitness)
+{
+    long done = 0;
+    int i, m;
+    double start = omp_get_wtime();
+
+    while (done < evals || done < num_points) {
+        for (i = 0; i < num_points; i += PSO_BLOCK, done += m) {
+            m = (num_points - i < PSO_BLOCK) ? num_points - i : PSO_BLOCK;
+            eval(x + (size_t)i * dim, m, dim, fitness + i);
+        }
+    }
+    return done / (omp_get_wtime() - start);
+}
+
+#define BENCH_EXPR_POINTS 4096
+
+static int bench_expr(int argc, char **argv)
+{
+    if (argc < 5)
+        usage(argv[0]);
+
+    long evals = atol(argv[2]);
+    int dim = atoi(argv[3]);
+    char *text = argv[4];
+    const pso_objective_t *builtin = (argc > 5) ? pso_find_objective(argv[5]) : NULL;
+    const pso_objective_t *objective;
+    char dir[] = "/tmp/pso_bench.XXXXXX", path[300];
+    double cold, warm, interpreted, compiled, kernel = 0.0;
+    float *x, *fitness, *reference;
+    unsigned int seed = 1;
+    int i, differ = 0;
+    DIR *cache;
+    struct dirent *entry;
+
+    if (evals < 1 || dim < 1 || (argc > 5 && (builtin == NULL || dim < builtin->min_dim)))
+        usage(argv[0]);
+    if (pso_kernels_select(getenv("PSO_ISA")) < 0)
+        return EXIT_FAILURE;
+    fprintf(stderr, "Kernels: %s, %s sums\n", pso_kernels->isa, pso_sum_policy);
+
+    x = (float *)malloc((size_t)BENCH_EXPR_POINTS * dim * sizeof(float));
+    fitness = (float *)malloc(BENCH_EXPR_POINTS * sizeof(float));
+    reference = (float *)malloc(BENCH_EXPR_POINTS * sizeof(float));
+    if (x == NULL || fitness == NULL || reference == NULL || mkdtemp(dir) == NULL) {
+        fprintf(stderr, "Could not allocate the points or the module cache\n");
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < BENCH_EXPR_POINTS * dim; i++)
+        x[i] = uniform_omp(-5.0, 5.0, &seed);
+
+    /* Interpreter, then the module built in the empty cache and loaded from it */
+    if (pso_expr_load(text, dim, 0, NULL, NULL) == NULL)
+        return EXIT_FAILURE;
+    interpreted = bench_eval_rate(pso_expr_interpret, x, BENCH_EXPR_POINTS, dim, evals, reference);
+    pso_expr_load(text, dim, 1, dir, &cold);
+    objective = pso_expr_load(text, dim, 1, dir, &warm);
+    compiled = bench_eval_rate(objective->batch, x, BENCH_EXPR_POINTS, dim, evals, fitness);
+    for (i = 0; i < BENCH_EXPR_POINTS; i++)
+        differ += (memcmp(&fitness[i], &reference[i], sizeof(float)) != 0);
+    if (builtin != NULL)
+        kernel = bench_eval_rate(pso_objective_batch(builtin), x, BENCH_EXPR_POINTS, dim, evals, fitness);
+
+    printf("%s, D = %d, %ld evaluations each\n", text, dim, evals);
+    if (objective->batch == pso_expr_interpret)
+        printf("module: could not be built, interpreted only\n");
+    else
+        printf("module: built in %.4fs, loaded from the cache in %.4fs\n", cold, warm);
+    printf("interpreted %.4g evals/s, compiled %.4g evals/s (%.2fx)", interpreted, compiled, compiled / interpreted);
+    if (builtin != NULL)
+        printf(", %s kernel %.4g evals/s", builtin->name, kernel);
+    printf("\ncompiled fitness %s the interpreter's on %d points", (differ == 0) ? "matches" : "differs from",
+           BENCH_EXPR_POINTS);
+    if (differ > 0)
+        printf(" (%d differ)", differ);
+    printf("\n");
+
+    /* Remove the module cache */
+    cache = opendir(dir);
+    while (cache != NULL && (entry = readdir(cache)) != NULL) {
+        if (entry->d_name[0] == '.')
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        unlink(path);
+    }
+    if (cache != NULL)
+        closedir(cache);
+    rmdir(dir);
+    free((void *)x);
+    free((void *)fitness);
+    free((void *)reference);
+    return (differ == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int bench_compare(int argc, char **argv)
+{
+    if (argc < 4)
+        usage(argv[0]);
+
+    double threshold = (argc > 4) ? atof(argv[4]) : 0.05;
+    double alpha = (argc > 5) ? atof(argv[5]) : 0.05;
+    bench_results_t base, next;
+    bench_config_t *a, *b;
+    double median_a, median_b, speedup, p;
+    int i, num_regressions = 0;
+    const char *verdict;
+
+    if (bench_load(argv[2], &base) < 0 || bench_load(argv[3], &next) < 0)
+        return 2;
+
+    printf("%-40s %6s %6s %10s %10s %8s %8s  %s\n", "configuration", "n_base", "n_new",
+           "base(s)", "new(s)", "speedup", "p", "verdict");
+    for (i = 0; i < base.num_configs; i++) {
+        a = &base.config[i];
+        b = bench_find(&next, a->key, 0);
+        if (b == NULL) {
+            printf("%-40s %6d %6s %10s %10s %8s %8s  %s\n", a->key, a->num_trials, "-", "-", "-", "-", "-", "missing in new");
+            continue;
+        }
+
+        median_a = median(a->time, a->num_trials);
+        median_b = median(b->time, b->num_trials);
+        speedup = median_a / median_b;
+        p = mann_whitney(a->time, a->num_trials, b->time, b->num_trials);
+
+        if (p >= alpha)
+            verdict = "no significant change";
+        else if (median_b > median_a * (1.0 + threshold)) {
+            verdict = "REGRESSION";
+            num_regressions++;
+        } else if (median_b < median_a)
+            verdict = "faster";
+        else
+            verdict = "slower (within threshold)";
+
+        printf("%-40s %6d %6d %10.4f %10.4f %8.3f %8.4f  %s\n", a->key, a->num_trials, b->num_trials,
+               median_a, median_b, speedup, p, verdict);
+    }
+    for (i = 0; i < next.num_configs; i++)
+        if (bench_find(&base, next.config[i].key, 0) == NULL)
+            printf("%-40s %6s %6d %10s %10s %8s %8s  %s\n", next.config[i].key, "-", next.config[i].num_trials,
+                   "-", "-", "-", "-", "missing in baseline");
+
+    printf("%d regression(s) beyond %.1f%% at alpha = %g\n", num_regressions, threshold * 100, alpha);
+    return (num_regressions > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+        usage(argv[0]);
+
+    if (strcmp(argv[1], "run") == 0)
+        return bench_run(argc, argv);
+    if (strcmp(argv[1], "target") == 0)
+        return bench_target(argc, argv);
+    if (strcmp(argv[1], "stats") == 0)
+        return bench_stats(argc, argv);
+    if (strcmp(argv[1], "dynamic") == 0)
+        return bench_dynamic(argc, argv);
+    if (strcmp(argv[1], "noise") == 0)
+        return bench_noise(argc, argv);
+    if (strcmp(argv[1], "expr") == 0)
+        return bench_expr(argc, argv);
+    if (strcmp(argv[1], "compare") == 0)
+        return bench_compare(argc, argv);
+
+    usage(argv[0]);
+    return EXIT_FAILURE;
+}
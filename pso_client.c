@@ -0,0 +1,217 @@
+/* Client for the optimizer daemon (pso --serve).
+ *
+ *  pso_client socket [-s] [--cold path-to-pso] [-t threads] < requests.jsonl
+ *
+ * Sends the request lines read from stdin (see pso_serve.c for the format),
+ * prints every line the daemon sends back and reports the latency of each
+ * run request from sending it to receiving its result. By default all
+ * requests are sent at once; -s sends one request at a time. With --cold the
+ * same run requests are also timed as cold invocations of path-to-pso, one
+ * process per request, for comparison. A cold run gets the cores a lone
+ * request gets from the daemon, -t threads (default the number of
+ * processors, the daemon's default), so the two differ only by startup.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <omp.h>
+#include "pso.h"
+
+/* Run request sent to the daemon */
+typedef struct client_request_s {
+    char id[64];
+    char *spec;         /* Job spec without the daemon fields */
+    double sent;
+    double latency;
+    int done;
+} client_request_t;
+
+static void usage(char *name)
+{
+    fprintf(stderr, "Usage: %s socket [-s] [--cold path-to-pso] [-t threads] < requests.jsonl\n", name);
+    exit(EXIT_FAILURE);
+}
+
+static void report(const char *label, double *latency, int n)
+{
+    int i;
+    double sum = 0.0;
+
+    if (n == 0)
+        return;
+    qsort(latency, n, sizeof(double), pso_compare_double);
+    for (i = 0; i < n; i++)
+        sum += latency[i];
+    fprintf(stderr, "%s: %d requests, mean %.3fms, median %.3fms, min %.3fms, max %.3fms\n", label, n,
+            1e3 * sum / n, 1e3 * latency[n / 2], 1e3 * latency[0], 1e3 * latency[n - 1]);
+}
+
+/* Read one response line and account for it. Return -1 when the daemon hung up */
+static int client_receive(FILE *in, client_request_t *requests, int num_requests, int *pending)
+{
+    static char *line = NULL;
+    static size_t line_len = 0;
+    char key[64], value[256], id[64] = "";
+    const char *p;
+    int i, is_result = 0;
+
+    if (getline(&line, &line_len, in) == -1)
+        return -1;
+    fputs(line, stdout);
+
+    p = line;
+    while (pso_json_next(&p, key, sizeof(key), value, sizeof(value)) > 0) {
+        if (strcmp(key, "id") == 0)
+            snprintf(id, sizeof(id), "%.63s", value);
+        else if (strcmp(key, "status") == 0)
+            is_result = 1;
+        else if (strcmp(key, "position") == 0)
+            break; /* Arrays are not flat values; nothing else needed */
+    }
+    if (!is_result)
+        return 0;
+    for (i = 0; i < num_requests; i++) {
+        if (!requests[i].done && strcmp(requests[i].id, id) == 0) {
+            requests[i].done = 1;
+            requests[i].latency = omp_get_wtime() - requests[i].sent;
+            (*pending)--;
+            break;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int i, fd, sequential = 0, num_requests = 0, capacity = 0, pending = 0, num_threads = omp_get_num_procs();
+    char *cold = NULL, *line = NULL, key[64], value[256], op[16];
+    const char *p;
+    size_t line_len = 0;
+    double *latency;
+    struct sockaddr_un addr;
+    client_request_t *requests = NULL, *request;
+    FILE *in, *out, *spec;
+    size_t spec_len;
+
+    if (argc < 2)
+        usage(argv[0]);
+    for (i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0)
+            sequential = 1;
+        else if (strcmp(argv[i], "--cold") == 0 && i + 1 < argc)
+            cold = argv[++i];
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            num_threads = atoi(argv[++i]);
+        else
+            usage(argv[0]);
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", argv[1]);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror(argv[1]);
+        exit(EXIT_FAILURE);
+    }
+    in = fdopen(dup(fd), "r");
+    out = fdopen(fd, "w");
+    if (in == NULL || out == NULL) {
+        perror("fdopen");
+        exit(EXIT_FAILURE);
+    }
+
+    while (getline(&line, &line_len, stdin) != -1) {
+        if (line[strspn(line, " \t\r\n")] == '\0')
+            continue;
+        if (num_requests == capacity) {
+            capacity = (capacity > 0) ? 2 * capacity : 64;
+            requests = (client_request_t *)realloc(requests, capacity * sizeof(client_request_t));
+            if (requests == NULL) {
+                fprintf(stderr, "Malloc error\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        /* Keep the job spec of run requests for the cold comparison */
+        request = &requests[num_requests];
+        memset(request, 0, sizeof(client_request_t));
+        op[0] = '\0';
+        spec = open_memstream(&request->spec, &spec_len);
+        fputc('{', spec);
+        p = line;
+        while (pso_json_next(&p, key, sizeof(key), value, sizeof(value)) > 0) {
+            if (strcmp(key, "op") == 0) {
+                snprintf(op, sizeof(op), "%.15s", value);
+                continue;
+            }
+            if (strcmp(key, "id") == 0)
+                snprintf(request->id, sizeof(request->id), "%.63s", value);
+            if (strcmp(key, "progress_every") == 0)
+                continue;
+            fprintf(spec, "%s\"%s\":", (ftell(spec) > 1) ? "," : "", key);
+            pso_json_string(spec, value);
+        }
+        fputs("}\n", spec);
+        fclose(spec);
+
+        fputs(line, out);
+        fflush(out);
+        if (strcmp(op, "run") != 0) {
+            free((void *)request->spec);
+            continue;
+        }
+        request->sent = omp_get_wtime();
+        num_requests++;
+        pending++;
+
+        while (sequential && pending > 0)
+            if (client_receive(in, requests, num_requests, &pending) < 0)
+                break;
+    }
+    while (pending > 0)
+        if (client_receive(in, requests, num_requests, &pending) < 0) {
+            fprintf(stderr, "Daemon closed the connection with %d requests pending\n", pending);
+            break;
+        }
+    fclose(out);
+    fclose(in);
+
+    latency = (double *)malloc((num_requests + 1) * sizeof(double));
+    for (i = 0, pending = 0; i < num_requests; i++)
+        if (requests[i].done)
+            latency[pending++] = requests[i].latency;
+    report("Warm (daemon)", latency, pending);
+
+    /* Same requests as cold processes */
+    if (cold != NULL) {
+        char command[1024];
+        FILE *child;
+        double start;
+
+        snprintf(command, sizeof(command), "%s --jobs - -t %d > /dev/null 2>&1", cold, num_threads);
+        for (i = 0; i < num_requests; i++) {
+            start = omp_get_wtime();
+            child = popen(command, "w");
+            if (child == NULL) {
+                perror(command);
+                break;
+            }
+            fputs(requests[i].spec, child);
+            pclose(child);
+            latency[i] = omp_get_wtime() - start;
+        }
+        report("Cold (./pso per request)", latency, i);
+    }
+
+    for (i = 0; i < num_requests; i++)
+        free((void *)requests[i].spec);
+    free((void *)requests);
+    free((void *)latency);
+    free((void *)line);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,305 @@
+/* Dynamic objectives for the OpenMP engine.
+ *
+ * A dynamic objective is evaluated at x - shift, clamped to the domain,
+ * where shift moves between iterations (see pso_dynamic_t). Once the
+ * objective has moved, the fitness stored with every pbest is stale:
+ * particles keep pbests that are no longer good and gbest may point at the
+ * old optimum. The solver learns of a move either from the objective's own
+ * signal, or by re-evaluating a few sentinel pbests (the best one and others
+ * spread over the swarm) at the start of every iteration and comparing them
+ * with their stored fitness; evaluation is deterministic, so any difference
+ * means the objective moved. Sentinels cost their evaluations in every
+ * iteration, changes or not.
+ *
+ * On a detected change the next evaluate pass first re-evaluates the pbests
+ * of each block in one batch objective call, then redraws a fraction of the
+ * block's particles uniformly over the domain and re-injects the memory, the
+ * best positions held before the last few changes, into the last particles
+ * of the swarm; both kinds start over with their new position as pbest. The
+ * best particle is never redrawn. The redraw is keyed by the seed, change
+ * and particle index, so a run does not depend on the thread count. The
+ * response is folded into the evaluate pass of the same iteration, so it
+ * costs one batch call per block and no extra parallel region; the update of
+ * that iteration still follows the stale pbests. The latest memory, the
+ * best position just before the move, restarts a particle next to a small
+ * move; older ones only pay off when the optimum comes back.
+ *
+ * For the test functions the objective moves with pso_drift_change: every
+ * period iterations the shift takes a step of severity times the domain
+ * width in a random direction, reflected to stay within a quarter of the
+ * domain of zero. Clamping keeps the known minimum a lower bound, but an
+ * optimum near the edge of the domain (holder_table, schwefel, eggholder)
+ * can be pushed out of it, and the error then has a floor. pso_track
+ * measures the tracking error of a run: after each iteration it re-evaluates
+ * the best pbest under the current shift and accumulates its distance to the
+ * function's known minimum (the offline error), the error just before each
+ * move and the delay from each move to its detection. That evaluation is a
+ * measurement and is not counted.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "pso.h"
+
+/* Set the detection method named name. Return 0 on success, -1 if unknown */
+int pso_parse_detect(const char *name, pso_config_t *config)
+{
+    if (strcmp(name, "signal") == 0)
+        config->detect = PSO_DETECT_SIGNAL;
+    else if (strcmp(name, "sentinel") == 0)
+        config->detect = PSO_DETECT_SENTINEL;
+    else if (strcmp(name, "none") == 0)
+        config->detect = PSO_DETECT_NONE;
+    else
+        return -1;
+    return 0;
+}
+
+/* Default response to moves of the objective */
+void pso_dynamic_defaults(pso_config_t *config)
+{
+    config->severity = 0.02;
+    config->detect = PSO_DETECT_SIGNAL;
+    config->sentinels = 4;
+    config->rediversify = 0.2;
+    config->memory = 4;
+}
+
+/* Moving optimum of config's run */
+void pso_drift_init(pso_drift_t *drift, pso_config_t *config)
+{
+    drift->period = config->dynamic_period;
+    drift->step = config->severity * (config->xmax - config->xmin);
+    drift->limit = 0.25f * (config->xmax - config->xmin);
+    drift->key = pso_hash(~config->seed);
+    drift->dim = config->dim;
+    drift->changes = 0;
+    drift->last_change = 0;
+}
+
+/* Change hook of pso_dynamic_t for a pso_drift_t: move shift at the start
+ * of every period-th iteration */
+int pso_drift_change(void *arg, int iter, float *shift)
+{
+    pso_drift_t *drift = (pso_drift_t *)arg;
+    float *dir, norm = 0.0f, s;
+    int d;
+
+    if (drift->period <= 0 || iter == 0 || iter % drift->period != 0 || iter == drift->last_change)
+        return 0;
+    dir = (float *)malloc(drift->dim * sizeof(float));
+    if (dir == NULL)
+        return 0;
+    drift->changes++;
+    drift->last_change = iter;
+    pso_kernels->normal(dir, drift->dim, pso_hash(drift->key + pso_hash(drift->changes)));
+    for (d = 0; d < drift->dim; d++)
+        norm += dir[d] * dir[d];
+    norm = (norm > 0.0f) ? drift->step / sqrtf(norm) : 0.0f;
+    for (d = 0; d < drift->dim; d++) {
+        s = shift[d] + norm * dir[d];
+        while (s > drift->limit || s < -drift->limit)
+            s = (s > drift->limit) ? 2.0f * drift->limit - s : -2.0f * drift->limit - s;
+        shift[d] = s;
+    }
+    free((void *)dir);
+    return 1;
+}
+
+/* Progress hook measuring the tracking error into a pso_track_t; never
+ * stops the solve */
+int pso_track(void *arg, int iter, int g, swarm_t *swarm)
+{
+    pso_track_t *track = (pso_track_t *)arg;
+    pso_dynamic_t *dynamic = track->dynamic;
+    const float *pbest = swarm->particle[g].pbest;
+    float fitness;
+    double error;
+    int d;
+
+    for (d = 0; d < swarm->dim; d++)
+        track->x[d] = fminf(fmaxf(pbest[d] - dynamic->shift[d], track->xmin), track->xmax);
+    pso_objective_batch(track->objective)(track->x, 1, swarm->dim, &fitness);
+    error = (double)fitness - track->objective->fmin;
+    track->error_sum += error;
+    track->iters++;
+    /* Iteration iter - 1 has just run */
+    if (dynamic->changes > track->detected) {
+        track->delay_sum += (iter - 1) - track->drift->last_change;
+        track->detected = dynamic->changes;
+    }
+    if (track->drift->period > 0 && iter % track->drift->period == 0) {
+        track->before_sum += error;
+        track->befores++;
+    }
+    return 0;
+}
+
+/* Solver state of a dynamic objective: the sentinels, the memory of past
+ * optima and the change being responded to in this iteration */
+struct pso_dynamic_pool_s {
+    pso_dynamic_t *dynamic;
+    unsigned int seed;      /* Hashed run seed, keying the redraws */
+    float *sentinel_rows;   /* Sentinel pbests and their fitness */
+    float *memory;          /* Best positions before the last changes */
+    int num_memory;         /* Changes remembered */
+    int num_recall;         /* Memories re-injected on this change */
+    int changed;            /* Objective moved before this iteration */
+    unsigned int change_key;
+};
+
+/* Fitness of the n rows of the n x dim matrix x; if there is a shift, at
+ * x - shift clamped to the domain, through the rows of tmp */
+void pso_eval_rows(void (*eval)(const float *, int, int, float *), const float *x, int n, int dim,
+                   const float *shift, const pso_update_t *param, float *tmp, float *fitness)
+{
+    int i, d;
+
+    if (shift == NULL) {
+        eval(x, n, dim, fitness);
+        return;
+    }
+    for (i = 0; i < n; i++)
+        for (d = 0; d < dim; d++)
+            tmp[(size_t)i * dim + d] = fminf(fmaxf(x[(size_t)i * dim + d] - shift[d], param->xmin), param->xmax);
+    eval(tmp, n, dim, fitness);
+}
+
+/* Whether any sentinel pbest, the best one (g) and sentinels - 1 spread over
+ * the swarm, no longer evaluates to its fitness under shift. rows holds
+ * sentinels x (dim + 1) elements */
+static int pso_sentinels_moved(swarm_t *swarm, void (*eval)(const float *, int, int, float *),
+                               const float *shift, const pso_update_t *param, int sentinels, int g, float *rows)
+{
+    int dim = swarm->dim, s, d, m;
+    float *fitness = rows + (size_t)sentinels * dim;
+
+    for (s = 0; s < sentinels; s++) {
+        m = (s == 0) ? g : (int)((long)s * swarm->num_particles / sentinels);
+        for (d = 0; d < dim; d++)
+            rows[(size_t)s * dim + d] = fminf(fmaxf(swarm->particle[m].pbest[d] - shift[d], param->xmin), param->xmax);
+    }
+    eval(rows, sentinels, dim, fitness);
+    for (s = 0; s < sentinels; s++) {
+        m = (s == 0) ? g : (int)((long)s * swarm->num_particles / sentinels);
+        if (fitness[s] != swarm->particle[m].fitness)
+            return 1;
+    }
+    return 0;
+}
+
+/* Pool for a solve of num_particles particles of dimension dim under
+ * dynamic, redrawing by seed. Resets the counts of dynamic and caps its
+ * sentinels at the swarm size. Return NULL on allocation failure */
+pso_dynamic_pool_t *pso_dynamic_pool_create(pso_dynamic_t *dynamic, int num_particles, int dim, unsigned int seed)
+{
+    pso_dynamic_pool_t *pool = (pso_dynamic_pool_t *)calloc(1, sizeof(pso_dynamic_pool_t));
+
+    if (pool == NULL)
+        return NULL;
+    if (dynamic->sentinels > num_particles)
+        dynamic->sentinels = num_particles;
+    pool->dynamic = dynamic;
+    pool->seed = pso_hash(seed);
+    pool->sentinel_rows = (float *)malloc((size_t)(dynamic->sentinels + 1) * (dim + 1) * sizeof(float));
+    pool->memory = (float *)malloc((size_t)(dynamic->memory + 1) * dim * sizeof(float));
+    if (pool->sentinel_rows == NULL || pool->memory == NULL) {
+        pso_dynamic_pool_destroy(pool);
+        return NULL;
+    }
+    dynamic->changes = 0;
+    dynamic->reevals = 0;
+    return pool;
+}
+
+void pso_dynamic_pool_destroy(pso_dynamic_pool_t *pool)
+{
+    if (pool == NULL)
+        return;
+    free((void *)pool->sentinel_rows);
+    free((void *)pool->memory);
+    free((void *)pool);
+}
+
+/* Before iteration iter, with g the best particle at gbest_x: learn whether
+ * the objective moved and, if so, remember the old optimum and key the
+ * redraw. Sentinel evaluations are counted in swarm. Return whether it moved */
+int pso_dynamic_begin(pso_dynamic_pool_t *pool, swarm_t *swarm, void (*eval)(const float *, int, int, float *),
+                      const pso_update_t *param, int iter, int g, const float *gbest_x)
+{
+    pso_dynamic_t *dynamic = pool->dynamic;
+    int dim = swarm->dim;
+
+    pool->changed = dynamic->change(dynamic->arg, iter, dynamic->shift);
+    if (dynamic->detect == PSO_DETECT_SENTINEL) {
+        pool->changed = pso_sentinels_moved(swarm, eval, dynamic->shift, param, dynamic->sentinels, g,
+                                            pool->sentinel_rows);
+        swarm->num_evals += dynamic->sentinels;
+        dynamic->reevals += dynamic->sentinels;
+    } else if (dynamic->detect == PSO_DETECT_NONE) {
+        pool->changed = 0;
+    }
+    if (pool->changed) {
+        dynamic->changes++;
+        if (dynamic->memory > 0) {
+            memcpy(pool->memory + (size_t)(pool->num_memory % dynamic->memory) * dim, gbest_x, dim * sizeof(float));
+            pool->num_memory++;
+        }
+        pool->num_recall = (pool->num_memory < dynamic->memory) ? pool->num_memory : dynamic->memory;
+        if (pool->num_recall > swarm->num_particles - 1)
+            pool->num_recall = swarm->num_particles - 1;
+        pool->change_key = pso_hash(~pool->seed ^ pso_hash(dynamic->changes));
+    }
+    return pool->changed;
+}
+
+/* After a move of the objective: fresh fitness for the pbests of the n
+ * particles from first, then redrawn and remembered positions that start
+ * over. The best particle g is kept. tmp and fitness hold n rows */
+void pso_dynamic_block(pso_dynamic_pool_t *pool, swarm_t *swarm, void (*eval)(const float *, int, int, float *),
+                       const pso_update_t *param, int first, int n, int g, float *tmp, float *fitness)
+{
+    pso_dynamic_t *dynamic = pool->dynamic;
+    particle_t *particle;
+    unsigned int particle_seed;
+    int i, k, m, dim = swarm->dim;
+
+    if (!pool->changed)
+        return;
+    pso_eval_rows(eval, swarm->pbest + (size_t)first * dim, n, dim, dynamic->shift, param, tmp, fitness);
+    for (i = 0; i < n; i++) {
+        m = first + i;
+        particle = &swarm->particle[m];
+        particle->fitness = fitness[i];
+        if (m == g)
+            continue;
+        if (m >= swarm->num_particles - pool->num_recall) {
+            /* Most recent memory last */
+            memcpy(particle->x, pool->memory + (size_t)((pool->num_memory - swarm->num_particles + m) % dynamic->memory) * dim,
+                   dim * sizeof(float));
+            if (particle->v != NULL)
+                memset(particle->v, 0, dim * sizeof(float));
+            particle->fitness = INFINITY;
+        } else if (dynamic->rediversify > 0) {
+            particle_seed = pso_hash(pool->change_key + pso_hash(m));
+            if (uniform_omp(0, 1, &particle_seed) < dynamic->rediversify) {
+                for (k = 0; k < dim; k++)
+                    particle->x[k] = uniform_omp(param->xmin, param->xmax, &particle_seed);
+                for (k = 0; particle->v != NULL && k < dim; k++)
+                    particle->v[k] = uniform_omp(-param->vmax, param->vmax, &particle_seed);
+                particle->fitness = INFINITY;
+            }
+        }
+    }
+}
+
+/* After the iteration: count the re-evaluations of the pbests in swarm */
+void pso_dynamic_end(pso_dynamic_pool_t *pool, swarm_t *swarm)
+{
+    if (!pool->changed)
+        return;
+    swarm->num_evals += swarm->num_particles;
+    pool->dynamic->reevals += swarm->num_particles;
+}
@@ -0,0 +1,316 @@
+/* Elite archive for the OpenMP engine: the k best distinct solutions found so
+ * far, updated every iteration.
+ *
+ * The candidates of an iteration are the particles whose pbest changed (all
+ * of them in the first iteration). While evaluating its blocks each thread
+ * keeps its k best candidates: in a max-heap of k entries when k is at most
+ * PSO_ELITE_HEAP, so most candidates are rejected with one comparison, and
+ * otherwise by appending them to its stretch of a per-particle array and
+ * cutting that down to the k best with a quickselect once its blocks are
+ * done. Either way a thread's work is linear in its particles.
+ *
+ * At the reduction the threads' survivors that beat the archive's last
+ * member (any, while it has room) are cut down to the k best by another
+ * quickselect and sorted, and each is then merged, best first, into the
+ * archive. A candidate with an archive member at least as good within the
+ * radius is a duplicate; otherwise it evicts the members within the radius,
+ * which are worse, and the archive is cut back to k members at the end. The
+ * members live in a uniform hash grid (see pso_niche.c), so each candidate
+ * costs one radius query and the archive is never rebuilt. This is the greedy
+ * best first pass over the archive and the candidates, so the result is the
+ * same as taking them all at once. Only the k best candidates of an iteration
+ * compete, so a cluster of near duplicates can crowd out distinct points
+ * further down its ranking, and evicted members are gone for good.
+ *
+ * Candidates are ranked by fitness and then particle index, and members
+ * ahead of candidates of equal fitness, so the archive does not depend on
+ * the thread count.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pso.h"
+
+#define PSO_ELITE_HEAP 64   /* Largest k kept in per-thread heaps */
+
+typedef struct pso_elite_cand_s {
+    float fitness;
+    int index;              /* Particle whose pbest is the candidate */
+} pso_elite_cand_t;
+
+/* Candidates of one thread, padded so threads do not share cache lines */
+typedef struct pso_elite_thread_s {
+    pso_elite_cand_t *cand; /* Heap of k, or stretch of the per-particle array */
+    int count;
+    char pad[52];
+} pso_elite_thread_t;
+
+struct pso_elite_pool_s {
+    int k;
+    int heap;               /* Per-thread heaps rather than selection */
+    pso_elite_cand_t *cand; /* k per thread, or one per particle */
+    pso_elite_thread_t *thread;
+    pso_elite_cand_t *merged;   /* Survivors of all threads */
+    float *fitness;         /* Members by slot: k, and up to k more during a merge */
+    float *x;
+    int *alive;             /* 1 for members, 2 for members added by this merge */
+    int *free_slot, num_free;
+    int *rank, *rank_tmp;   /* Slots of the members, best first */
+    int num_ranked;
+    int *fresh;             /* Slots of the members added by a merge, best first */
+    int *near;              /* Members within the radius of a candidate */
+    pso_grid_t *grid;       /* Members by position */
+};
+
+/* Whether candidate a ranks before b */
+static int pso_elite_before(const pso_elite_cand_t *a, const pso_elite_cand_t *b)
+{
+    return a->fitness < b->fitness || (a->fitness == b->fitness && a->index < b->index);
+}
+
+static int pso_elite_compare(const void *a, const void *b)
+{
+    return pso_elite_before((const pso_elite_cand_t *)a, (const pso_elite_cand_t *)b) ? -1
+           : pso_elite_before((const pso_elite_cand_t *)b, (const pso_elite_cand_t *)a);
+}
+
+/* Reorder the n candidates of c so the k best come first, in any order */
+static void pso_elite_select(pso_elite_cand_t *c, int n, int k)
+{
+    int lo = 0, hi = n - 1, i, j;
+    pso_elite_cand_t pivot, tmp;
+
+    while (lo < hi) {
+        pivot = c[lo + (hi - lo) / 2];
+        i = lo;
+        j = hi;
+        while (i <= j) {
+            while (pso_elite_before(&c[i], &pivot))
+                i++;
+            while (pso_elite_before(&pivot, &c[j]))
+                j--;
+            if (i <= j) {
+                tmp = c[i]; c[i] = c[j]; c[j] = tmp;
+                i++;
+                j--;
+            }
+        }
+        /* c[lo..j] rank before c[i..hi], with the pivot's equals in between */
+        if (k <= j)
+            hi = j;
+        else if (k >= i)
+            lo = i;
+        else
+            break;
+    }
+}
+
+/* Pool for an archive of k members at least radius apart, with grid cells
+ * starting at origin, over swarms of up to num_particles particles of
+ * dimension dim on up to max_threads threads. Return NULL on allocation
+ * failure */
+pso_elite_pool_t *pso_elite_pool_create(int k, float radius, float origin, int num_particles, int dim,
+                                        int max_threads)
+{
+    pso_elite_pool_t *pool = (pso_elite_pool_t *)calloc(1, sizeof(pso_elite_pool_t));
+    int s;
+
+    if (pool == NULL)
+        return NULL;
+    pool->k = k;
+    pool->heap = (k <= PSO_ELITE_HEAP);
+    pool->cand = (pso_elite_cand_t *)malloc((pool->heap ? (size_t)max_threads * k : (size_t)num_particles)
+                                            * sizeof(pso_elite_cand_t));
+    pool->thread = (pso_elite_thread_t *)malloc(max_threads * sizeof(pso_elite_thread_t));
+    pool->merged = (pso_elite_cand_t *)malloc((size_t)max_threads * k * sizeof(pso_elite_cand_t));
+    pool->fitness = (float *)malloc(2 * k * sizeof(float));
+    pool->x = (float *)malloc((size_t)2 * k * dim * sizeof(float));
+    pool->alive = (int *)calloc(2 * k, sizeof(int));
+    pool->free_slot = (int *)malloc(2 * k * sizeof(int));
+    pool->rank = (int *)malloc(k * sizeof(int));
+    pool->rank_tmp = (int *)malloc(2 * k * sizeof(int));
+    pool->fresh = (int *)malloc(k * sizeof(int));
+    pool->near = (int *)malloc(2 * k * sizeof(int));
+    pool->grid = pso_grid_create(2 * k, dim);
+    if (pool->cand == NULL || pool->thread == NULL || pool->merged == NULL || pool->fitness == NULL
+        || pool->x == NULL || pool->alive == NULL || pool->free_slot == NULL || pool->rank == NULL
+        || pool->rank_tmp == NULL || pool->fresh == NULL || pool->near == NULL || pool->grid == NULL) {
+        pso_elite_pool_destroy(pool);
+        return NULL;
+    }
+    pso_grid_clear(pool->grid, dim, origin, radius);
+    for (s = 0; s < 2 * k; s++)
+        pool->free_slot[s] = 2 * k - 1 - s;
+    pool->num_free = 2 * k;
+    return pool;
+}
+
+void pso_elite_pool_destroy(pso_elite_pool_t *pool)
+{
+    if (pool == NULL)
+        return;
+    free((void *)pool->cand);
+    free((void *)pool->thread);
+    free((void *)pool->merged);
+    free((void *)pool->fitness);
+    free((void *)pool->x);
+    free((void *)pool->alive);
+    free((void *)pool->free_slot);
+    free((void *)pool->rank);
+    free((void *)pool->rank_tmp);
+    free((void *)pool->fresh);
+    free((void *)pool->near);
+    pso_grid_destroy(pool->grid);
+    free((void *)pool);
+}
+
+/* Start thread tid's candidates of an iteration */
+void pso_elite_begin(pso_elite_pool_t *pool, int tid)
+{
+    pool->thread[tid].cand = pool->heap ? pool->cand + (size_t)tid * pool->k : NULL;
+    pool->thread[tid].count = 0;
+}
+
+/* Offer the pbest of particle i, of the given fitness, as a candidate of
+ * thread tid. A thread offers its particles in increasing order */
+void pso_elite_offer(pso_elite_pool_t *pool, int tid, float fitness, int i)
+{
+    pso_elite_thread_t *thread = &pool->thread[tid];
+    pso_elite_cand_t cand = { fitness, i }, *heap = thread->cand;
+    int k = pool->k, p, c;
+
+    if (!pool->heap) {
+        /* The thread's candidates start at its first one, so they fit in
+         * the particles it owns */
+        if (thread->cand == NULL)
+            thread->cand = pool->cand + i;
+        thread->cand[thread->count++] = cand;
+        return;
+    }
+    if (thread->count < k) {
+        /* Sift up */
+        for (c = thread->count++; c > 0 && pso_elite_before(&heap[(c - 1) / 2], &cand); c = p) {
+            p = (c - 1) / 2;
+            heap[c] = heap[p];
+        }
+        heap[c] = cand;
+        return;
+    }
+    if (!pso_elite_before(&cand, &heap[0]))
+        return;
+    /* Replace the worst and sift down */
+    for (p = 0; (c = 2 * p + 1) < k; p = c) {
+        if (c + 1 < k && pso_elite_before(&heap[c], &heap[c + 1]))
+            c++;
+        if (!pso_elite_before(&cand, &heap[c]))
+            break;
+        heap[p] = heap[c];
+    }
+    heap[p] = cand;
+}
+
+/* Finish thread tid's candidates of an iteration: keep its k best */
+void pso_elite_end(pso_elite_pool_t *pool, int tid)
+{
+    pso_elite_thread_t *thread = &pool->thread[tid];
+
+    if (!pool->heap && thread->count > pool->k) {
+        pso_elite_select(thread->cand, thread->count, pool->k);
+        thread->count = pool->k;
+    }
+}
+
+/* Remove the member in slot */
+static void pso_elite_evict(pso_elite_pool_t *pool, int slot)
+{
+    pso_grid_remove(pool->grid, slot);
+    pool->alive[slot] = 0;
+    pool->free_slot[pool->num_free++] = slot;
+}
+
+/* Merge the candidates of the first num_threads threads into the archive and
+ * copy it to elite. Called by one thread after the others have finished
+ * their candidates */
+void pso_elite_merge(pso_elite_pool_t *pool, int num_threads, swarm_t *swarm, pso_elite_t *elite)
+{
+    int dim = swarm->dim, k = pool->k, n = 0, t, i, j, m, slot, dup;
+    int num_old = pool->num_ranked, num_fresh = 0, old = 0, ahead = 0;
+    const float *x;
+    float fitness;
+    pso_elite_cand_t *cand;
+
+    /* Once the archive is full only candidates better than its last member
+     * can change it */
+    for (t = 0; t < num_threads; t++) {
+        cand = pool->thread[t].cand;
+        for (i = 0; i < pool->thread[t].count; i++)
+            if (num_old < k || cand[i].fitness < pool->fitness[pool->rank[num_old - 1]])
+                pool->merged[n++] = cand[i];
+    }
+    if (n == 0)
+        return;
+    if (n > k) {
+        pso_elite_select(pool->merged, n, k);
+        n = k;
+    }
+    qsort(pool->merged, n, sizeof(pso_elite_cand_t), pso_elite_compare);
+
+    /* A candidate only evicts worse members, so the members ahead of one
+     * stay, and the archive may hold more than k until it is cut at the end */
+    for (i = 0; i < n; i++) {
+        fitness = pool->merged[i].fitness;
+        x = swarm->pbest + (size_t)pool->merged[i].index * dim;
+
+        for (; old < num_old && pool->fitness[pool->rank[old]] <= fitness; old++)
+            ahead += (pool->alive[pool->rank[old]] == 1);
+        if (ahead + num_fresh >= k)
+            break;
+        m = pso_grid_within(pool->grid, x, dim, pool->near);
+        for (j = 0, dup = 0; j < m && !dup; j++)
+            dup = (pool->fitness[pool->near[j]] <= fitness);
+        if (dup)
+            continue;
+        for (j = 0; j < m; j++)
+            pso_elite_evict(pool, pool->near[j]);
+        slot = pool->free_slot[--pool->num_free];
+        pool->alive[slot] = 2;
+        pool->fitness[slot] = fitness;
+        memcpy(pool->x + (size_t)slot * dim, x, dim * sizeof(float));
+        pso_grid_insert(pool->grid, slot, x, dim);
+        pool->fresh[num_fresh++] = slot;
+    }
+    if (num_fresh == 0)
+        return;
+
+    /* Merge the surviving members with the added ones, members first on
+     * ties, and keep the k best. The slot of an evicted member may hold an
+     * added one by now */
+    for (i = 0, j = 0, m = 0; i < num_old || j < num_fresh;) {
+        if (i < num_old && pool->alive[pool->rank[i]] != 1)
+            i++;
+        else if (i < num_old && (j == num_fresh || pool->fitness[pool->rank[i]] <= pool->fitness[pool->fresh[j]]))
+            pool->rank_tmp[m++] = pool->rank[i++];
+        else
+            pool->rank_tmp[m++] = pool->fresh[j++];
+    }
+    for (j = 0; j < num_fresh; j++)
+        pool->alive[pool->fresh[j]] = 1;
+    for (i = k; i < m; i++)
+        pso_elite_evict(pool, pool->rank_tmp[i]);
+    pool->num_ranked = m < k ? m : k;
+    memcpy(pool->rank, pool->rank_tmp, pool->num_ranked * sizeof(int));
+
+    elite->count = pool->num_ranked;
+    for (i = 0; i < elite->count; i++) {
+        elite->fitness[i] = pool->fitness[pool->rank[i]];
+        memcpy(elite->x + (size_t)i * dim, pool->x + (size_t)pool->rank[i] * dim, dim * sizeof(float));
+    }
+}
+
+/* Archive radius of config: config->elite_radius, or a thousandth of the
+ * domain */
+float pso_elite_radius(pso_config_t *config)
+{
+    return (config->elite_radius > 0) ? config->elite_radius : 0.001f * (config->xmax - config->xmin);
+}
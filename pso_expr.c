@@ -0,0 +1,905 @@
+/* Objectives given as expressions.
+ *
+ * --expr EXPR defines the objective "expr" over the coordinates x[0] ..
+ * x[D-1]. An expression has the arithmetic operators + - * / and ^ (power),
+ * the constants pi, e and D, the functions sin, cos, tan, exp, log, sqrt,
+ * abs, floor, min and max, and the reductions sum(body) and prod(body),
+ * which run the index i over 0 .. D-1, or sum(lo, hi, body) over lo .. hi-1.
+ * In a body, x[i], x[i+1] and the like are the coordinates around i;
+ * reductions do not nest. For example
+ *
+ *   sphere      sum(x[i]^2)
+ *   rosenbrock  sum(0, D-1, 100*(x[i+1]-x[i]^2)^2 + (1-x[i])^2)
+ *   griewank    1 + sum(x[i]^2)/4000 - prod(cos(x[i]/sqrt(i+1)))
+ *
+ * The expression is parsed once D is known, so the bounds of the
+ * reductions and every index are checked before the run, and evaluated by
+ * one of two means:
+ *
+ * - a bytecode interpreter (pso_expr_interpret) running a stack program
+ *   whose instructions each process a block of up to PSO_BLOCK particles,
+ *   so dispatch is paid once per block rather than once per particle;
+ * - with --compile, a C module specialized for the expression and D
+ *   (expr_codegen), built with the system compiler ($CC, default cc) at -O3
+ *   -march=native and loaded with dlopen. Modules are cached under the hash
+ *   of their source, compiler command and CPU model in --expr-cache DIR,
+ *   $PSO_CACHE, $XDG_CACHE_HOME/pso or ~/.cache/pso, so only the first run
+ *   of an expression and dimension on a machine waits for the compiler. The
+ *   cache and its modules must belong to the user and be writable by nobody
+ *   else; with no cache location the module is built in a private temporary
+ *   directory and not kept. Without a compiler, or if the build fails, the
+ *   expression is interpreted.
+ *
+ * Both evaluate in single precision, operation for operation in the same
+ * order. The module is built without contraction into fused multiply-adds
+ * and without folding of the transcendental functions at compile time, so
+ * it returns the interpreter's fitness bit for bit and a run gives the same
+ * result either way.
+ *
+ * One expression is loaded per process; pso_find_objective returns its
+ * registry entry once pso_expr_load has succeeded.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <dlfcn.h>
+#include <unistd.h>
+#include <omp.h>
+#include <sys/stat.h>
+#include "pso.h"
+
+#define EXPR_MAX_NODES 1024     /* Nodes of the expression tree */
+#define EXPR_MAX_STACK 32       /* Operand stack depth of the interpreter */
+#define EXPR_MAX_REDUCTIONS 64  /* Accumulators of the compiled module */
+#define EXPR_MODULE_BLOCK 16    /* Particles per block of the compiled module */
+#define EXPR_MAX_TRANSPOSE (32 * 1024)    /* Bytes of the transposed block of the compiled module */
+
+/* Flags of the compiled modules: no fused multiply-adds and no compile-time
+ * evaluation of the functions whose library results may differ from the
+ * compiler's, so the module matches the interpreter */
+#define EXPR_CFLAGS "-std=c99 -O3 -march=native -ffp-contract=off -fno-math-errno -fno-builtin-sinf " \
+                    "-fno-builtin-cosf -fno-builtin-tanf -fno-builtin-expf -fno-builtin-logf -fno-builtin-powf " \
+                    "-shared -fPIC"
+
+/* Operations of the expression tree, also the instructions of the bytecode */
+enum {
+    EXPR_CONST,         /* value */
+    EXPR_X,             /* Coordinate index */
+    EXPR_XI,            /* Coordinate i + index */
+    EXPR_I,             /* Index of the reduction */
+    EXPR_NEG, EXPR_SQUARE, EXPR_SIN, EXPR_COS, EXPR_TAN, EXPR_EXP, EXPR_LOG, EXPR_SQRT, EXPR_ABS, EXPR_FLOOR,
+    EXPR_ADD, EXPR_SUB, EXPR_MUL, EXPR_DIV, EXPR_POW, EXPR_MIN, EXPR_MAX,
+    EXPR_SUM, EXPR_PROD,
+    EXPR_LOOP           /* Bytecode only: start of the reduction ending at end */
+};
+
+/* Node of the expression tree */
+typedef struct expr_node_s {
+    int op;
+    float value;        /* Constant */
+    int index;          /* Coordinate of EXPR_X, offset from i of EXPR_XI */
+    int lo, hi;         /* Range of i of a reduction */
+    int arg[2];         /* Operands */
+} expr_node_t;
+
+/* Instruction of the interpreter. A reduction is EXPR_LOOP, which pushes
+ * the accumulator and sets i to lo, then its body, then EXPR_SUM or
+ * EXPR_PROD, which folds the body's value into the accumulator and jumps
+ * back to the body until i reaches hi */
+typedef struct expr_op_s {
+    int op;
+    float value;        /* Constant, identity of a reduction */
+    int index;          /* As in expr_node_t */
+    int lo, hi;         /* Range of i of EXPR_LOOP */
+    int jump;           /* EXPR_LOOP: its end; EXPR_SUM, EXPR_PROD: their EXPR_LOOP */
+} expr_op_t;
+
+typedef struct expr_parser_s {
+    const char *text, *pos;
+    int dim;
+    expr_node_t *node;
+    int num_nodes;
+    int in_reduction;   /* Parsing the arguments of a reduction */
+    int num_reductions;
+    int nesting;        /* Recursion depth of the parser */
+    int min_offset, max_offset; /* Offsets from i of the body so far */
+    char error[128];
+} expr_parser_t;
+
+typedef void (*expr_batch_t)(const float *, int, int, float *);
+
+/* Functions by name; reductions take one or three arguments */
+static const struct {
+    const char *name;
+    int op;
+    int arity;
+} expr_functions[] = {
+    { "sin", EXPR_SIN, 1 }, { "cos", EXPR_COS, 1 }, { "tan", EXPR_TAN, 1 }, { "exp", EXPR_EXP, 1 },
+    { "log", EXPR_LOG, 1 }, { "sqrt", EXPR_SQRT, 1 }, { "abs", EXPR_ABS, 1 }, { "floor", EXPR_FLOOR, 1 },
+    { "min", EXPR_MIN, 2 }, { "max", EXPR_MAX, 2 }, { "sum", EXPR_SUM, 0 }, { "prod", EXPR_PROD, 0 },
+    { NULL, 0, 0 }
+};
+
+/* C of the unary and binary operations in the generated module */
+static const char *const expr_c[] = {
+    [EXPR_NEG] = "-", [EXPR_SQUARE] = "sq", [EXPR_SIN] = "sinf", [EXPR_COS] = "cosf", [EXPR_TAN] = "tanf",
+    [EXPR_EXP] = "expf", [EXPR_LOG] = "logf", [EXPR_SQRT] = "sqrtf", [EXPR_ABS] = "fabsf",
+    [EXPR_FLOOR] = "floorf", [EXPR_ADD] = "+", [EXPR_SUB] = "-", [EXPR_MUL] = "*", [EXPR_DIV] = "/",
+    [EXPR_POW] = "powf", [EXPR_MIN] = "mn", [EXPR_MAX] = "mx"
+};
+
+/* The loaded expression */
+static expr_op_t *expr_code;
+static int expr_num_ops;
+static void *expr_module;       /* dlopen handle of the compiled module, NULL if interpreted */
+
+static float expr_eval_particle(particle_t *);
+
+static pso_objective_t expr_objective = {
+    PSO_EXPR_NAME, expr_eval_particle, 0, 1, -10.0, 10.0, NAN, pso_expr_interpret
+};
+
+/* Registry entry of the loaded expression, NULL before pso_expr_load */
+const pso_objective_t *pso_expr_objective = NULL;
+
+static int expr_fail(expr_parser_t *parser, const char *message)
+{
+    if (parser->error[0] == '\0')
+        snprintf(parser->error, sizeof(parser->error), "%s at column %d", message,
+                 (int)(parser->pos - parser->text) + 1);
+    return -1;
+}
+
+static void expr_skip(expr_parser_t *parser)
+{
+    while (isspace((unsigned char)*parser->pos))
+        parser->pos++;
+}
+
+/* Consume c if it is the next character. Return whether it was */
+static int expr_accept(expr_parser_t *parser, char c)
+{
+    expr_skip(parser);
+    if (*parser->pos != c)
+        return 0;
+    parser->pos++;
+    return 1;
+}
+
+/* Append a node. Return its index, -1 if the tree is full */
+static int expr_add(expr_parser_t *parser, int op, int a, int b)
+{
+    expr_node_t *node;
+
+    if (parser->num_nodes == EXPR_MAX_NODES)
+        return expr_fail(parser, "expression too long");
+    node = &parser->node[parser->num_nodes];
+    memset(node, 0, sizeof(expr_node_t));
+    node->op = op;
+    node->arg[0] = a;
+    node->arg[1] = b;
+    return parser->num_nodes++;
+}
+
+/* Value of a subtree without coordinates or i, in double precision. Return
+ * 0 on success, -1 if it is not constant */
+static int expr_constant(expr_parser_t *parser, int n, double *value)
+{
+    const expr_node_t *node = &parser->node[n];
+    double a = 0.0, b = 0.0;
+
+    if (node->op == EXPR_CONST) {
+        *value = node->value;
+        return 0;
+    }
+    if (node->op < EXPR_NEG || node->op > EXPR_MAX || expr_constant(parser, node->arg[0], &a) < 0
+        || (node->op >= EXPR_ADD && expr_constant(parser, node->arg[1], &b) < 0))
+        return -1;
+    switch (node->op) {
+    case EXPR_NEG: *value = -a; break;
+    case EXPR_SQUARE: *value = a * a; break;
+    case EXPR_SIN: *value = sin(a); break;
+    case EXPR_COS: *value = cos(a); break;
+    case EXPR_TAN: *value = tan(a); break;
+    case EXPR_EXP: *value = exp(a); break;
+    case EXPR_LOG: *value = log(a); break;
+    case EXPR_SQRT: *value = sqrt(a); break;
+    case EXPR_ABS: *value = fabs(a); break;
+    case EXPR_FLOOR: *value = floor(a); break;
+    case EXPR_ADD: *value = a + b; break;
+    case EXPR_SUB: *value = a - b; break;
+    case EXPR_MUL: *value = a * b; break;
+    case EXPR_DIV: *value = a / b; break;
+    case EXPR_POW: *value = pow(a, b); break;
+    case EXPR_MIN: *value = (a < b) ? a : b; break;
+    default: *value = (a > b) ? a : b; break;
+    }
+    return 0;
+}
+
+/* Integer value of a constant subtree. Return 0 on success, -1 otherwise */
+static int expr_integer(expr_parser_t *parser, int n, int *value)
+{
+    double v;
+
+    if (expr_constant(parser, n, &v) < 0 || v != floor(v) || fabs(v) > 1e9)
+        return -1;
+    *value = (int)v;
+    return 0;
+}
+
+static int expr_sum(expr_parser_t *);
+static int expr_unary(expr_parser_t *);
+
+/* Coordinate x[index]: a constant index, or i plus a constant in a reduction */
+static int expr_coordinate(expr_parser_t *parser)
+{
+    int index, n, offset;
+    const expr_node_t *node;
+
+    if (!expr_accept(parser, '['))
+        return expr_fail(parser, "expected [ after x");
+    if ((index = expr_sum(parser)) < 0)
+        return -1;
+    if (!expr_accept(parser, ']'))
+        return expr_fail(parser, "expected ]");
+    if (expr_integer(parser, index, &offset) == 0) {
+        if (offset < 0 || offset >= parser->dim)
+            return expr_fail(parser, "coordinate outside 0 .. D-1");
+        if ((n = expr_add(parser, EXPR_X, -1, -1)) >= 0)
+            parser->node[n].index = offset;
+        return n;
+    }
+    node = &parser->node[index];
+    if (node->op == EXPR_I)
+        offset = 0;
+    else if (node->op == EXPR_ADD && parser->node[node->arg[0]].op == EXPR_I
+             && expr_integer(parser, node->arg[1], &offset) == 0)
+        ;
+    else if (node->op == EXPR_ADD && parser->node[node->arg[1]].op == EXPR_I
+             && expr_integer(parser, node->arg[0], &offset) == 0)
+        ;
+    else if (node->op == EXPR_SUB && parser->node[node->arg[0]].op == EXPR_I
+             && expr_integer(parser, node->arg[1], &offset) == 0)
+        offset = -offset;
+    else
+        return expr_fail(parser, "index must be an integer or i plus an integer");
+    if ((n = expr_add(parser, EXPR_XI, -1, -1)) < 0)
+        return -1;
+    parser->node[n].index = offset;
+    parser->min_offset = (offset < parser->min_offset) ? offset : parser->min_offset;
+    parser->max_offset = (offset > parser->max_offset) ? offset : parser->max_offset;
+    return n;
+}
+
+/* sum(body), sum(lo, hi, body) and the same for prod */
+static int expr_reduction(expr_parser_t *parser, int op)
+{
+    int arg[3], num_args = 0, n, lo = 0, hi = parser->dim;
+
+    if (parser->in_reduction)
+        return expr_fail(parser, "reductions do not nest");
+    if (++parser->num_reductions > EXPR_MAX_REDUCTIONS)
+        return expr_fail(parser, "too many reductions");
+    parser->in_reduction = 1;
+    parser->min_offset = parser->max_offset = 0;
+    do {
+        if (num_args == 3)
+            return expr_fail(parser, "sum and prod take one or three arguments");
+        if (num_args == 2)
+            parser->min_offset = parser->max_offset = 0;
+        if ((arg[num_args++] = expr_sum(parser)) < 0)
+            return -1;
+    } while (expr_accept(parser, ','));
+    if (!expr_accept(parser, ')'))
+        return expr_fail(parser, "expected )");
+    if (num_args == 2)
+        return expr_fail(parser, "sum and prod take one or three arguments");
+    if (num_args == 3 && (expr_integer(parser, arg[0], &lo) < 0 || expr_integer(parser, arg[1], &hi) < 0))
+        return expr_fail(parser, "bounds of a reduction must be integers");
+    if (lo < hi && (lo + parser->min_offset < 0 || hi - 1 + parser->max_offset >= parser->dim))
+        return expr_fail(parser, "coordinate outside 0 .. D-1 in the range of i");
+    parser->in_reduction = 0;
+    if ((n = expr_add(parser, op, arg[num_args - 1], -1)) >= 0) {
+        parser->node[n].lo = lo;
+        parser->node[n].hi = hi;
+    }
+    return n;
+}
+
+/* Number, constant, coordinate, call or parenthesized expression */
+static int expr_primary(expr_parser_t *parser)
+{
+    char name[16], *end;
+    double value;
+    int len = 0, n, a, b = -1, f;
+
+    expr_skip(parser);
+    if (isdigit((unsigned char)*parser->pos) || *parser->pos == '.') {
+        value = strtod(parser->pos, &end);
+        if (end == parser->pos)
+            return expr_fail(parser, "bad number");
+        parser->pos = end;
+        if ((n = expr_add(parser, EXPR_CONST, -1, -1)) >= 0)
+            parser->node[n].value = (float)value;
+        return n;
+    }
+    if (expr_accept(parser, '(')) {
+        n = expr_sum(parser);
+        if (n >= 0 && !expr_accept(parser, ')'))
+            return expr_fail(parser, "expected )");
+        return n;
+    }
+    while (isalnum((unsigned char)parser->pos[len]) || parser->pos[len] == '_')
+        len++;
+    if (len == 0 || len >= (int)sizeof(name))
+        return expr_fail(parser, "expected a number, name or (");
+    memcpy(name, parser->pos, len);
+    name[len] = '\0';
+    parser->pos += len;
+
+    if (strcmp(name, "x") == 0)
+        return expr_coordinate(parser);
+    if (strcmp(name, "i") == 0) {
+        if (!parser->in_reduction)
+            return expr_fail(parser, "i outside sum or prod");
+        return expr_add(parser, EXPR_I, -1, -1);
+    }
+    if (strcmp(name, "pi") == 0 || strcmp(name, "e") == 0 || strcmp(name, "D") == 0) {
+        if ((n = expr_add(parser, EXPR_CONST, -1, -1)) >= 0)
+            parser->node[n].value = (name[0] == 'p') ? (float)M_PI : (name[0] == 'e') ? (float)M_E : parser->dim;
+        return n;
+    }
+    for (f = 0; expr_functions[f].name != NULL; f++)
+        if (strcmp(name, expr_functions[f].name) == 0)
+            break;
+    if (expr_functions[f].name == NULL)
+        return expr_fail(parser, "unknown name");
+    if (!expr_accept(parser, '('))
+        return expr_fail(parser, "expected ( after function name");
+    if (expr_functions[f].arity == 0)
+        return expr_reduction(parser, expr_functions[f].op);
+    if ((a = expr_sum(parser)) < 0)
+        return -1;
+    if (expr_functions[f].arity == 2 && (!expr_accept(parser, ',') || (b = expr_sum(parser)) < 0))
+        return expr_fail(parser, "expected two arguments");
+    if (!expr_accept(parser, ')'))
+        return expr_fail(parser, "expected )");
+    return expr_add(parser, expr_functions[f].op, a, b);
+}
+
+/* primary ^ unary, right associative; squares are multiplications */
+static int expr_power(expr_parser_t *parser)
+{
+    int a, b;
+    double exponent;
+
+    if ((a = expr_primary(parser)) < 0 || !expr_accept(parser, '^'))
+        return a;
+    if ((b = expr_unary(parser)) < 0)
+        return -1;
+    if (expr_constant(parser, b, &exponent) == 0 && exponent == 2.0)
+        return expr_add(parser, EXPR_SQUARE, a, -1);
+    return expr_add(parser, EXPR_POW, a, b);
+}
+
+static int expr_unary(expr_parser_t *parser)
+{
+    int a;
+
+    if (++parser->nesting > EXPR_MAX_NODES)
+        return expr_fail(parser, "expression nested too deeply");
+    if (expr_accept(parser, '-')) {
+        if ((a = expr_unary(parser)) >= 0)
+            a = expr_add(parser, EXPR_NEG, a, -1);
+    } else if (expr_accept(parser, '+'))
+        a = expr_unary(parser);
+    else
+        a = expr_power(parser);
+    parser->nesting--;
+    return a;
+}
+
+static int expr_product(expr_parser_t *parser)
+{
+    int a, b, op;
+
+    if ((a = expr_unary(parser)) < 0)
+        return -1;
+    for (;;) {
+        if (expr_accept(parser, '*'))
+            op = EXPR_MUL;
+        else if (expr_accept(parser, '/'))
+            op = EXPR_DIV;
+        else
+            return a;
+        if ((b = expr_unary(parser)) < 0 || (a = expr_add(parser, op, a, b)) < 0)
+            return -1;
+    }
+}
+
+static int expr_sum(expr_parser_t *parser)
+{
+    int a, b, op;
+
+    if ((a = expr_product(parser)) < 0)
+        return -1;
+    for (;;) {
+        if (expr_accept(parser, '+'))
+            op = EXPR_ADD;
+        else if (expr_accept(parser, '-'))
+            op = EXPR_SUB;
+        else
+            return a;
+        if ((b = expr_product(parser)) < 0 || (a = expr_add(parser, op, a, b)) < 0)
+            return -1;
+    }
+}
+
+/* Append the bytecode of subtree n to code, tracking the stack depth.
+ * Return 0 on success, -1 if the stack would overflow */
+static int expr_emit(const expr_node_t *tree, int n, expr_op_t *code, int *num_ops, int *depth)
+{
+    const expr_node_t *node = &tree[n];
+    expr_op_t *op;
+    int loop;
+
+    if (node->op == EXPR_SUM || node->op == EXPR_PROD) {
+        loop = (*num_ops)++;
+        code[loop].op = EXPR_LOOP;
+        code[loop].value = (node->op == EXPR_SUM) ? 0.0f : 1.0f;
+        code[loop].lo = node->lo;
+        code[loop].hi = node->hi;
+        if (++*depth > EXPR_MAX_STACK || expr_emit(tree, node->arg[0], code, num_ops, depth) < 0)
+            return -1;
+        code[loop].jump = *num_ops;
+        op = &code[(*num_ops)++];
+        op->op = node->op;
+        op->jump = loop;
+        --*depth;
+        return 0;
+    }
+    if (node->op >= EXPR_NEG && expr_emit(tree, node->arg[0], code, num_ops, depth) < 0)
+        return -1;
+    if (node->op >= EXPR_ADD && expr_emit(tree, node->arg[1], code, num_ops, depth) < 0)
+        return -1;
+    op = &code[(*num_ops)++];
+    op->op = node->op;
+    op->value = node->value;
+    op->index = node->index;
+    if (node->op < EXPR_NEG)
+        ++*depth;
+    else if (node->op >= EXPR_ADD)
+        --*depth;
+    return (*depth > EXPR_MAX_STACK) ? -1 : 0;
+}
+
+/* Run the loaded program on the m <= PSO_BLOCK rows of x into fitness */
+static void expr_run(const float *x, int m, int dim, float *fitness)
+{
+    float stack[EXPR_MAX_STACK][PSO_BLOCK];
+    float *a, *b;
+    const expr_op_t *op;
+    int pc, sp = 0, i = 0, p;
+
+    for (pc = 0; pc < expr_num_ops; pc++) {
+        op = &expr_code[pc];
+        a = stack[(sp > 0) ? sp - 1 : 0];       /* Top, the only operand of unary operations */
+        b = stack[(sp > 1) ? sp - 2 : 0];       /* Left operand of binary operations */
+        switch (op->op) {
+        case EXPR_CONST:
+            for (p = 0; p < m; p++) stack[sp][p] = op->value;
+            sp++;
+            break;
+        case EXPR_X:
+            for (p = 0; p < m; p++) stack[sp][p] = x[(size_t)p * dim + op->index];
+            sp++;
+            break;
+        case EXPR_XI:
+            for (p = 0; p < m; p++) stack[sp][p] = x[(size_t)p * dim + i + op->index];
+            sp++;
+            break;
+        case EXPR_I:
+            for (p = 0; p < m; p++) stack[sp][p] = (float)i;
+            sp++;
+            break;
+        case EXPR_LOOP:
+            for (p = 0; p < m; p++) stack[sp][p] = op->value;
+            sp++;
+            i = op->lo;
+            if (i >= op->hi)
+                pc = op->jump;
+            break;
+        case EXPR_NEG: for (p = 0; p < m; p++) a[p] = -a[p]; break;
+        case EXPR_SQUARE: for (p = 0; p < m; p++) a[p] = a[p] * a[p]; break;
+        case EXPR_SIN: for (p = 0; p < m; p++) a[p] = sinf(a[p]); break;
+        case EXPR_COS: for (p = 0; p < m; p++) a[p] = cosf(a[p]); break;
+        case EXPR_TAN: for (p = 0; p < m; p++) a[p] = tanf(a[p]); break;
+        case EXPR_EXP: for (p = 0; p < m; p++) a[p] = expf(a[p]); break;
+        case EXPR_LOG: for (p = 0; p < m; p++) a[p] = logf(a[p]); break;
+        case EXPR_SQRT: for (p = 0; p < m; p++) a[p] = sqrtf(a[p]); break;
+        case EXPR_ABS: for (p = 0; p < m; p++) a[p] = fabsf(a[p]); break;
+        case EXPR_FLOOR: for (p = 0; p < m; p++) a[p] = floorf(a[p]); break;
+        case EXPR_ADD: for (p = 0; p < m; p++) b[p] = b[p] + a[p]; sp--; break;
+        case EXPR_SUB: for (p = 0; p < m; p++) b[p] = b[p] - a[p]; sp--; break;
+        case EXPR_MUL: for (p = 0; p < m; p++) b[p] = b[p] * a[p]; sp--; break;
+        case EXPR_DIV: for (p = 0; p < m; p++) b[p] = b[p] / a[p]; sp--; break;
+        case EXPR_POW: for (p = 0; p < m; p++) b[p] = powf(b[p], a[p]); sp--; break;
+        case EXPR_MIN: for (p = 0; p < m; p++) b[p] = (b[p] < a[p]) ? b[p] : a[p]; sp--; break;
+        case EXPR_MAX: for (p = 0; p < m; p++) b[p] = (b[p] > a[p]) ? b[p] : a[p]; sp--; break;
+        case EXPR_SUM:
+        case EXPR_PROD:
+            if (op->op == EXPR_SUM)
+                for (p = 0; p < m; p++) b[p] = b[p] + a[p];
+            else
+                for (p = 0; p < m; p++) b[p] = b[p] * a[p];
+            sp--;
+            if (++i < expr_code[op->jump].hi)
+                pc = op->jump;
+            break;
+        }
+    }
+    memcpy(fitness, stack[0], m * sizeof(float));
+}
+
+/* Batch objective of the loaded expression by interpretation */
+void pso_expr_interpret(const float *x, int n, int dim, float *fitness)
+{
+    int i;
+
+    for (i = 0; i < n; i += PSO_BLOCK)
+        expr_run(x + (size_t)i * dim, (n - i < PSO_BLOCK) ? n - i : PSO_BLOCK, dim, fitness + i);
+}
+
+/* Scalar objective of the reference engine */
+static float expr_eval_particle(particle_t *particle)
+{
+    float fitness;
+
+    expr_objective.batch(particle->x, 1, particle->dim, &fitness);
+    return fitness;
+}
+
+/* Write the C of subtree n: its value for particle p, reductions read from
+ * their accumulators r<k>[p] in the order expr_codegen numbered them */
+static void expr_codegen_node(FILE *out, const expr_node_t *tree, int n, int *reduction)
+{
+    const expr_node_t *node = &tree[n];
+
+    switch (node->op) {
+    case EXPR_CONST:
+        if (isinf(node->value))
+            fprintf(out, "__builtin_inff()");
+        else
+            fprintf(out, "%af", (double)node->value);
+        break;
+    case EXPR_X: fprintf(out, "X(%d)", node->index); break;
+    case EXPR_XI: fprintf(out, "X(i + (%d))", node->index); break;
+    case EXPR_I: fprintf(out, "(float)i"); break;
+    case EXPR_SUM:
+    case EXPR_PROD: fprintf(out, "r%d[p]", (*reduction)++); break;
+    case EXPR_NEG:
+        fprintf(out, "(-");
+        expr_codegen_node(out, tree, node->arg[0], reduction);
+        fprintf(out, ")");
+        break;
+    case EXPR_ADD: case EXPR_SUB: case EXPR_MUL: case EXPR_DIV:
+        fprintf(out, "(");
+        expr_codegen_node(out, tree, node->arg[0], reduction);
+        fprintf(out, " %s ", expr_c[node->op]);
+        expr_codegen_node(out, tree, node->arg[1], reduction);
+        fprintf(out, ")");
+        break;
+    default:
+        fprintf(out, "%s(", expr_c[node->op]);
+        expr_codegen_node(out, tree, node->arg[0], reduction);
+        if (node->op >= EXPR_ADD) {
+            fprintf(out, ", ");
+            expr_codegen_node(out, tree, node->arg[1], reduction);
+        }
+        fprintf(out, ")");
+        break;
+    }
+}
+
+/* Collect the reductions of subtree n in the order expr_codegen_node meets them */
+static void expr_reductions(const expr_node_t *tree, int n, int *found, int *num_found)
+{
+    const expr_node_t *node = &tree[n];
+
+    if (node->op == EXPR_SUM || node->op == EXPR_PROD) {
+        found[(*num_found)++] = n;
+        return;
+    }
+    if (node->op >= EXPR_NEG)
+        expr_reductions(tree, node->arg[0], found, num_found);
+    if (node->op >= EXPR_ADD)
+        expr_reductions(tree, node->arg[1], found, num_found);
+}
+
+/* C source of the module for the expression with tree rooted at root.
+ * The particles of a block are the inner loop of every reduction, so the
+ * compiler can vectorize across particles while each particle's terms are
+ * added in the interpreter's order. Unless D is large the block is first
+ * transposed so those loops read consecutive floats. Return the source,
+ * NULL if out of memory */
+static char *expr_codegen(const char *text, int dim, const expr_node_t *tree, int root)
+{
+    int found[EXPR_MAX_REDUCTIONS], num_found = 0, k, reduction = 0;
+    int transpose = ((size_t)dim * EXPR_MODULE_BLOCK * sizeof(float) <= EXPR_MAX_TRANSPOSE);
+    char *source = NULL;
+    size_t size;
+    const char *c;
+    FILE *out;
+
+    expr_reductions(tree, root, found, &num_found);
+    out = open_memstream(&source, &size);
+    if (out == NULL)
+        return NULL;
+    fprintf(out, "/* pso expression module, D = %d:\n * ", dim);
+    for (c = text; *c != '\0'; c++)     /* Keep the comment closed */
+        fputc((c[0] == '*' && c[1] == '/') ? '+' : (*c == '\n') ? ' ' : *c, out);
+    fprintf(out, "\n */\n");
+    fprintf(out, "float sinf(float); float cosf(float); float tanf(float); float expf(float); float logf(float);\n"
+                 "float sqrtf(float); float fabsf(float); float floorf(float); float powf(float, float);\n"
+                 "static inline float sq(float a) { return a * a; }\n"
+                 "static inline float mn(float a, float b) { return (a < b) ? a : b; }\n"
+                 "static inline float mx(float a, float b) { return (a > b) ? a : b; }\n\n"
+                 "#define D %d\n#define B %d\n#define X(k) %s\n\nconst int pso_expr_dim = D;\n\n", dim, EXPR_MODULE_BLOCK,
+                 transpose ? "xt[k][p]" : "x[p * D + (k)]");
+    fprintf(out, "void pso_expr_batch(const float *restrict x, int n, int dim, float *restrict fitness)\n{\n"
+                 "    int p0, m, p, i = 0;\n");
+    if (transpose)
+        fprintf(out, "    float xt[D][B];\n");
+    for (k = 0; k < num_found; k++)
+        fprintf(out, "    float r%d[B];\n", k);
+    fprintf(out, "\n    (void)dim;\n"
+                 "    for (p0 = 0; p0 < n; p0 += B, x += B * D, fitness += B) {\n"
+                 "        m = (n - p0 < B) ? n - p0 : B;\n");
+    if (transpose)
+        fprintf(out, "        for (i = 0; i < D; i++)\n            for (p = 0; p < m; p++)\n"
+                     "                xt[i][p] = x[p * D + i];\n");
+    for (k = 0; k < num_found; k++) {
+        fprintf(out, "        for (p = 0; p < m; p++) {\n            float r = %s;\n\n"
+                     "            for (i = %d; i < %d; i++)\n                r = r %s ",
+                (tree[found[k]].op == EXPR_SUM) ? "0.0f" : "1.0f", tree[found[k]].lo, tree[found[k]].hi,
+                (tree[found[k]].op == EXPR_SUM) ? "+" : "*");
+        expr_codegen_node(out, tree, tree[found[k]].arg[0], &reduction);
+        fprintf(out, ";\n            r%d[p] = r;\n        }\n", k);
+    }
+    reduction = 0;
+    fprintf(out, "        for (p = 0; p < m; p++)\n            fitness[p] = ");
+    expr_codegen_node(out, tree, root, &reduction);
+    fprintf(out, ";\n    }\n}\n");
+    if (fclose(out) != 0) {
+        free(source);
+        return NULL;
+    }
+    return source;
+}
+
+/* FNV-1a hash of text, telling expressions apart in calibration keys and
+ * checkpoints */
+unsigned long long pso_expr_hash(const char *text)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+
+    for (; *text != '\0'; text++)
+        hash = (hash ^ (unsigned char)*text) * 1099511628211ULL;
+    return hash;
+}
+
+/* Nonzero if path is a file or directory of the user that nobody else can
+ * write, so a module in it cannot have been planted */
+static int expr_private(const char *path, int directory)
+{
+    struct stat st;
+
+    return lstat(path, &st) == 0 && (directory ? S_ISDIR(st.st_mode) : S_ISREG(st.st_mode))
+        && st.st_uid == geteuid() && (st.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+/* Create directory path and any missing parents */
+static int expr_mkdirs(char *path)
+{
+    char *slash;
+
+    for (slash = strchr(path + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        mkdir(path, 0700);
+        *slash = '/';
+    }
+    return (mkdir(path, 0700) < 0 && errno != EEXIST) ? -1 : 0;
+}
+
+/* Directory the modules are cached in, created if needed. Return 0 for the
+ * cache, 1 for a private temporary directory to remove after loading when
+ * there is no cache location, -1 if the directory cannot be used */
+static int expr_cache_dir(const char *dir, char *path, size_t size)
+{
+    const char *home;
+    int temporary = 0;
+
+    if (dir == NULL)
+        dir = getenv("PSO_CACHE");
+    if (dir != NULL && dir[0] != '\0')
+        snprintf(path, size, "%s", dir);
+    else if ((home = getenv("XDG_CACHE_HOME")) != NULL && home[0] != '\0')
+        snprintf(path, size, "%s/pso", home);
+    else if ((home = getenv("HOME")) != NULL && home[0] != '\0')
+        snprintf(path, size, "%s/.cache/pso", home);
+    else {
+        /* No cache of the user's own: never share a directory like /tmp */
+        home = getenv("TMPDIR");
+        snprintf(path, size, "%s/pso-expr-XXXXXX", (home != NULL && home[0] != '\0') ? home : "/tmp");
+        if (mkdtemp(path) == NULL)
+            return -1;
+        temporary = 1;
+    }
+    if (!temporary && expr_mkdirs(path) < 0)
+        return -1;
+    if (strchr(path, '\'') != NULL || !expr_private(path, 1))   /* Quoted in the compiler command */
+        return -1;
+    return temporary;
+}
+
+/* Open the module at path. Return its batch objective, NULL on failure */
+static expr_batch_t expr_open(const char *path, int dim)
+{
+    void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    expr_batch_t batch;
+    const int *module_dim;
+
+    if (handle == NULL)
+        return NULL;
+    batch = (expr_batch_t)dlsym(handle, "pso_expr_batch");
+    module_dim = (const int *)dlsym(handle, "pso_expr_dim");
+    if (batch == NULL || module_dim == NULL || *module_dim != dim) {
+        dlclose(handle);
+        return NULL;
+    }
+    expr_module = handle;
+    return batch;
+}
+
+/* Load the module of source from the cache, compiling it on a miss. Return
+ * its batch objective, NULL if it could not be built */
+static expr_batch_t expr_compile(const char *source, int dim, const char *cache)
+{
+    const char *cc = getenv("CC");
+    char dir[256], base[320], path[400], tmp[400], command[1600], model[128];
+    unsigned long long hash = 14695981039346656037ULL;     /* FNV-1a */
+    expr_batch_t batch;
+    const char *c;
+    FILE *file;
+    int status, temporary;
+
+    if (cc == NULL || cc[0] == '\0')
+        cc = "cc";
+    temporary = expr_cache_dir(cache, dir, sizeof(dir));
+    if (temporary < 0) {
+        fprintf(stderr, "Could not use the module cache %s: it must be a directory of yours that only you can "
+                "write\n", dir);
+        return NULL;
+    }
+    /* -march=native modules only run on the CPU they were built for */
+    pso_cpu_model(model, sizeof(model));
+    for (c = source; *c != '\0'; c++)
+        hash = (hash ^ (unsigned char)*c) * 1099511628211ULL;
+    snprintf(command, sizeof(command), "\n%s " EXPR_CFLAGS "\n%s", cc, model);
+    for (c = command; *c != '\0'; c++)
+        hash = (hash ^ (unsigned char)*c) * 1099511628211ULL;
+    snprintf(base, sizeof(base), "%s/expr-%016llx", dir, hash);
+    snprintf(path, sizeof(path), "%s.so", base);
+
+    /* Hit: an earlier run built it */
+    if (!temporary && expr_private(path, 0) && (batch = expr_open(path, dim)) != NULL) {
+        fprintf(stderr, "Expression: cached module %s\n", path);
+        return batch;
+    }
+
+    /* Miss: build into a file of our own and rename it into place, so
+     * concurrent runs never load a partial module */
+    snprintf(tmp, sizeof(tmp), "%s.c", base);
+    file = fopen(tmp, "w");
+    if (file == NULL || fputs(source, file) == EOF || fclose(file) != 0) {
+        fprintf(stderr, "Could not write %s\n", tmp);
+        return NULL;
+    }
+    snprintf(tmp, sizeof(tmp), "%s.so.%d", base, (int)getpid());
+    snprintf(command, sizeof(command), "%s " EXPR_CFLAGS " -o '%s' '%s.c' -lm > '%s.log' 2>&1", cc, tmp, base, base);
+    status = system(command);
+    if (status != 0 || chmod(tmp, 0755) < 0 || rename(tmp, path) < 0) {
+        unlink(tmp);
+        fprintf(stderr, "Could not compile the expression with %s (see %s.log)\n", cc, base);
+        return NULL;
+    }
+    snprintf(tmp, sizeof(tmp), "%s.log", base);
+    unlink(tmp);
+    batch = expr_open(path, dim);
+    if (batch == NULL)
+        fprintf(stderr, "Could not load %s: %s\n", path, dlerror());
+    else
+        fprintf(stderr, "Expression: compiled module %s%s\n", path, temporary ? " (not cached)" : "");
+    if (temporary) {
+        /* The loaded module stays mapped */
+        unlink(path);
+        snprintf(tmp, sizeof(tmp), "%s.c", base);
+        unlink(tmp);
+        rmdir(dir);
+    }
+    return batch;
+}
+
+/* Load the expression text over dim coordinates as the objective
+ * PSO_EXPR_NAME. With compile the objective is the specialized module,
+ * built in cache (NULL for the default) unless an earlier run built it;
+ * latency, if not NULL, receives the seconds taken to generate, build and
+ * open it. Without compile, or if the module cannot be built, the
+ * expression is interpreted and latency is 0. Replaces any expression
+ * loaded before. Return the registry entry, NULL on a syntax error */
+const pso_objective_t *pso_expr_load(const char *text, int dim, int compile, const char *cache, double *latency)
+{
+    expr_parser_t parser;
+    expr_op_t *code;
+    char *source;
+    int root = -1, num_ops = 0, depth = 0;
+    double start = omp_get_wtime();
+    expr_batch_t batch = NULL;
+
+    if (latency != NULL)
+        *latency = 0.0;
+    memset(&parser, 0, sizeof(parser));
+    parser.text = parser.pos = text;
+    parser.dim = dim;
+    parser.node = (expr_node_t *)malloc(EXPR_MAX_NODES * sizeof(expr_node_t));
+    code = (expr_op_t *)calloc(2 * EXPR_MAX_NODES, sizeof(expr_op_t));
+    if (parser.node == NULL || code == NULL) {
+        fprintf(stderr, "Malloc error\n");
+        free((void *)parser.node);
+        free((void *)code);
+        return NULL;
+    }
+    if (dim < 1)
+        expr_fail(&parser, "dimension must be positive");
+    else if ((root = expr_sum(&parser)) >= 0) {
+        expr_skip(&parser);
+        if (*parser.pos != '\0')
+            expr_fail(&parser, "unexpected character");
+        else if (expr_emit(parser.node, root, code, &num_ops, &depth) < 0)
+            expr_fail(&parser, "expression nested too deeply");
+    }
+    if (parser.error[0] != '\0') {
+        fprintf(stderr, "Expression %s: %s\n", text, parser.error);
+        free((void *)parser.node);
+        free((void *)code);
+        return NULL;
+    }
+
+    if (expr_module != NULL) {
+        dlclose(expr_module);
+        expr_module = NULL;
+    }
+    if (compile) {
+        source = expr_codegen(text, dim, parser.node, root);
+        if (source != NULL)
+            batch = expr_compile(source, dim, cache);
+        free(source);
+        if (batch == NULL)
+            fprintf(stderr, "Expression: interpreting it\n");
+        else if (latency != NULL)
+            *latency = omp_get_wtime() - start;
+    }
+    free((void *)parser.node);
+    free((void *)expr_code);
+    expr_code = code;
+    expr_num_ops = num_ops;
+    expr_objective.dim = expr_objective.min_dim = dim;
+    expr_objective.batch = (batch != NULL) ? batch : pso_expr_interpret;
+    pso_expr_objective = &expr_objective;
+    return pso_expr_objective;
+}
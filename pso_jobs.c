@@ -0,0 +1,484 @@
+/* Batch runner: many optimizations in one process.
+ *
+ * Reads one job spec per line, each a flat JSON object such as
+ *
+ *   {"id": "r1", "function": "rastrigin", "dim": 30, "swarm_size": 2000,
+ *    "xmin": -5.12, "xmax": 5.12, "max_iter": 500, "seed": 7, "engine": "omp"}
+ *
+ * Only "function" is required; the other fields default to the registry
+ * values as on the command line. Without "seed" a job runs on the current
+ * time plus its index, so repeated specs give independent runs; the seed
+ * used is echoed in the result line. Jobs are shared out to a single team of
+ * worker threads, each of which keeps one swarm allocation and reuses it for
+ * all of its jobs. One JSON result line is written to stdout per job, either
+ * as jobs complete or in input order.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <omp.h>
+#include "pso.h"
+
+/* Read the next "key": value pair of a flat JSON object starting at *p.
+ * Strings are returned without quotes; numbers and literals as written.
+ * Return 1 when a pair was read, 0 at the end of the object, -1 on syntax error.
+ */
+int pso_json_next(const char **p, char *key, int key_len, char *value, int value_len)
+{
+    const char *s = *p;
+    int n;
+
+    while (*s == ' ' || *s == '\t' || *s == '{' || *s == ',' || *s == '\r' || *s == '\n')
+        s++;
+    if (*s == '}' || *s == '\0')
+        return 0;
+
+    /* Key */
+    if (*s++ != '"')
+        return -1;
+    for (n = 0; *s != '"' && *s != '\0'; s++)
+        if (n < key_len - 1)
+            key[n++] = *s;
+    key[n] = '\0';
+    if (*s++ != '"')
+        return -1;
+
+    while (*s == ' ' || *s == '\t')
+        s++;
+    if (*s++ != ':')
+        return -1;
+    while (*s == ' ' || *s == '\t')
+        s++;
+
+    /* Value */
+    n = 0;
+    if (*s == '"') {
+        for (s++; *s != '"' && *s != '\0'; s++) {
+            if (*s == '\\' && s[1] != '\0')
+                s++;
+            if (n < value_len - 1)
+                value[n++] = *s;
+        }
+        if (*s++ != '"')
+            return -1;
+    } else {
+        for (; *s != ',' && *s != '}' && *s != '\0' && *s != ' ' && *s != '\n'; s++)
+            if (n < value_len - 1)
+                value[n++] = *s;
+        if (n == 0)
+            return -1;
+    }
+    value[n] = '\0';
+
+    *p = s;
+    return 1;
+}
+
+/* Write s as a JSON string */
+void pso_json_string(FILE *fp, const char *s)
+{
+    fputc('"', fp);
+    for (; *s != '\0'; s++) {
+        if (*s == '"' || *s == '\\')
+            fprintf(fp, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(fp, "\\u%04x", *s);
+        else
+            fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+/* Reset job to the defaults of a job spec */
+void pso_job_defaults(pso_job_t *job)
+{
+    memset(job, 0, sizeof(pso_job_t));
+    job->config.engine = PSO_ENGINE_OMP;
+    job->config.swarm_size = 1000;
+    job->config.max_iter = 1000;
+    job->config.xmin = NAN;
+    job->config.xmax = NAN;
+    job->config.num_threads = 1;
+    job->config.seed = (unsigned int)time(NULL);   /* Plus the index unless "seed" is given */
+    job->weight = 1;
+    job->status = -1;
+}
+
+/* Set one field of a job spec. Return 0 on success, -1 otherwise with the
+ * reason in job->error */
+int pso_job_set(pso_job_t *job, const char *key, const char *value)
+{
+    if (strcmp(key, "id") == 0)
+        snprintf(job->id, sizeof(job->id), "%.63s", value);
+    else if (strcmp(key, "function") == 0)
+        snprintf(job->function, sizeof(job->function), "%.31s", value);
+    else if (strcmp(key, "dim") == 0 || strcmp(key, "D") == 0)
+        job->config.dim = atoi(value);
+    else if (strcmp(key, "swarm_size") == 0 || strcmp(key, "N") == 0)
+        job->config.swarm_size = atoi(value);
+    else if (strcmp(key, "xmin") == 0)
+        job->config.xmin = atof(value);
+    else if (strcmp(key, "xmax") == 0)
+        job->config.xmax = atof(value);
+    else if (strcmp(key, "max_iter") == 0 || strcmp(key, "iterations") == 0)
+        job->config.max_iter = atoi(value);
+    else if (strcmp(key, "seed") == 0) {
+        job->config.seed = strtoul(value, NULL, 10);
+        job->seeded = 1;
+    }
+    else if (strcmp(key, "weight") == 0)
+        job->weight = atoi(value);
+    else if (strcmp(key, "niche_radius") == 0)
+        job->config.niche_radius = atof(value);
+    else if (strcmp(key, "inertia") == 0)
+        job->config.inertia = atof(value);
+    else if (strcmp(key, "c1") == 0)
+        job->config.c1 = atof(value);
+    else if (strcmp(key, "c2") == 0)
+        job->config.c2 = atof(value);
+    else if (strcmp(key, "opposition") == 0) {
+        job->config.opposition = 1;
+        job->config.jump_rate = atof(value);
+    }
+    else if (strcmp(key, "engine") == 0) {
+        if (strcmp(value, "gold") == 0)
+            job->config.engine = PSO_ENGINE_GOLD;
+        else if (strcmp(value, "omp") == 0)
+            job->config.engine = PSO_ENGINE_OMP;
+        else {
+            snprintf(job->error, sizeof(job->error), "unknown engine %.64s", value);
+            return -1;
+        }
+    } else if (strcmp(key, "variant") == 0) {
+        if (pso_parse_variant(value, &job->config) < 0) {
+            snprintf(job->error, sizeof(job->error), "unknown variant %.64s", value);
+            return -1;
+        }
+    } else if (strcmp(key, "topology") == 0) {
+        if (pso_parse_topology(value, &job->config) < 0) {
+            snprintf(job->error, sizeof(job->error), "unknown topology %.64s", value);
+            return -1;
+        }
+    } else {
+        snprintf(job->error, sizeof(job->error), "unknown field %.64s", key);
+        return -1;
+    }
+    return 0;
+}
+
+/* Fill in registry defaults and validate job. Return 0 on success, -1
+ * otherwise with the reason in job->error */
+int pso_job_check(pso_job_t *job)
+{
+    const pso_objective_t *objective;
+    pso_config_t *config;
+
+    objective = pso_find_objective(job->function);
+    if (objective == NULL) {
+        snprintf(job->error, sizeof(job->error), "unknown function %s", job->function);
+        return -1;
+    }
+    config = &job->config;
+    config->function = (char *)objective->name;
+    if (config->dim <= 0)
+        config->dim = objective->dim;
+    if (isnan(config->xmin))
+        config->xmin = objective->xmin;
+    if (isnan(config->xmax))
+        config->xmax = objective->xmax;
+    if (config->dim < objective->min_dim || config->swarm_size < 1 || config->max_iter < 0
+        || config->xmin >= config->xmax || job->weight < 1
+        || (config->opposition && (config->jump_rate < 0 || config->jump_rate > 1)) || config->niche_radius < 0
+        || config->inertia < 0 || config->c1 < 0 || config->c2 < 0) {
+        snprintf(job->error, sizeof(job->error), "invalid parameters");
+        return -1;
+    }
+    if (config->engine == PSO_ENGINE_GOLD && (config->variant != PSO_VARIANT_GBEST || config->opposition
+                                              || config->inertia > 0 || config->c1 > 0 || config->c2 > 0)) {
+        snprintf(job->error, sizeof(job->error), "the gold engine only runs the gbest variant");
+        return -1;
+    }
+
+    job->status = 0;
+    return 0;
+}
+
+/* Fill job from a JSON job spec. Return 0 on success, -1 otherwise with
+ * the reason in job->error */
+int pso_parse_job(const char *line, pso_job_t *job)
+{
+    char key[64], value[256];
+    int status;
+
+    pso_job_defaults(job);
+    while ((status = pso_json_next(&line, key, sizeof(key), value, sizeof(value))) > 0)
+        if (pso_job_set(job, key, value) < 0)
+            return -1;
+    if (status < 0) {
+        snprintf(job->error, sizeof(job->error), "malformed job spec");
+        return -1;
+    }
+    return pso_job_check(job);
+}
+
+/* qsort comparison of doubles */
+int pso_compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Run one job on the calling thread, reusing *arena for the swarm. The
+ * progress hook, if any, applies to the OpenMP engine only */
+void pso_run_job(pso_job_t *job, swarm_t **arena, pso_progress_t *progress)
+{
+    int g = -1;
+    double start = omp_get_wtime();
+    pso_config_t *config = &job->config;
+    swarm_t *swarm;
+
+    job->threads = 1;
+    if (config->engine == PSO_ENGINE_GOLD) {
+        /* The reference engine's random numbers are per thread */
+        pso_gold_seed(config->seed);
+        swarm = pso_init(config->function, config->dim, config->swarm_size, config->xmin, config->xmax);
+        if (swarm != NULL) {
+            g = pso_solve_gold(config->function, swarm, config->xmax, config->xmin, config->max_iter);
+            if (g >= 0) {
+                job->fitness = swarm->particle[g].fitness;
+                job->position = (float *)malloc(config->dim * sizeof(float));
+                if (job->position != NULL)
+                    memcpy(job->position, swarm->particle[g].pbest, config->dim * sizeof(float));
+            }
+            pso_free(swarm);
+        }
+    } else {
+        *arena = pso_alloc(*arena, config->dim, config->swarm_size, pso_variant_velocity(config));
+        swarm = *arena;
+        if (swarm != NULL && pso_init_swarm_omp(swarm, config->function, config->xmin, config->xmax,
+                                                config->num_threads, config->seed) == 0) {
+            g = pso_solve_omp(swarm, config, progress);
+            if (g >= 0) {
+                job->fitness = swarm->particle[g].fitness;
+                job->position = (float *)malloc(config->dim * sizeof(float));
+                if (job->position != NULL)
+                    memcpy(job->position, swarm->particle[g].pbest, config->dim * sizeof(float));
+            }
+        }
+        job->threads = (config->slot != NULL) ? pso_sched_mean_threads(config->slot) : config->num_threads;
+    }
+
+    job->time = omp_get_wtime() - start;
+    if (g < 0 || job->position == NULL) {
+        job->status = -1;
+        snprintf(job->error, sizeof(job->error), "optimization failed");
+    }
+}
+
+/* Write result of job as one JSON line */
+void pso_print_job(FILE *fp, pso_job_t *job)
+{
+    int j;
+    char num[32];
+
+    fprintf(fp, "{\"job\":%d,\"id\":", job->index);
+    pso_json_string(fp, job->id);
+    if (job->status < 0) {
+        fprintf(fp, ",\"status\":\"error\",\"error\":");
+        pso_json_string(fp, job->error);
+        fprintf(fp, "}\n");
+        return;
+    }
+
+    fprintf(fp, ",\"status\":\"ok\",\"function\":");
+    pso_json_string(fp, job->config.function);
+    fprintf(fp, ",\"engine\":\"%s\",\"variant\":\"%s\",\"dim\":%d,\"swarm_size\":%d,\"xmin\":%.9g,\"xmax\":%.9g,"
+            "\"max_iter\":%d,\"seed\":%u,\"threads\":%.2f,\"time\":%.6f,\"fitness\":%.9g,\"position\":[",
+            (job->config.engine == PSO_ENGINE_GOLD) ? "gold" : "omp", pso_variant_name(&job->config), job->config.dim, job->config.swarm_size,
+            job->config.xmin, job->config.xmax, job->config.max_iter, job->config.seed, job->threads,
+            job->time, job->fitness);
+    for (j = 0; j < job->config.dim; j++) {
+        if (j > 0)
+            fputc(',', fp);
+        pso_format_float(num, job->position[j]);
+        fputs(num, fp);
+    }
+    fprintf(fp, "]}\n");
+}
+
+/* Run the num_jobs jobs of jobs on num_threads cores. Up to one job per
+ * core runs at a time; the cores are divided among the running jobs by the
+ * scheduler in proportion to their weights, a gold job holding one core,
+ * and are handed on as jobs finish.
+ * Jobs whose status is not 0 are skipped. done, if not NULL, is called with
+ * arg for every job as it finishes, one at a time. Return the core seconds
+ * the jobs ran for, or -1 on allocation failure */
+double pso_run_batch(pso_job_t *jobs, int num_jobs, int num_threads, void (*done)(pso_job_t *, void *), void *arg)
+{
+    double busy = 0.0;
+    pso_sched_t *sched = pso_sched_create(num_threads);
+
+    if (sched == NULL)
+        return -1;
+    omp_set_max_active_levels(2); /* Jobs run their own teams inside the worker team */
+#pragma omp parallel num_threads(num_threads) reduction(+:busy)
+{
+    swarm_t *arena = NULL;  /* Swarm storage reused across this worker's jobs */
+    int k;
+
+    #pragma omp for schedule(dynamic, 1)
+    for (k = 0; k < num_jobs; k++) {
+        if (jobs[k].status == 0) {
+            /* The reference engine is serial and holds a single core */
+            jobs[k].config.slot = pso_sched_join(sched, (jobs[k].config.engine == PSO_ENGINE_OMP) ? jobs[k].weight : 0);
+            pso_run_job(&jobs[k], &arena, NULL);
+            pso_sched_leave(jobs[k].config.slot);
+            jobs[k].config.slot = NULL;
+            busy += jobs[k].time * jobs[k].threads;
+        }
+        if (done != NULL) {
+            #pragma omp critical (pso_jobs_output)
+            done(&jobs[k], arg);
+        }
+    }
+    pso_free(arena);
+}
+    pso_sched_destroy(sched);
+    return busy;
+}
+
+/* Output order of pso_run_jobs */
+typedef struct pso_jobs_output_s {
+    pso_job_t *jobs;
+    int num_jobs;
+    int in_order;
+    int *done;
+    int next_to_print;
+} pso_jobs_output_t;
+
+/* Print a finished job's result, or in input order those now complete */
+static void pso_job_done(pso_job_t *job, void *arg)
+{
+    pso_jobs_output_t *out = (pso_jobs_output_t *)arg;
+    pso_job_t *next;
+
+    if (!out->in_order) {
+        pso_print_job(stdout, job);
+        free((void *)job->position);
+        job->position = NULL;
+    } else {
+        out->done[job->index] = 1;
+        while (out->next_to_print < out->num_jobs && out->done[out->next_to_print]) {
+            next = &out->jobs[out->next_to_print];
+            pso_print_job(stdout, next);
+            free((void *)next->position);
+            next->position = NULL;
+            out->next_to_print++;
+        }
+    }
+    fflush(stdout);
+}
+
+/* Read job specs from path ("-" for stdin), one per line, skipping blank
+ * lines and # comments. Specs that do not parse are kept with their error.
+ * Return the jobs and their number in *num_jobs, NULL on failure */
+pso_job_t *pso_read_jobs(const char *path, int *num_jobs)
+{
+    FILE *fp;
+    char *line = NULL;
+    size_t line_len = 0;
+    int capacity = 0;
+    pso_job_t *jobs = NULL;
+
+    *num_jobs = 0;
+    fp = (strcmp(path, "-") == 0) ? stdin : fopen(path, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "Could not open job file %s\n", path);
+        return NULL;
+    }
+    while (getline(&line, &line_len, fp) != -1) {
+        char *s = line + strspn(line, " \t\r\n");
+        if (*s == '\0' || *s == '#')
+            continue;
+        if (*num_jobs == capacity) {
+            capacity = (capacity > 0) ? 2 * capacity : 64;
+            jobs = (pso_job_t *)realloc(jobs, capacity * sizeof(pso_job_t));
+            if (jobs == NULL) {
+                fprintf(stderr, "Malloc error\n");
+                return NULL;
+            }
+        }
+        pso_parse_job(s, &jobs[*num_jobs]);
+        jobs[*num_jobs].index = *num_jobs;
+        if (!jobs[*num_jobs].seeded)
+            jobs[*num_jobs].config.seed += *num_jobs;
+        (*num_jobs)++;
+    }
+    free((void *)line);
+    if (fp != stdin)
+        fclose(fp);
+    if (jobs == NULL)
+        jobs = (pso_job_t *)malloc(sizeof(pso_job_t));
+    return jobs;
+}
+
+/* Run all jobs of config->jobs_path ("-" for stdin) on config->num_threads
+ * cores (see pso_run_batch). Return 0 if every job succeeded, -1 otherwise */
+int pso_run_jobs(pso_config_t *config)
+{
+    int i, num_jobs, num_failed = 0;
+    pso_job_t *jobs;
+    double start, elapsed, busy, evals = 0.0, *latency;
+    pso_jobs_output_t out;
+
+    jobs = pso_read_jobs(config->jobs_path, &num_jobs);
+    if (jobs == NULL)
+        return -1;
+    out.jobs = jobs;
+    out.num_jobs = num_jobs;
+    out.in_order = config->jobs_in_order;
+    out.next_to_print = 0;
+    out.done = (int *)calloc(num_jobs + 1, sizeof(int));
+    latency = (double *)malloc((num_jobs + 1) * sizeof(double));
+    if (out.done == NULL || latency == NULL) {
+        fprintf(stderr, "Malloc error\n");
+        return -1;
+    }
+
+    start = omp_get_wtime();
+    busy = pso_run_batch(jobs, num_jobs, config->num_threads, pso_job_done, &out);
+    elapsed = omp_get_wtime() - start;
+    if (busy < 0) {
+        fprintf(stderr, "Malloc error\n");
+        return -1;
+    }
+
+    for (i = 0; i < num_jobs; i++) {
+        if (jobs[i].status < 0) {
+            num_failed++;
+            continue;
+        }
+        latency[i - num_failed] = jobs[i].time;
+        evals += (double)jobs[i].config.swarm_size * (jobs[i].config.max_iter + 1);
+    }
+    fprintf(stderr, "%d jobs (%d failed) on %d cores in %fs: %.2f jobs/s, %.3g evaluations/s, core utilization %.1f%%\n",
+            num_jobs, num_failed, config->num_threads, elapsed, num_jobs / elapsed, evals / elapsed,
+            100.0 * busy / (elapsed * config->num_threads));
+    if (num_jobs > num_failed) {
+        int n = num_jobs - num_failed;
+        double sum = 0.0;
+        qsort(latency, n, sizeof(double), pso_compare_double);
+        for (i = 0; i < n; i++)
+            sum += latency[i];
+        fprintf(stderr, "Job latency: mean %.3fs, median %.3fs, p95 %.3fs, max %.3fs\n",
+                sum / n, latency[n / 2], latency[(int)ceil(0.95 * (n - 1))], latency[n - 1]);
+    }
+
+    free((void *)latency);
+    free((void *)out.done);
+    free((void *)jobs);
+    return (num_failed > 0) ? -1 : 0;
+}
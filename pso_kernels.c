@@ -0,0 +1,735 @@
+/* Compute kernels of the OpenMP engine, compiled for several instruction sets.
+ *
+ * Every kernel is written once as a plain loop. The Makefile builds for the
+ * baseline x86-64 instruction set (SSE2); the target attribute compiles
+ * further copies of each kernel for AVX2 and AVX-512, and
+ * pso_kernels_select() picks one set at startup from what the CPU reports
+ * through cpuid. All variants perform the same operations in the same order
+ * (no FMA contraction in ISO C mode, sums kept in a fixed number of partial
+ * sums), so the results do not depend on the variant chosen.
+ *
+ * The sums of the high-dimensional objectives (rastrigin, schwefel) follow a
+ * summation policy chosen at build time with PSO_SUM (see k_sum_add):
+ * NAIVE adds term j to partial sum j mod LANES, KAHAN compensates each
+ * partial sum, and PAIRWISE sums blocks of terms and combines the block sums
+ * in a binary tree. In every policy the order of the operations depends on
+ * the dimension alone, never on the vector width or the thread count.
+ *
+ * Transcendental functions are evaluated with the single precision
+ * polynomials of the Cephes library so the objective loops vectorize; they
+ * are accurate to a few units in the last place over the full domain.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "pso.h"
+
+#define KERNEL static inline __attribute__((always_inline))
+#define LANES 16        /* Partial sums of the high-dimensional objectives */
+
+/* Summation policies of the high-dimensional objectives */
+#define PSO_SUM_NAIVE 0
+#define PSO_SUM_KAHAN 1
+#define PSO_SUM_PAIRWISE 2
+#ifndef PSO_SUM
+#define PSO_SUM PSO_SUM_NAIVE
+#endif
+#define PSO_SUM_BLOCK 8  /* Terms per partial sum in a block of pairwise summation */
+
+#if PSO_SUM == PSO_SUM_KAHAN
+const char *const pso_sum_policy = "kahan";
+#elif PSO_SUM == PSO_SUM_PAIRWISE
+const char *const pso_sum_policy = "pairwise";
+#else
+const char *const pso_sum_policy = "naive";
+#endif
+
+/* Round to nearest integer; valid for |x| < 2^51 */
+KERNEL double k_round(double x)
+{
+    return (x + 6755399441055744.0) - 6755399441055744.0;
+}
+
+/* sin(r + n * pi/2) for |r| <= pi/4 */
+KERNEL float k_sin_quadrant(float r, int n)
+{
+    float z = r * r, s, c, y;
+
+    s = ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z - 1.6666654611e-1f) * z * r + r;
+    c = ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z + 4.166664568298827e-2f) * z * z
+        - 0.5f * z + 1.0f;
+    y = (n & 1) ? c : s;
+    return (n & 2) ? -y : y;
+}
+
+/* sin(a + n * pi/2); the reduction to [-pi/4, pi/4] is done in double precision */
+KERNEL float k_sin_shifted(float a, int n)
+{
+    double q = k_round((double)a * M_2_PI);
+    float r = (float)((double)a - q * M_PI_2);
+
+    return k_sin_quadrant(r, (int)(q - 4.0 * k_round(q * 0.25)) + n);
+}
+
+KERNEL float k_sin(float a)
+{
+    return k_sin_shifted(a, 0);
+}
+
+KERNEL float k_cos(float a)
+{
+    return k_sin_shifted(a, 1);
+}
+
+/* cos(2 pi x); reduced exactly in units of a quarter turn */
+KERNEL float k_cos_2pi(float x)
+{
+    double q = k_round(4.0 * (double)x);
+    float r = (float)((double)x - q * 0.25) * (float)(2.0 * M_PI);
+
+    return k_sin_quadrant(r, (int)(q - 4.0 * k_round(q * 0.25)) + 1);
+}
+
+/* log(x) for normal, positive x */
+KERNEL float k_log(float x)
+{
+    float m, z, y, e;
+    int bits;
+
+    /* x = m * 2^e with m in [sqrt(1/2), sqrt(2)) */
+    memcpy(&bits, &x, sizeof(float));
+    e = (float)((bits >> 23) - 126);
+    bits = (bits & 0x007fffff) | 0x3f000000;
+    memcpy(&m, &bits, sizeof(float));
+    e = (m < 0.707106781186547524f) ? e - 1.0f : e;
+    m = (m < 0.707106781186547524f) ? m + m - 1.0f : m - 1.0f;
+    z = m * m;
+    y = ((((((((7.0376836292e-2f * m - 1.1514610310e-1f) * m + 1.1676998740e-1f) * m
+         - 1.2420140846e-1f) * m + 1.4249322787e-1f) * m - 1.6668057665e-1f) * m
+         + 2.0000714765e-1f) * m - 2.4999993993e-1f) * m + 3.3333331174e-1f) * m * z;
+    y = y + -2.12194440e-4f * e - 0.5f * z;
+    return m + y + 0.693359375f * e;
+}
+
+/* exp(z) */
+KERNEL float k_exp(float z)
+{
+    float zc, n, r, p, scale;
+    int bits;
+
+    zc = (z > 88.0f) ? 88.0f : z;
+    zc = (zc < -87.0f) ? -87.0f : zc;
+    n = (float)k_round(zc * 1.44269504088896341f);
+    r = zc - n * 0.693359375f - n * -2.12194440e-4f;
+    p = (((((1.9875691500e-4f * r + 1.3981999507e-3f) * r + 8.3334519073e-3f) * r
+         + 4.1665795894e-2f) * r + 1.6666665459e-1f) * r + 5.0000001201e-1f) * r * r + r + 1.0f;
+    bits = ((int)n + 127) << 23;
+    memcpy(&scale, &bits, sizeof(float));
+    p = p * scale;
+    p = (z > 88.7f) ? INFINITY : p;
+    return (z < -87.3f) ? 0.0f : p;
+}
+
+/* Same as pso_hash, inlined so it vectorizes */
+KERNEL unsigned int k_hash(unsigned int x)
+{
+    x ^= x >> 16;
+    x *= 0x85ebca6bu;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35u;
+    x ^= x >> 16;
+    return x;
+}
+
+/* Sum the LANES partial sums in a fixed order */
+KERNEL float k_sum_lanes(float *acc)
+{
+    int l, s;
+
+    for (s = LANES / 2; s > 0; s /= 2)
+        for (l = 0; l < s; l++)
+            acc[l] += acc[l + s];
+    return acc[0];
+}
+
+/* Running sum of the terms of one objective */
+typedef struct k_sum_s {
+    float acc[LANES];   /* Partial sums */
+    float comp[LANES];  /* Kahan: what each partial sum has in excess */
+    float stack[32];    /* Pairwise: sums of 2^k blocks awaiting their pair */
+    int top;            /* Pairwise: entries on the stack */
+    int blocks;         /* Pairwise: blocks pushed so far */
+    int terms;          /* Pairwise: terms of the current block per partial sum */
+} k_sum_t;
+
+KERNEL void k_sum_init(k_sum_t *s)
+{
+    int l;
+
+    for (l = 0; l < LANES; l++) {
+        s->acc[l] = 0.0f;
+        s->comp[l] = 0.0f;
+    }
+    s->top = s->blocks = s->terms = 0;
+}
+
+/* Pairwise: push the current block's sum and merge equal-sized sums */
+KERNEL void k_sum_push(k_sum_t *s)
+{
+    float c = k_sum_lanes(s->acc);
+    int b;
+
+    for (b = s->blocks++; b & 1; b >>= 1)
+        c = s->stack[--s->top] + c;
+    s->stack[s->top++] = c;
+    for (b = 0; b < LANES; b++)
+        s->acc[b] = 0.0f;
+    s->terms = 0;
+}
+
+/* Add terms t[0..m-1], the next m <= LANES of the objective, to partial sums
+ * 0 to m - 1 */
+KERNEL void k_sum_add(k_sum_t *s, const float *t, int m)
+{
+    int l;
+#if PSO_SUM == PSO_SUM_KAHAN
+    float y, u;
+
+    for (l = 0; l < m; l++) {
+        y = t[l] - s->comp[l];
+        u = s->acc[l] + y;
+        s->comp[l] = (u - s->acc[l]) - y;
+        s->acc[l] = u;
+    }
+#else
+    for (l = 0; l < m; l++)
+        s->acc[l] += t[l];
+#endif
+#if PSO_SUM == PSO_SUM_PAIRWISE
+    if (++s->terms == PSO_SUM_BLOCK)
+        k_sum_push(s);
+#endif
+}
+
+/* Total of the terms added to s */
+KERNEL float k_sum_finish(k_sum_t *s)
+{
+#if PSO_SUM == PSO_SUM_KAHAN
+    float a, b, u, e;
+    int l, h;
+
+    /* Fold the partial sums in the fixed tree, keeping each rounding error */
+    for (h = LANES / 2; h > 0; h /= 2)
+        for (l = 0; l < h; l++) {
+            a = s->acc[l];
+            b = s->acc[l + h];
+            u = a + b;
+            e = (a - (u - (u - a))) + (b - (u - a));
+            s->acc[l] = u;
+            s->comp[l] = s->comp[l] + s->comp[l + h] - e;
+        }
+    return s->acc[0] - s->comp[0];
+#elif PSO_SUM == PSO_SUM_PAIRWISE
+    float c;
+    int k;
+
+    if (s->terms > 0 || s->blocks == 0)
+        k_sum_push(s);
+    c = s->stack[s->top - 1];
+    for (k = s->top - 2; k >= 0; k--)
+        c = s->stack[k] + c;
+    return c;
+#else
+    return k_sum_lanes(s->acc);
+#endif
+}
+
+/* Fill r with n numbers uniform in [0, 1), the j-th derived from key and j
+ * alone so any block of them can be generated independently */
+KERNEL void uniform_body(float *restrict r, int n, unsigned int key)
+{
+    int j;
+
+    for (j = 0; j < n; j++)
+        r[j] = (float)(k_hash(key ^ k_hash(j)) >> 8) * (1.0f / 16777216.0f);
+}
+
+/* Fill r with n standard normal numbers by the Box-Muller transform of
+ * pairs of the counter-based uniform numbers, so any block of them can be
+ * generated independently */
+KERNEL void normal_body(float *restrict r, int n, unsigned int key)
+{
+    int j, quadrant;
+    float u1, u2, q, a, radius;
+
+    for (j = 0; j < n / 2; j++) {
+        u1 = (float)((k_hash(key ^ k_hash(2 * j)) >> 8) + 1) * (1.0f / 16777216.0f);     /* (0, 1] */
+        u2 = (float)(k_hash(key ^ k_hash(2 * j + 1)) >> 8) * (1.0f / 16777216.0f);
+        radius = sqrtf(-2.0f * k_log(u1));
+        /* Angle 2 pi u2 in quarter turns; exact in single precision as u2 < 1 */
+        q = (4.0f * u2 + 12582912.0f) - 12582912.0f;
+        a = (u2 - 0.25f * q) * (float)(2.0 * M_PI);
+        quadrant = (int)q;
+        r[2 * j] = radius * k_sin_quadrant(a, quadrant + 1);
+        r[2 * j + 1] = radius * k_sin_quadrant(a, quadrant);
+    }
+    if (n % 2) {
+        u1 = (float)((k_hash(key ^ k_hash(n - 1)) >> 8) + 1) * (1.0f / 16777216.0f);
+        u2 = (float)(k_hash(key ^ k_hash(n)) >> 8) * (1.0f / 16777216.0f);
+        r[n - 1] = sqrtf(-2.0f * k_log(u1)) * k_cos_2pi(u2);
+    }
+}
+
+/* Update velocities and positions of n elements of consecutive particles;
+ * gbest holds the best position repeated for each of them. r holds three
+ * rows of n uniform numbers: r1 and r2 weigh the pull towards pbest and
+ * gbest, r3 resets velocities that leave [-vmax, vmax] to a random one */
+KERNEL void update_body(float *restrict x, float *restrict v, const float *restrict pbest,
+                        const float *restrict gbest, const float *restrict r, int n,
+                        const pso_update_t *param)
+{
+    int j;
+    float w = param->w, c1 = param->c1, c2 = param->c2;
+    float vmax = param->vmax, xmin = param->xmin, xmax = param->xmax;
+    float vj, xj, reset;
+
+    for (j = 0; j < n; j++) {
+        vj = w * v[j] + c1 * r[j] * (pbest[j] - x[j]) + c2 * r[n + j] * (gbest[j] - x[j]);
+        reset = -vmax + 2 * vmax * r[2 * n + j];
+        vj = (fabsf(vj) > vmax) ? reset : vj;
+        xj = x[j] + vj;
+        xj = (xj > xmax) ? xmax : xj;
+        xj = (xj < xmin) ? xmin : xj;
+        v[j] = vj;
+        x[j] = xj;
+    }
+}
+
+/* Fully informed update of n elements of consecutive particles: the pull is
+ * the sum over the k neighbors of r_m * (pbest_m - x), with neighbor[m] the
+ * pbest rows of the m-th neighbor of each particle (a shifted view of the
+ * pbest matrix) and r holding k rows of n uniform numbers, row 0 of which
+ * is overwritten with the pull. Constriction: v = w * (v + c1 * pull) */
+KERNEL void fips_update_body(float *restrict x, float *restrict v, const float *const *neighbor, int k,
+                             float *restrict r, int n, const pso_update_t *param)
+{
+    int j, m;
+    float w = param->w, c1 = param->c1;
+    float vmax = param->vmax, xmin = param->xmin, xmax = param->xmax;
+    float vj, xj;
+    const float *restrict p = neighbor[0];
+    const float *restrict rm;
+
+    for (j = 0; j < n; j++)
+        r[j] = r[j] * (p[j] - x[j]);
+    for (m = 1; m < k; m++) {
+        p = neighbor[m];
+        rm = r + (size_t)m * n;
+        for (j = 0; j < n; j++)
+            r[j] += rm[j] * (p[j] - x[j]);
+    }
+    for (j = 0; j < n; j++) {
+        vj = w * (v[j] + c1 * r[j]);
+        vj = (vj > vmax) ? vmax : vj;
+        vj = (vj < -vmax) ? -vmax : vj;
+        xj = x[j] + vj;
+        xj = (xj > xmax) ? xmax : xj;
+        xj = (xj < xmin) ? xmin : xj;
+        v[j] = vj;
+        x[j] = xj;
+    }
+}
+
+/* Comprehensive learning update of n elements: element j is pulled towards
+ * pbest[exemplar[j]], the same dimension of the pbest its particle learns
+ * from in that dimension. One random number per element */
+KERNEL void clpso_update_body(float *restrict x, float *restrict v, const float *restrict pbest,
+                              const int *restrict exemplar, const float *restrict r, int n,
+                              const pso_update_t *param)
+{
+    int j;
+    float w = param->w, c1 = param->c1;
+    float vmax = param->vmax, xmin = param->xmin, xmax = param->xmax;
+    float vj, xj;
+
+    for (j = 0; j < n; j++) {
+        vj = w * v[j] + c1 * r[j] * (pbest[exemplar[j]] - x[j]);
+        vj = (vj > vmax) ? vmax : vj;
+        vj = (vj < -vmax) ? -vmax : vj;
+        xj = x[j] + vj;
+        xj = (xj > xmax) ? xmax : xj;
+        xj = (xj < xmin) ? xmin : xj;
+        v[j] = vj;
+        x[j] = xj;
+    }
+}
+
+/* Bare-bones update of n elements of consecutive particles: positions are
+ * drawn from N((pbest + gbest) / 2, |pbest - gbest|) using the standard
+ * normal numbers in z; gbest is repeated for each particle as in update_body */
+KERNEL void barebones_update_body(float *restrict x, const float *restrict pbest, const float *restrict gbest,
+                                  const float *restrict z, int n, const pso_update_t *param)
+{
+    int j;
+    float xmin = param->xmin, xmax = param->xmax;
+    float xj;
+
+    for (j = 0; j < n; j++) {
+        xj = 0.5f * (pbest[j] + gbest[j]) + fabsf(pbest[j] - gbest[j]) * z[j];
+        xj = (xj > xmax) ? xmax : xj;
+        xj = (xj < xmin) ? xmin : xj;
+        x[j] = xj;
+    }
+}
+
+/* Quantum-behaved update of n elements of consecutive particles: x is moved
+ * to p +- beta |mbest - x| ln(1/u) with p = phi pbest + (1 - phi) gbest, beta
+ * in param->w and gbest and mbest repeated for each particle. r holds three
+ * rows of n uniform numbers: phi, u and the sign */
+KERNEL void qpso_update_body(float *restrict x, const float *restrict pbest, const float *restrict gbest,
+                             const float *restrict mbest, const float *restrict r, int n,
+                             const pso_update_t *param)
+{
+    int j;
+    float beta = param->w, xmin = param->xmin, xmax = param->xmax;
+    float p, step, xj;
+
+    for (j = 0; j < n; j++) {
+        p = r[j] * pbest[j] + (1.0f - r[j]) * gbest[j];
+        step = -beta * fabsf(mbest[j] - x[j]) * k_log(1.0f - r[n + j]);     /* 1 - u in (0, 1] */
+        xj = (r[2 * n + j] < 0.5f) ? p + step : p - step;
+        xj = (xj > xmax) ? xmax : xj;
+        xj = (xj < xmin) ? xmin : xj;
+        x[j] = xj;
+    }
+}
+
+/* Opposite points y = xmin + xmax - x of n elements */
+KERNEL void opposite_body(const float *restrict x, float *restrict y, int n, const pso_update_t *param)
+{
+    int j;
+    float sum = param->xmin + param->xmax;
+
+    for (j = 0; j < n; j++)
+        y[j] = sum - x[j];
+}
+
+/* Replace each of the n rows of x (dim elements each) with the same row of y
+ * where y's fitness is lower, along with its fitness */
+KERNEL void select_body(float *restrict x, float *restrict fitness, const float *restrict y,
+                        const float *restrict y_fitness, int n, int dim)
+{
+    int i, j;
+    size_t offset;
+
+    for (i = 0; i < n; i++) {
+        if (!(y_fitness[i] < fitness[i]))
+            continue;
+        offset = (size_t)i * dim;
+        for (j = 0; j < dim; j++)
+            x[offset + j] = y[offset + j];
+        fitness[i] = y_fitness[i];
+    }
+}
+
+/* Index of the smallest of n fitness values, lowest index on ties; -1 if
+ * none is finite or below infinity */
+KERNEL int argmin_body(const float *restrict fitness, int n)
+{
+    int i;
+    float best = INFINITY;
+
+#pragma omp simd reduction(min:best)
+    for (i = 0; i < n; i++)
+        best = (fitness[i] < best) ? fitness[i] : best;
+    if (!(best < INFINITY))
+        return -1;
+    for (i = 0; i < n; i++)
+        if (fitness[i] == best)
+            break;
+    return i;
+}
+
+/* Sums of x[j] - shift[j % lanes] over n elements, and of their squares,
+ * folded to width lanes: element j goes to lane j % lanes, with lanes a
+ * multiple of 16, and halving then adds the upper lanes into the lower ones
+ * down to width, so lanes / width must be a power of two. Lane l ends in
+ * sum[l] and sum_sq[l], which need room for all lanes. Each lane adds in
+ * element order and the halving order is fixed, so every ISA gives the same
+ * sums. Sixteen lanes at a time stay in registers over all whole passes, and
+ * sixteen lanes in all are folded there too. Callers keep the number of
+ * elements per lane small */
+#define MOMENTS_HALVE(h)                        \
+    if (width <= (h)) {                         \
+        for (l = 0; l < (h); l++) {             \
+            acc[l] += acc[l + (h)];             \
+            acc_sq[l] += acc_sq[l + (h)];       \
+        }                                       \
+    }
+
+KERNEL void moments_body(const float *restrict x, const float *restrict shift, int n, int lanes, int width,
+                         float *restrict sum, float *restrict sum_sq)
+{
+    int h, j, k, l, m = n - n % lanes;
+    float acc[16], acc_sq[16], d;
+
+    for (k = 0; k < lanes; k += 16) {
+        for (l = 0; l < 16; l++)
+            acc[l] = acc_sq[l] = 0.0f;
+        for (j = k; j < m; j += lanes) {
+            for (l = 0; l < 16; l++) {
+                d = x[j + l] - shift[k + l];
+                acc[l] += d;
+                acc_sq[l] += d * d;
+            }
+        }
+        for (l = 0; l < 16; l++) {
+            sum[k + l] = acc[l];
+            sum_sq[k + l] = acc_sq[l];
+        }
+    }
+    for (l = 0; m + l < n; l++) {
+        d = x[m + l] - shift[l];
+        sum[l] += d;
+        sum_sq[l] += d * d;
+    }
+    if (lanes == 16) {
+        for (l = 0; l < 16; l++) {
+            acc[l] = sum[l];
+            acc_sq[l] = sum_sq[l];
+        }
+        MOMENTS_HALVE(8);
+        MOMENTS_HALVE(4);
+        MOMENTS_HALVE(2);
+        MOMENTS_HALVE(1);
+        for (l = 0; l < width; l++) {
+            sum[l] = acc[l];
+            sum_sq[l] = acc_sq[l];
+        }
+        return;
+    }
+    for (h = lanes / 2; h >= width; h /= 2) {
+        for (l = 0; l < h; l++) {
+            sum[l] += sum[l + h];
+            sum_sq[l] += sum_sq[l + h];
+        }
+    }
+}
+
+/* Snap the discrete coordinates of the n rows of x (dim elements each) to
+ * space: an integer coordinate rounds to the nearest integer in [imin, imax]
+ * and a categorical one with k options moves to the center of its k-th of
+ * the domain. The continuous coordinates lead each row and are left alone.
+ * A discrete particle that sits on pbest and gbest decays its velocity
+ * towards zero forever, so velocities v (if not NULL) of the discrete
+ * coordinates are flushed to zero before they turn subnormal and slow the
+ * update down */
+KERNEL void snap_body(float *restrict x, float *restrict v, int n, int dim, const pso_space_t *space,
+                      const pso_update_t *param)
+{
+    int i, j, c = space->num_continuous, m = c + space->num_integer;
+    float *restrict row, xj, k, imin = space->imin, imax = space->imax;
+    float xmin = param->xmin, width = param->xmax - param->xmin;
+
+    for (i = 0; i < n; i++) {
+        row = x + (size_t)i * dim;
+        for (j = c; j < m; j++) {
+            xj = floorf(row[j] + 0.5f);
+            xj = (xj < imin) ? imin : xj;
+            row[j] = (xj > imax) ? imax : xj;
+        }
+        for (j = m; j < dim; j++) {
+            k = space->options[j - m];
+            xj = floorf((row[j] - xmin) * k / width);
+            xj = (xj < 0.0f) ? 0.0f : xj;
+            xj = (xj > k - 1.0f) ? k - 1.0f : xj;
+            row[j] = xmin + (xj + 0.5f) * width / k;
+        }
+        if (v == NULL)
+            continue;
+        row = v + (size_t)i * dim;
+        for (j = c; j < dim; j++)
+            row[j] = (fabsf(row[j]) < FLT_MIN) ? 0.0f : row[j];
+    }
+}
+
+/* Batch objectives: fitness of the n particles whose positions are the rows
+ * of the n x dim matrix x. See pso_utils.c for the definitions */
+KERNEL void booth_body(const float *restrict x, int n, int dim, float *restrict fitness)
+{
+    int i;
+    float a, b;
+
+    for (i = 0; i < n; i++) {
+        a = x[i * dim] + 2 * x[i * dim + 1] - 7;
+        b = 2 * x[i * dim] + x[i * dim + 1] - 5;
+        fitness[i] = a * a + b * b;
+    }
+}
+
+KERNEL void rastrigin_body(const float *restrict x, int n, int dim, float *restrict fitness)
+{
+    int i, j, l, m;
+    float t[LANES], xj;
+    k_sum_t sum;
+
+    for (i = 0; i < n; i++, x += dim) {
+        k_sum_init(&sum);
+        for (j = 0; j < dim; j += LANES) {
+            m = (dim - j < LANES) ? dim - j : LANES;
+            for (l = 0; l < m; l++) {
+                xj = x[j + l];
+                t[l] = xj * xj - 10 * k_cos_2pi(xj);
+            }
+            k_sum_add(&sum, t, m);
+        }
+        fitness[i] = 10 * dim + k_sum_finish(&sum);
+    }
+}
+
+KERNEL void holder_table_body(const float *restrict x, int n, int dim, float *restrict fitness)
+{
+    int i;
+    float x0, x1;
+
+    for (i = 0; i < n; i++) {
+        x0 = x[i * dim];
+        x1 = x[i * dim + 1];
+        fitness[i] = -fabsf(k_sin(x0) * k_cos(x1)
+                            * k_exp(fabsf(1 - sqrtf(x0 * x0 + x1 * x1) / (float)M_PI)));
+    }
+}
+
+KERNEL void eggholder_body(const float *restrict x, int n, int dim, float *restrict fitness)
+{
+    int i;
+    float x0, x1;
+
+    for (i = 0; i < n; i++) {
+        x0 = x[i * dim];
+        x1 = x[i * dim + 1];
+        fitness[i] = -(x1 + 47) * k_sin(sqrtf(fabsf(x0 / 2 + x1 + 47)))
+                     - x0 * k_sin(sqrtf(fabsf(x0 - (x1 + 47))));
+    }
+}
+
+KERNEL void schwefel_body(const float *restrict x, int n, int dim, float *restrict fitness)
+{
+    int i, j, l, m;
+    float t[LANES], xj;
+    k_sum_t sum;
+
+    for (i = 0; i < n; i++, x += dim) {
+        k_sum_init(&sum);
+        for (j = 0; j < dim; j += LANES) {
+            m = (dim - j < LANES) ? dim - j : LANES;
+            for (l = 0; l < m; l++) {
+                xj = x[j + l];
+                t[l] = xj * k_sin(sqrtf(fabsf(xj)));
+            }
+            k_sum_add(&sum, t, m);
+        }
+        fitness[i] = 418.9829f * dim - k_sum_finish(&sum);
+    }
+}
+
+/* Instantiate every kernel for one instruction set */
+#define PSO_KERNEL_VARIANT(isa, target_isa)                                                         \
+__attribute__((target(target_isa))) static void uniform_##isa(float *r, int n, unsigned int key)    \
+{ uniform_body(r, n, key); }                                                                        \
+__attribute__((target(target_isa))) static void normal_##isa(float *r, int n, unsigned int key)     \
+{ normal_body(r, n, key); }                                                                         \
+__attribute__((target(target_isa))) static void update_##isa(float *x, float *v, const float *pbest, \
+        const float *gbest, const float *r, int n, const pso_update_t *param)                      \
+{ update_body(x, v, pbest, gbest, r, n, param); }                                                 \
+__attribute__((target(target_isa))) static void fips_update_##isa(float *x, float *v,                \
+        const float *const *neighbor, int k, float *r, int n, const pso_update_t *param)           \
+{ fips_update_body(x, v, neighbor, k, r, n, param); }                                               \
+__attribute__((target(target_isa))) static void clpso_update_##isa(float *x, float *v,               \
+        const float *pbest, const int *exemplar, const float *r, int n, const pso_update_t *param) \
+{ clpso_update_body(x, v, pbest, exemplar, r, n, param); }                                          \
+__attribute__((target(target_isa))) static void barebones_update_##isa(float *x, const float *pbest, \
+        const float *gbest, const float *z, int n, const pso_update_t *param)                      \
+{ barebones_update_body(x, pbest, gbest, z, n, param); }                                            \
+__attribute__((target(target_isa))) static void qpso_update_##isa(float *x, const float *pbest,      \
+        const float *gbest, const float *mbest, const float *r, int n, const pso_update_t *param)  \
+{ qpso_update_body(x, pbest, gbest, mbest, r, n, param); }                                          \
+__attribute__((target(target_isa))) static void opposite_##isa(const float *x, float *y, int n,     \
+        const pso_update_t *param)                                                                 \
+{ opposite_body(x, y, n, param); }                                                                  \
+__attribute__((target(target_isa))) static void select_##isa(float *x, float *fitness, const float *y, \
+        const float *y_fitness, int n, int dim)                                                    \
+{ select_body(x, fitness, y, y_fitness, n, dim); }                                                  \
+__attribute__((target(target_isa))) static int argmin_##isa(const float *fitness, int n)            \
+{ return argmin_body(fitness, n); }                                                                 \
+__attribute__((target(target_isa))) static void moments_##isa(const float *x, const float *shift,   \
+        int n, int lanes, int width, float *sum, float *sum_sq)                                    \
+{ moments_body(x, shift, n, lanes, width, sum, sum_sq); }                                           \
+__attribute__((target(target_isa))) static void snap_##isa(float *x, float *v, int n, int dim,      \
+        const pso_space_t *space, const pso_update_t *param)                                       \
+{ snap_body(x, v, n, dim, space, param); }                                                             \
+__attribute__((target(target_isa))) static void booth_##isa(const float *x, int n, int dim, float *f) \
+{ booth_body(x, n, dim, f); }                                                                       \
+__attribute__((target(target_isa))) static void rastrigin_##isa(const float *x, int n, int dim, float *f) \
+{ rastrigin_body(x, n, dim, f); }                                                                   \
+__attribute__((target(target_isa))) static void holder_table_##isa(const float *x, int n, int dim, float *f) \
+{ holder_table_body(x, n, dim, f); }                                                                \
+__attribute__((target(target_isa))) static void eggholder_##isa(const float *x, int n, int dim, float *f) \
+{ eggholder_body(x, n, dim, f); }                                                                   \
+__attribute__((target(target_isa))) static void schwefel_##isa(const float *x, int n, int dim, float *f) \
+{ schwefel_body(x, n, dim, f); }                                                                    \
+static const pso_kernels_t kernels_##isa = {                                                        \
+    #isa, uniform_##isa, normal_##isa, update_##isa, fips_update_##isa, clpso_update_##isa,         \
+    barebones_update_##isa, qpso_update_##isa, opposite_##isa, select_##isa, argmin_##isa,          \
+    moments_##isa, snap_##isa,                                                                      \
+    { booth_##isa, rastrigin_##isa, holder_table_##isa, eggholder_##isa, schwefel_##isa }           \
+};
+
+PSO_KERNEL_VARIANT(sse2, "sse2")
+PSO_KERNEL_VARIANT(avx2, "avx2,fma")
+PSO_KERNEL_VARIANT(avx512, "avx512f,avx512dq,avx512vl,avx512bw,avx2,fma")
+
+/* Kernels in use; the baseline set runs on every x86-64 CPU */
+const pso_kernels_t *pso_kernels = &kernels_sse2;
+
+/* Whether the CPU (and operating system) support the instruction set */
+static int pso_isa_supported(const pso_kernels_t *kernels)
+{
+    __builtin_cpu_init();
+    if (kernels == &kernels_avx512)
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")
+               && __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx512bw");
+    if (kernels == &kernels_avx2)
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    return 1;
+}
+
+/* Select the kernels for isa (sse2, avx2 or avx512), or the best the CPU
+ * supports if isa is NULL or "auto". Call once at startup before any solve.
+ * Return 0 on success, -1 if the instruction set is unknown or unsupported */
+int pso_kernels_select(const char *isa)
+{
+    static const pso_kernels_t *variants[] = { &kernels_avx512, &kernels_avx2, &kernels_sse2 };
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        if (isa != NULL && strcmp(isa, "auto") != 0 && strcmp(isa, variants[i]->isa) != 0)
+            continue;
+        if (pso_isa_supported(variants[i])) {
+            pso_kernels = variants[i];
+            return 0;
+        }
+        if (isa != NULL && strcmp(isa, "auto") != 0) {
+            fprintf(stderr, "This CPU does not support %s\n", isa);
+            return -1;
+        }
+    }
+    if (isa != NULL && strcmp(isa, "auto") != 0) {
+        fprintf(stderr, "Unknown instruction set %s\n", isa);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,214 @@
+/* Integer and categorical dimensions for the OpenMP engine.
+ *
+ * Every dimension is declared continuous, integer or categorical with k
+ * options by a spec of comma-separated runs, COUNT*KIND or KIND for a count
+ * of one, where KIND is c, i or kK: "4*c,6*i,2*k3" is four continuous, six
+ * integer and two categorical dimensions of three options each, in that
+ * order. The kinds must come grouped in the order continuous, integer,
+ * categorical, so each kind is one contiguous block of columns of the
+ * position matrix and the continuous block is updated by the vector kernels
+ * untouched.
+ *
+ * Positions and velocities stay continuous. After each update the snap
+ * kernel rounds the integer block to the nearest integer in the domain and
+ * moves each categorical coordinate to the center of the slice of the domain
+ * its option covers: option j of k covers [xmin + j w / k, xmin + (j + 1) w / k)
+ * of a domain of width w. Options are therefore treated as ordered levels;
+ * the swarm moves between neighboring options more easily than distant ones.
+ * The objective only ever sees snapped points.
+ *
+ * Once a discrete particle settles, updates often snap it back onto its own
+ * pbest. Evaluation is deterministic, so the solver then reuses the pbest
+ * fitness instead of evaluating the point again; the saving is reported as
+ * the evaluations skipped.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+#include "pso.h"
+
+/* Parse the dimension kinds spec for dim dimensions in [xmin, xmax] into
+ * space, allocating space->options. Return 0 on success, -1 if the spec is
+ * malformed, out of order, does not cover dim dimensions or declares integer
+ * dimensions with no integer in the domain */
+int pso_parse_space(const char *spec, int dim, float xmin, float xmax, pso_space_t *space)
+{
+    const char *p = spec;
+    char *end;
+    long count, options;
+    int kind, last = 0, total = 0, j;
+    int *levels;
+
+    memset(space, 0, sizeof(pso_space_t));
+    levels = (int *)malloc(dim * sizeof(int));
+    if (levels == NULL)
+        return -1;
+    while (*p != '\0') {
+        count = 1;
+        if (*p >= '0' && *p <= '9') {
+            count = strtol(p, &end, 10);
+            if (*end != '*' || count < 1)
+                goto fail;
+            p = end + 1;
+        }
+        options = 0;
+        switch (*p++) {
+        case 'c': kind = 0; break;
+        case 'i': kind = 1; break;
+        case 'k':
+            kind = 2;
+            options = strtol(p, &end, 10);
+            if (end == p || options < 2 || options > 1 << 24)
+                goto fail;
+            p = end;
+            break;
+        default:
+            goto fail;
+        }
+        if (kind < last || count > dim - total || (*p != ',' && *p != '\0'))
+            goto fail;
+        for (j = 0; j < count; j++)
+            levels[total + j] = (int)options;
+        last = kind;
+        total += count;
+        if (kind == 0)
+            space->num_continuous += count;
+        else if (kind == 1)
+            space->num_integer += count;
+        if (*p == ',')
+            p++;
+    }
+    space->imin = ceilf(xmin);
+    space->imax = floorf(xmax);
+    if (total != dim || (space->num_integer > 0 && space->imin > space->imax))
+        goto fail;
+    space->num_categorical = dim - space->num_continuous - space->num_integer;
+    memmove(levels, levels + space->num_continuous + space->num_integer, space->num_categorical * sizeof(int));
+    space->options = levels;
+    return 0;
+
+fail:
+    free((void *)levels);
+    memset(space, 0, sizeof(pso_space_t));
+    return -1;
+}
+
+/* Solver state of a mixed space: the parsed space and, per thread, the
+ * particles of a block to evaluate packed into rows */
+struct pso_mixed_pool_s {
+    pso_space_t space;
+    const pso_kernels_t *kernels;
+    int reuse;              /* Keep the fitness of particles back on their pbest */
+    int dim;
+    int block;
+    int *moved;             /* Per thread: particles of a block to evaluate */
+    float *packed;          /*   their rows and fitness */
+};
+
+/* Pool over space for blocks of block particles of dimension dim on up to
+ * max_threads threads, taking over space->options also on failure. reuse
+ * allows skipping particles back on their pbest when the space is fully
+ * discrete. Return NULL on allocation failure */
+pso_mixed_pool_t *pso_mixed_pool_create(pso_space_t *space, int reuse, int dim, int block, int max_threads)
+{
+    pso_mixed_pool_t *pool = (pso_mixed_pool_t *)calloc(1, sizeof(pso_mixed_pool_t));
+
+    if (pool == NULL) {
+        free((void *)space->options);
+        return NULL;
+    }
+    pool->space = *space;
+    pool->kernels = pso_kernels;
+    pool->reuse = reuse && space->num_continuous == 0;
+    pool->dim = dim;
+    pool->block = block;
+    pool->moved = (int *)malloc((size_t)max_threads * block * sizeof(int));
+    pool->packed = (float *)malloc((size_t)max_threads * block * (dim + 1) * sizeof(float));
+    if (pool->moved == NULL || pool->packed == NULL) {
+        pso_mixed_pool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void pso_mixed_pool_destroy(pso_mixed_pool_t *pool)
+{
+    if (pool == NULL)
+        return;
+    free((void *)pool->space.options);
+    free((void *)pool->moved);
+    free((void *)pool->packed);
+    free((void *)pool);
+}
+
+/* Snap the n rows of x (and v if not NULL) to the space */
+void pso_mixed_snap(pso_mixed_pool_t *pool, float *x, float *v, int n, const pso_update_t *param)
+{
+    pool->kernels->snap(x, v, n, pool->dim, &pool->space, param);
+}
+
+/* Snap the initial swarm, which then holds its pbests, and evaluate it on
+ * num_threads threads. The evaluations are counted in swarm */
+void pso_mixed_start(pso_mixed_pool_t *pool, swarm_t *swarm, void (*eval)(const float *, int, int, float *),
+                     const pso_update_t *param, int num_threads)
+{
+    int block = pool->block, dim = pool->dim;
+    int num_blocks = (swarm->num_particles + block - 1) / block;
+
+#pragma omp parallel num_threads(num_threads)
+    {
+        int b, i, n;
+        float *fitness = pool->packed + (size_t)omp_get_thread_num() * block * (dim + 1);
+        size_t offset;
+
+        #pragma omp for schedule(static)
+        for (b = 0; b < num_blocks; b++) {
+            n = (b == num_blocks - 1) ? swarm->num_particles - b * block : block;
+            offset = (size_t)b * block * dim;
+            pso_mixed_snap(pool, swarm->x + offset, (swarm->v != NULL) ? swarm->v + offset : NULL, n, param);
+            memcpy(swarm->pbest + offset, swarm->x + offset, (size_t)n * dim * sizeof(float));
+            eval(swarm->x + offset, n, dim, fitness);
+            for (i = 0; i < n; i++)
+                swarm->particle[b * block + i].fitness = fitness[i];
+        }
+    }
+    swarm->num_evals += swarm->num_particles;
+}
+
+/* Snap the n updated particles from first on thread tid and evaluate them
+ * into fitness, under shift as pso_eval_rows does; particles back on their
+ * pbest keep its fitness if the pool reuses it. Return the evaluations
+ * skipped */
+int pso_mixed_eval(pso_mixed_pool_t *pool, int tid, swarm_t *swarm, int first, int n,
+                   void (*eval)(const float *, int, int, float *), const float *shift, const pso_update_t *param,
+                   float *tmp, float *fitness)
+{
+    int i, k, dim = pool->dim;
+    int *moved = pool->moved + (size_t)tid * pool->block;
+    float *packed = pool->packed + (size_t)tid * pool->block * (dim + 1);
+    float *packed_fitness = packed + (size_t)pool->block * dim;
+    particle_t *particle;
+
+    pso_mixed_snap(pool, swarm->x + (size_t)first * dim, (swarm->v != NULL) ? swarm->v + (size_t)first * dim : NULL,
+                   n, param);
+    if (!pool->reuse) {
+        pso_eval_rows(eval, swarm->x + (size_t)first * dim, n, dim, shift, param, tmp, fitness);
+        return 0;
+    }
+    for (i = 0, k = 0; i < n; i++) {
+        particle = &swarm->particle[first + i];
+        if (particle->fitness < INFINITY && memcmp(particle->x, particle->pbest, dim * sizeof(float)) == 0) {
+            fitness[i] = particle->fitness;
+            continue;
+        }
+        memcpy(packed + (size_t)k * dim, particle->x, dim * sizeof(float));
+        moved[k++] = i;
+    }
+    pso_eval_rows(eval, packed, k, dim, shift, param, tmp, packed_fitness);
+    for (i = 0; i < k; i++)
+        fitness[moved[i]] = packed_fitness[i];
+    return n - k;
+}
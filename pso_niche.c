@@ -0,0 +1,367 @@
+/* Species-based niching for the OpenMP engine (Li, "Adaptively choosing
+ * neighbourhood bests using species in a particle swarm optimizer for
+ * multimodal function optimization", GECCO 2004).
+ *
+ * The pbests are ranked by fitness (lowest index on ties). Going down the
+ * ranking, a pbest with no species seed within the niche radius becomes a
+ * seed; every particle then follows the best seed within the radius of its
+ * pbest, which for a seed is itself. No two seeds are within the radius of
+ * each other, and at the end of a run they are the optima found.
+ *
+ * Radius queries use a uniform hash grid with cells one radius wide over the
+ * first PSO_GRID_DIMS coordinates. Two points within the radius of each other
+ * lie in the same or adjacent cells of that projection, so a query visits
+ * 3^PSO_GRID_DIMS cells and checks the full distance of the seeds hashed to
+ * them. Only seeds are stored, so once the swarm has converged a query checks
+ * a handful of seeds whatever the species sizes. The ranking is an LSD radix
+ * sort of the fitness bits and the seed pass is serial; computing cells and
+ * assigning leaders are split over the threads.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+#include "pso.h"
+
+#define PSO_GRID_DIMS 3     /* Coordinates the grid is built over */
+
+struct pso_grid_s {
+    int num_buckets;        /* Power of two, at least twice the particles */
+    int *head;              /* Last seed hashed to each bucket, -1 if none */
+    int *next;              /* Previous seed in the same bucket */
+    int *bucket;            /* Bucket of each particle */
+    int *cell;              /* Cell coordinates of each particle */
+    int *order, *order_tmp; /* Particles ranked by fitness */
+    unsigned int *key, *key_tmp;
+    int *seed;              /* Seeds, best first; seeds are numbered in this order */
+    float *seed_x;          /* Pbests of the seeds */
+    int num_seeds;
+    int grid_dims;
+    float origin;           /* Lower corner of cell 0 */
+    float radius;
+};
+
+/* Hash of cell coordinates c is the exclusive or of the coordinates times
+ * these primes (Teschner et al., "Optimized spatial hashing for collision
+ * detection of deformable objects", VMV 2003) */
+static const unsigned int pso_grid_prime[PSO_GRID_DIMS] = { 73856093u, 19349663u, 83492791u };
+
+static int pso_grid_hash(pso_grid_t *grid, const int *c)
+{
+    unsigned int h = 0;
+    int d;
+
+    for (d = 0; d < grid->grid_dims; d++)
+        h ^= (unsigned int)c[d] * pso_grid_prime[d];
+    return (int)(h & (unsigned int)(grid->num_buckets - 1));
+}
+
+/* Unsigned key that sorts like the float f */
+static unsigned int pso_fitness_key(float f)
+{
+    unsigned int u;
+
+    memcpy(&u, &f, sizeof(u));
+    return (u & 0x80000000u) ? ~u : u ^ 0x80000000u;
+}
+
+/* Grid for up to num_particles particles of dimension dim. Return NULL on
+ * allocation failure */
+pso_grid_t *pso_grid_create(int num_particles, int dim)
+{
+    pso_grid_t *grid = (pso_grid_t *)calloc(1, sizeof(pso_grid_t));
+
+    if (grid == NULL)
+        return NULL;
+    grid->num_buckets = 1;
+    while (grid->num_buckets < 2 * num_particles)
+        grid->num_buckets *= 2;
+    grid->head = (int *)malloc(grid->num_buckets * sizeof(int));
+    grid->next = (int *)malloc(num_particles * sizeof(int));
+    grid->bucket = (int *)malloc(num_particles * sizeof(int));
+    grid->cell = (int *)malloc((size_t)num_particles * PSO_GRID_DIMS * sizeof(int));
+    grid->order = (int *)malloc(num_particles * sizeof(int));
+    grid->order_tmp = (int *)malloc(num_particles * sizeof(int));
+    grid->key = (unsigned int *)malloc(num_particles * sizeof(unsigned int));
+    grid->key_tmp = (unsigned int *)malloc(num_particles * sizeof(unsigned int));
+    grid->seed = (int *)malloc(num_particles * sizeof(int));
+    grid->seed_x = (float *)malloc((size_t)num_particles * dim * sizeof(float));
+    if (grid->head == NULL || grid->next == NULL || grid->bucket == NULL || grid->cell == NULL
+        || grid->order == NULL || grid->order_tmp == NULL || grid->key == NULL || grid->key_tmp == NULL
+        || grid->seed == NULL || grid->seed_x == NULL) {
+        pso_grid_destroy(grid);
+        return NULL;
+    }
+    return grid;
+}
+
+void pso_grid_destroy(pso_grid_t *grid)
+{
+    if (grid == NULL)
+        return;
+    free((void *)grid->head);
+    free((void *)grid->next);
+    free((void *)grid->bucket);
+    free((void *)grid->cell);
+    free((void *)grid->order);
+    free((void *)grid->order_tmp);
+    free((void *)grid->key);
+    free((void *)grid->key_tmp);
+    free((void *)grid->seed);
+    free((void *)grid->seed_x);
+    free((void *)grid);
+}
+
+/* Rank the n particles in grid->order by grid->key: a stable radix sort, one
+ * byte per pass, of particles already in index order */
+static void pso_grid_sort(pso_grid_t *grid, int n)
+{
+    int count[256], shift, pos, i, b, *order_swap;
+    unsigned int *key_swap;
+
+    for (shift = 0; shift < 32; shift += 8) {
+        memset(count, 0, sizeof(count));
+        for (i = 0; i < n; i++)
+            count[(grid->key[i] >> shift) & 255]++;
+        for (b = 0, pos = 0; b < 256; b++) {
+            i = count[b];
+            count[b] = pos;
+            pos += i;
+        }
+        for (i = 0; i < n; i++) {
+            pos = count[(grid->key[i] >> shift) & 255]++;
+            grid->order_tmp[pos] = grid->order[i];
+            grid->key_tmp[pos] = grid->key[i];
+        }
+        order_swap = grid->order; grid->order = grid->order_tmp; grid->order_tmp = order_swap;
+        key_swap = grid->key; grid->key = grid->key_tmp; grid->key_tmp = key_swap;
+    }
+}
+
+/* Number of a seed within the grid radius of x: the first one found if any
+ * is set, else the best one. Return -1 if there is none */
+static int pso_grid_search(pso_grid_t *grid, const float *x, const int *c, int dim, int any)
+{
+    static const int offset[3] = { 0, 1, -1 };  /* Own cell first */
+    unsigned int h[PSO_GRID_DIMS][3], mask = (unsigned int)(grid->num_buckets - 1);
+    int d, e, k, s, num_cells = 1, found = -1;
+    const float *q;
+    float r2 = grid->radius * grid->radius, dist, diff;
+
+    for (d = 0; d < grid->grid_dims; d++) {
+        for (e = 0; e < 3; e++)
+            h[d][e] = (unsigned int)(c[d] + offset[e]) * pso_grid_prime[d];
+        num_cells *= 3;
+    }
+    for (k = 0; k < num_cells; k++) {
+        unsigned int hash = 0;
+
+        for (d = 0, e = k; d < grid->grid_dims; d++, e /= 3)
+            hash ^= h[d][e % 3];
+        /* Seeds are chained newest first, so the better ones come last */
+        for (s = grid->head[hash & mask]; s >= 0; s = grid->next[s]) {
+            if (found >= 0 && s >= found)
+                continue;
+            q = grid->seed_x + (size_t)s * dim;
+            for (d = 0, dist = 0.0f; d < dim && dist <= r2; d++) {
+                diff = x[d] - q[d];
+                dist += diff * diff;
+            }
+            if (dist <= r2) {
+                found = s;
+                if (any)
+                    return found;
+            }
+        }
+    }
+    return found;
+}
+
+/* Rank the pbests of swarm and pick the species seeds, with cells radius wide
+ * starting at origin. Called by every thread of a parallel region */
+void pso_grid_build(pso_grid_t *grid, swarm_t *swarm, float origin, float radius)
+{
+    int b, i, d, pos, n = swarm->num_particles, dim = swarm->dim;
+    int *c;
+
+    #pragma omp single
+    {
+        grid->grid_dims = (dim < PSO_GRID_DIMS) ? dim : PSO_GRID_DIMS;
+        grid->origin = origin;
+        grid->radius = radius;
+    }
+    #pragma omp for schedule(static) nowait
+    for (b = 0; b < grid->num_buckets; b++)
+        grid->head[b] = -1;
+    #pragma omp for schedule(static)
+    for (i = 0; i < n; i++) {
+        c = grid->cell + (size_t)i * PSO_GRID_DIMS;
+        for (d = 0; d < grid->grid_dims; d++)
+            c[d] = (int)floorf((swarm->pbest[(size_t)i * dim + d] - origin) / radius);
+        grid->bucket[i] = pso_grid_hash(grid, c);
+        grid->key[i] = pso_fitness_key(swarm->particle[i].fitness);
+        grid->order[i] = i;
+    }
+
+    #pragma omp single
+    {
+        pso_grid_sort(grid, n);
+        grid->num_seeds = 0;
+        for (pos = 0; pos < n; pos++) {
+            i = grid->order[pos];
+            if (pso_grid_search(grid, swarm->pbest + (size_t)i * dim, grid->cell + (size_t)i * PSO_GRID_DIMS,
+                                dim, 1) >= 0)
+                continue;
+            memcpy(grid->seed_x + (size_t)grid->num_seeds * dim, swarm->pbest + (size_t)i * dim,
+                   dim * sizeof(float));
+            grid->next[grid->num_seeds] = grid->head[grid->bucket[i]];
+            grid->head[grid->bucket[i]] = grid->num_seeds;
+            grid->seed[grid->num_seeds++] = i;
+        }
+    }
+}
+
+/* Species leader of particle i: the best ranked seed within the grid radius
+ * of its pbest */
+int pso_grid_leader(pso_grid_t *grid, swarm_t *swarm, int i)
+{
+    int dim = swarm->dim;
+
+    return grid->seed[pso_grid_search(grid, swarm->pbest + (size_t)i * dim, grid->cell + (size_t)i * PSO_GRID_DIMS,
+                                      dim, 0)];
+}
+
+/* Empty the grid for points of dimension dim, with cells radius wide
+ * starting at origin */
+void pso_grid_clear(pso_grid_t *grid, int dim, float origin, float radius)
+{
+    int b;
+
+    grid->grid_dims = (dim < PSO_GRID_DIMS) ? dim : PSO_GRID_DIMS;
+    grid->origin = origin;
+    grid->radius = radius;
+    grid->num_seeds = 0;
+    for (b = 0; b < grid->num_buckets; b++)
+        grid->head[b] = -1;
+}
+
+/* Cell coordinates of x; far cells may share a clamped coordinate, which
+ * only costs distance checks */
+static void pso_grid_cell(pso_grid_t *grid, const float *x, int *c)
+{
+    int d;
+    float cell;
+
+    for (d = 0; d < grid->grid_dims; d++) {
+        cell = floorf((x[d] - grid->origin) / grid->radius);
+        c[d] = (cell > 1e9f) ? 1000000000 : (cell < -1e9f) ? -1000000000 : (int)cell;
+    }
+}
+
+/* Insert x as seed s, which must not be in the grid. Seeds need not be
+ * numbered in order here, and the grid does not rank them */
+void pso_grid_insert(pso_grid_t *grid, int s, const float *x, int dim)
+{
+    int c[PSO_GRID_DIMS] = { 0 }, b;
+
+    pso_grid_cell(grid, x, c);
+    b = pso_grid_hash(grid, c);
+    memcpy(grid->seed_x + (size_t)s * dim, x, dim * sizeof(float));
+    grid->bucket[s] = b;
+    grid->next[s] = grid->head[b];
+    grid->head[b] = s;
+}
+
+/* Unlink seed s from its bucket */
+void pso_grid_remove(pso_grid_t *grid, int s)
+{
+    int *link = &grid->head[grid->bucket[s]];
+
+    while (*link != s)
+        link = &grid->next[*link];
+    *link = grid->next[s];
+}
+
+/* Seeds within the grid radius of x, into found (room for every seed).
+ * Return how many */
+int pso_grid_within(pso_grid_t *grid, const float *x, int dim, int *found)
+{
+    static const int offset[3] = { 0, 1, -1 };
+    unsigned int h[PSO_GRID_DIMS][3], mask = (unsigned int)(grid->num_buckets - 1);
+    int c[PSO_GRID_DIMS] = { 0 }, d, e, k, m, s, num_cells = 1, num_found = 0;
+    const float *q;
+    float r2 = grid->radius * grid->radius, dist, diff;
+
+    pso_grid_cell(grid, x, c);
+    for (d = 0; d < grid->grid_dims; d++) {
+        for (e = 0; e < 3; e++)
+            h[d][e] = (unsigned int)(c[d] + offset[e]) * pso_grid_prime[d];
+        num_cells *= 3;
+    }
+    for (k = 0; k < num_cells; k++) {
+        unsigned int hash = 0;
+
+        for (d = 0, e = k; d < grid->grid_dims; d++, e /= 3)
+            hash ^= h[d][e % 3];
+        for (s = grid->head[hash & mask]; s >= 0; s = grid->next[s]) {
+            q = grid->seed_x + (size_t)s * dim;
+            for (d = 0, dist = 0.0f; d < dim && dist <= r2; d++) {
+                diff = x[d] - q[d];
+                dist += diff * diff;
+            }
+            if (dist > r2)
+                continue;
+            /* Neighboring cells can share a bucket */
+            for (m = 0; m < num_found && found[m] != s; m++)
+                ;
+            if (m == num_found)
+                found[num_found++] = s;
+        }
+    }
+    return num_found;
+}
+
+/* Niche radius of config: config->niche_radius, or a tenth of the domain */
+float pso_niche_radius(pso_config_t *config)
+{
+    return (config->niche_radius > 0) ? config->niche_radius : 0.1f * (config->xmax - config->xmin);
+}
+
+/* Species seeds of the swarm's pbests, best first, into niche (room for all
+ * particles). Return the number of seeds, -1 on allocation failure. If
+ * timing is not NULL it receives the seconds spent building the grid and
+ * finding the leaders of all particles */
+int pso_find_niches(swarm_t *swarm, pso_config_t *config, int *niche, double *timing)
+{
+    int num_niches;
+    double start, built, done;
+    pso_grid_t *grid = pso_grid_create(swarm->num_particles, swarm->dim);
+
+    if (grid == NULL)
+        return -1;
+    start = omp_get_wtime();
+    built = start;
+#pragma omp parallel num_threads(config->num_threads)
+    {
+        int i;
+
+        pso_grid_build(grid, swarm, config->xmin, pso_niche_radius(config));
+        #pragma omp master
+        built = omp_get_wtime();
+        #pragma omp for schedule(static)
+        for (i = 0; i < swarm->num_particles; i++)
+            niche[i] = pso_grid_leader(grid, swarm, i);
+    }
+    done = omp_get_wtime();
+
+    num_niches = grid->num_seeds;
+    memcpy(niche, grid->seed, num_niches * sizeof(int));
+    pso_grid_destroy(grid);
+    if (timing != NULL) {
+        timing[0] = built - start;
+        timing[1] = done - built;
+    }
+    return num_niches;
+}
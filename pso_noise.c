@@ -0,0 +1,322 @@
+/* Noisy objectives for the OpenMP engine.
+ *
+ * The objective returns its fitness plus normal noise of standard deviation
+ * sigma, drawn from a key per particle and draw, so a run does not depend on
+ * the thread count. Every pbest keeps the mean of its samples, their number
+ * and their sum of squared deviations (Welford), and particle->fitness holds
+ * the mean. A pbest is replaced when the mean of the new position's samples
+ * is lower.
+ *
+ * With a fixed number of samples every position and initial pbest is
+ * evaluated that many times. Racing instead takes one sample of each new
+ * position, and two of each initial pbest to estimate the noise, and then
+ * resamples only the comparisons that are too close to call: those whose
+ * means are less than PSO_NOISE_Z standard errors apart, with the noise
+ * estimated from the pooled variance of all pbests. Each round gives every
+ * open comparison of a block one more sample, of the side with fewer
+ * samples, which for two points of equal variance is the allocation OCBA
+ * (Chen et al., "Simulation budget allocation for further enhancing the
+ * efficiency of ordinal optimization", DEDS 2000) makes; the rows of a round
+ * are packed into one batch objective call. A point stops at max_samples.
+ * Samples of a pbest are kept from iteration to iteration, so a good pbest
+ * soon has all it needs and only new positions are resampled. When a new
+ * gbest is picked the reduce races it against the old one the same way, one
+ * row at a time.
+ *
+ * The noise is simulated, so the noise-free fitness of every point is known
+ * from its evaluations at no cost. Each pbest comparison is checked against
+ * it to report the share decided correctly, along with the noise-free fitness
+ * of the final best pbest.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "pso.h"
+
+#define PSO_NOISE_Z 1.645f  /* Standard errors between means of a decided comparison */
+
+/* Candidates of one thread's block, padded so threads do not share cache lines */
+typedef struct pso_noise_thread_s {
+    float *packed;          /* Rows sampled in one round, block x dim */
+    float *packed_fitness;
+    float *m2;              /* Squared deviations of each position's samples */
+    float *truth;           /* Noise-free fitness of each position */
+    int *who;               /* Particle of each packed row, in the block */
+    int *side;              /* Whether each packed row is the pbest rather than the position */
+    int *n;                 /* Samples of each position */
+    long resamples;
+    long decisions;
+    long correct;
+    char pad[48];
+} pso_noise_thread_t;
+
+struct pso_noise_pool_s {
+    pso_noise_t *noise;
+    int dim;
+    int max_threads;
+    unsigned int key;
+    int *count;             /* Samples of each pbest */
+    float *m2;              /* Squared deviations of each pbest's samples */
+    float *truth;           /* Noise-free fitness of each pbest */
+    unsigned int *draws;    /* Noise drawn for each particle so far */
+    float sigma_hat;
+    pso_noise_thread_t *thread;
+};
+
+/* Noise of the next sample of particle m */
+static float pso_noise_draw(pso_noise_pool_t *pool, int m)
+{
+    float z;
+
+    pso_kernels->normal(&z, 1, pso_hash(pool->key ^ pso_hash(m)) + pool->draws[m]++);
+    return pool->noise->sigma * z;
+}
+
+/* Add sample s to a mean of n samples with squared deviations m2 */
+static void pso_noise_add(float s, float *mean, int *n, float *m2)
+{
+    float d = s - *mean;
+
+    (*n)++;
+    *mean += d / *n;
+    *m2 += d * (s - *mean);
+}
+
+/* Which side of a comparison to sample next: 0 for the position with na
+ * samples, 1 for the pbest with nb, -1 if both are at the limit */
+static int pso_noise_side(int na, int nb, int max_samples)
+{
+    if (na >= max_samples && nb >= max_samples)
+        return -1;
+    return nb < max_samples && (na >= max_samples || nb < na);
+}
+
+/* Pool for the noisy objective of noise over swarms of up to num_particles
+ * particles of dimension dim, in blocks of up to block particles on up to
+ * max_threads threads. Return NULL on allocation failure */
+pso_noise_pool_t *pso_noise_pool_create(pso_noise_t *noise, int num_particles, int block, int dim,
+                                        int max_threads, unsigned int seed)
+{
+    pso_noise_pool_t *pool = (pso_noise_pool_t *)calloc(1, sizeof(pso_noise_pool_t));
+    pso_noise_thread_t *t;
+    int i;
+
+    if (pool == NULL)
+        return NULL;
+    pool->noise = noise;
+    pool->dim = dim;
+    pool->max_threads = max_threads;
+    pool->key = pso_hash(pso_hash(seed) ^ 0x9e3779b9u);
+    pool->count = (int *)malloc(num_particles * sizeof(int));
+    pool->m2 = (float *)malloc(num_particles * sizeof(float));
+    pool->truth = (float *)malloc(num_particles * sizeof(float));
+    pool->draws = (unsigned int *)calloc(num_particles, sizeof(unsigned int));
+    pool->thread = (pso_noise_thread_t *)calloc(max_threads, sizeof(pso_noise_thread_t));
+    if (pool->count == NULL || pool->m2 == NULL || pool->truth == NULL || pool->draws == NULL
+        || pool->thread == NULL) {
+        pso_noise_pool_destroy(pool);
+        return NULL;
+    }
+    for (i = 0; i < max_threads; i++) {
+        t = &pool->thread[i];
+        t->packed = (float *)malloc((size_t)block * (dim + 3) * sizeof(float));
+        t->who = (int *)malloc(3 * block * sizeof(int));
+        if (t->packed == NULL || t->who == NULL) {
+            pso_noise_pool_destroy(pool);
+            return NULL;
+        }
+        t->packed_fitness = t->packed + (size_t)block * dim;
+        t->m2 = t->packed_fitness + block;
+        t->truth = t->m2 + block;
+        t->side = t->who + block;
+        t->n = t->side + block;
+    }
+    return pool;
+}
+
+void pso_noise_pool_destroy(pso_noise_pool_t *pool)
+{
+    int i;
+
+    if (pool == NULL)
+        return;
+    for (i = 0; pool->thread != NULL && i < pool->max_threads; i++) {
+        free((void *)pool->thread[i].packed);
+        free((void *)pool->thread[i].who);
+    }
+    free((void *)pool->thread);
+    free((void *)pool->count);
+    free((void *)pool->m2);
+    free((void *)pool->truth);
+    free((void *)pool->draws);
+    free((void *)pool);
+}
+
+/* Sample the n initial pbests from particle first on, whose fitness holds
+ * their noise-free evaluation, on thread tid */
+void pso_noise_start(pso_noise_pool_t *pool, int tid, swarm_t *swarm, int first, int n,
+                     void (*eval)(const float *, int, int, float *))
+{
+    pso_noise_thread_t *t = &pool->thread[tid];
+    int samples = (pool->noise->samples > 0) ? pool->noise->samples : 2;
+    int i, m, s;
+    particle_t *particle;
+
+    for (i = 0; i < n; i++) {
+        m = first + i;
+        particle = &swarm->particle[m];
+        pool->truth[m] = particle->fitness;
+        particle->fitness += pso_noise_draw(pool, m);
+        pool->count[m] = 1;
+        pool->m2[m] = 0.0f;
+    }
+    for (s = 1; s < samples; s++) {
+        eval(swarm->pbest + (size_t)first * pool->dim, n, pool->dim, t->packed_fitness);
+        for (i = 0; i < n; i++) {
+            m = first + i;
+            pso_noise_add(t->packed_fitness[i] + pso_noise_draw(pool, m), &swarm->particle[m].fitness,
+                          &pool->count[m], &pool->m2[m]);
+        }
+        t->resamples += n;
+    }
+}
+
+/* Sample the n new positions from particle first on, whose noise-free
+ * fitness is in fitness, on thread tid: leave the mean of their samples in
+ * fitness, resampling them and their pbests while a comparison is close */
+void pso_noise_block(pso_noise_pool_t *pool, int tid, swarm_t *swarm, int first, int n,
+                     void (*eval)(const float *, int, int, float *), float *fitness)
+{
+    pso_noise_thread_t *t = &pool->thread[tid];
+    int dim = pool->dim, max_samples = pool->noise->max_samples;
+    int i, j, k, m, s, side;
+    float se;
+    particle_t *particle;
+
+    for (i = 0; i < n; i++) {
+        t->truth[i] = fitness[i];
+        fitness[i] += pso_noise_draw(pool, first + i);
+        t->n[i] = 1;
+        t->m2[i] = 0.0f;
+    }
+    for (s = 1; s < pool->noise->samples; s++) {
+        eval(swarm->x + (size_t)first * dim, n, dim, t->packed_fitness);
+        for (i = 0; i < n; i++)
+            pso_noise_add(t->packed_fitness[i] + pso_noise_draw(pool, first + i), &fitness[i], &t->n[i], &t->m2[i]);
+        t->resamples += n;
+    }
+    if (pool->noise->samples > 0)
+        return;
+
+    /* Race: one more sample for each close comparison per round */
+    for (;;) {
+        for (i = 0, k = 0; i < n; i++) {
+            m = first + i;
+            particle = &swarm->particle[m];
+            se = pool->sigma_hat * sqrtf(1.0f / t->n[i] + 1.0f / pool->count[m]);
+            if (!(fabsf(fitness[i] - particle->fitness) < PSO_NOISE_Z * se))
+                continue;
+            side = pso_noise_side(t->n[i], pool->count[m], max_samples);
+            if (side < 0)
+                continue;
+            memcpy(t->packed + (size_t)k * dim, side ? particle->pbest : particle->x, dim * sizeof(float));
+            t->who[k] = i;
+            t->side[k++] = side;
+        }
+        if (k == 0)
+            break;
+        eval(t->packed, k, dim, t->packed_fitness);
+        for (j = 0; j < k; j++) {
+            i = t->who[j];
+            m = first + i;
+            if (t->side[j])
+                pso_noise_add(t->packed_fitness[j] + pso_noise_draw(pool, m), &swarm->particle[m].fitness,
+                              &pool->count[m], &pool->m2[m]);
+            else
+                pso_noise_add(t->packed_fitness[j] + pso_noise_draw(pool, m), &fitness[i], &t->n[i], &t->m2[i]);
+        }
+        t->resamples += k;
+    }
+}
+
+/* Record the decision whether particle m, row i of its block on thread tid,
+ * takes its new position as pbest; the samples go along with it */
+void pso_noise_decide(pso_noise_pool_t *pool, int tid, int m, int i, int accepted)
+{
+    pso_noise_thread_t *t = &pool->thread[tid];
+
+    t->decisions++;
+    t->correct += accepted ? (t->truth[i] <= pool->truth[m]) : (t->truth[i] >= pool->truth[m]);
+    if (accepted) {
+        pool->count[m] = t->n[i];
+        pool->m2[m] = t->m2[i];
+        pool->truth[m] = t->truth[i];
+    }
+}
+
+/* Race the pbest of challenger, the new best particle, against that of
+ * incumbent, the old one, on thread tid. Return the winner */
+int pso_noise_gbest(pso_noise_pool_t *pool, int tid, swarm_t *swarm,
+                    void (*eval)(const float *, int, int, float *), int incumbent, int challenger)
+{
+    pso_noise_thread_t *t = &pool->thread[tid];
+    particle_t *a = &swarm->particle[challenger], *b = &swarm->particle[incumbent];
+    int side;
+    float f, se;
+
+    if (challenger == incumbent || pool->noise->samples > 0)
+        return challenger;
+    for (;;) {
+        se = pool->sigma_hat * sqrtf(1.0f / pool->count[challenger] + 1.0f / pool->count[incumbent]);
+        if (!(fabsf(a->fitness - b->fitness) < PSO_NOISE_Z * se))
+            break;
+        side = pso_noise_side(pool->count[challenger], pool->count[incumbent], pool->noise->max_samples);
+        if (side < 0)
+            break;
+        eval(side ? b->pbest : a->pbest, 1, pool->dim, &f);
+        if (side)
+            pso_noise_add(f + pso_noise_draw(pool, incumbent), &b->fitness, &pool->count[incumbent],
+                          &pool->m2[incumbent]);
+        else
+            pso_noise_add(f + pso_noise_draw(pool, challenger), &a->fitness, &pool->count[challenger],
+                          &pool->m2[challenger]);
+        t->resamples++;
+    }
+    return (a->fitness < b->fitness) ? challenger : incumbent;
+}
+
+/* End of an iteration: collect the threads' counts and estimate the noise
+ * from the pooled variance of the pbests. Return the resamples since the
+ * last call */
+long pso_noise_end(pso_noise_pool_t *pool, swarm_t *swarm, int num_threads)
+{
+    pso_noise_thread_t *t;
+    long resamples = 0;
+    double m2 = 0.0, dof = 0.0;
+    int i;
+
+    for (i = 0; i < num_threads; i++) {
+        t = &pool->thread[i];
+        resamples += t->resamples;
+        pool->noise->decisions += t->decisions;
+        pool->noise->correct += t->correct;
+        t->resamples = t->decisions = t->correct = 0;
+    }
+    pool->noise->resamples += resamples;
+    /* In particle order, so the estimate does not depend on the thread count */
+    for (i = 0; i < swarm->num_particles; i++) {
+        m2 += pool->m2[i];
+        dof += pool->count[i] - 1;
+    }
+    pool->sigma_hat = (dof > 0) ? sqrt(m2 / dof) : 0.0f;
+    return resamples;
+}
+
+/* Report the noise estimate and the noise-free fitness of best particle g */
+void pso_noise_finish(pso_noise_pool_t *pool, int g)
+{
+    pool->noise->sigma_hat = pool->sigma_hat;
+    pool->noise->truth = pool->truth[g];
+}
@@ -0,0 +1,417 @@
+/* Buffered output of solutions.
+ *
+ * Values are written with the shortest decimal representation that reads
+ * back as the same float, so no precision is lost, and everything goes
+ * through one buffer written out with write(2) in large blocks rather than
+ * one stdio call per element. Particles can be written as text, CSV, JSON
+ * or raw binary.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include "pso.h"
+
+#define WRITER_BUFFER_SIZE (1 << 16)
+
+struct pso_writer_s {
+    int fd;
+    int close_fd;       /* fd was opened by the writer */
+    char *buf;
+    size_t len;
+    int error;
+};
+
+static const double pow10_table[23] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* Scale d by 10^k; exact operands for |k| <= 22 so the result is correctly rounded */
+static double scale10(double d, int k)
+{
+    return (k >= 0) ? d * pow10_table[k] : d / pow10_table[-k];
+}
+
+/* Whether the decimal value r, computed as m * 10^-k, reads back as the
+ * float x. When r is not exact (a division, or a product beyond 2^53), rounding it to float can
+ * differ from rounding the decimal itself only if r lands exactly halfway
+ * between two floats (the low 29 of the 53 mantissa bits are 1 followed by
+ * zeros); such digit strings are rejected so a longer one is tried */
+static int pso_round_trips(double r, int k, float x)
+{
+    uint64_t bits;
+
+    if (k > 0 || r >= 9007199254740992.0) {
+        memcpy(&bits, &r, sizeof(bits));
+        if ((bits & 0x1fffffffu) == 0x10000000u)
+            return 0;
+    }
+    return (float)r == x;
+}
+
+/* Format x into buf (at least 32 bytes) as the shortest decimal string that
+ * reads back as x. Returns the length of the string. Infinities and NaN are
+ * written as inf, -inf and nan.
+ */
+int pso_format_float(char *buf, float x)
+{
+    double d = x, scaled;
+    int p, e, k, n, num_digits, point;
+    uint64_t m = 0, limit;
+    char digits[24], *s = buf;
+
+    if (isnan(x))
+        return sprintf(buf, "nan");
+    if (isinf(x))
+        return sprintf(buf, (x < 0) ? "-inf" : "inf");
+    if (signbit(x))
+        *s++ = '-';
+    d = fabs(d);
+    if (d == 0.0) {
+        *s++ = '0';
+        *s = '\0';
+        return s - buf;
+    }
+
+    /* Fewest significant digits (at most 9, which always suffice) that
+     * round-trip. Six digits are tried first: float precision is finer than
+     * half a unit in the sixth digit, so rounding to six digits never loses a
+     * shorter representation. The decimal exponent estimate from the binary
+     * exponent may be one off and is corrected below */
+    frexp(d, &e);
+    e = (int)floor((e - 1) * 0.30102999566398120);
+    for (p = 6; p <= 9; p++) {
+        k = p - 1 - e;
+        if (k > 22 || k < -22)
+            break; /* Powers of ten no longer exact; use the C library */
+        scaled = scale10(d, k);
+        limit = (uint64_t)pow10_table[p];
+        if (scaled >= limit) {      /* log10 estimate was one too small */
+            e++;
+            p--;
+            continue;
+        }
+        m = (uint64_t)(scaled + 0.5);
+        if (m >= limit) {
+            /* Rounding carried into the next decade: the candidate is
+             * 10^(e+1), but longer ones keep the exponent of d */
+            if (pso_round_trips(scale10((double)limit, -k), k, (float)d)) {
+                m = limit / 10;
+                e++;
+                break;
+            }
+            continue;
+        }
+        if (m < limit / 10) {       /* log10 estimate was one too large */
+            e--;
+            p--;
+            continue;
+        }
+        if (pso_round_trips(scale10((double)m, -k), k, (float)d))
+            break;
+    }
+    if (p > 9 || k > 22 || k < -22) {
+        char tmp[32];
+        for (p = 1; p < 9; p++) {
+            snprintf(tmp, sizeof(tmp), "%.*g", p, d);
+            if (strtof(tmp, NULL) == (float)d)
+                break;
+        }
+        return sprintf(s, "%.*g", p, d) + (s - buf);
+    }
+
+    /* Digits of m without trailing zeros */
+    num_digits = 0;
+    for (n = 0; n < p; n++) {
+        digits[p - 1 - n] = '0' + (char)(m % 10);
+        m /= 10;
+    }
+    for (num_digits = p; num_digits > 1 && digits[num_digits - 1] == '0'; num_digits--)
+        ;
+
+    if (e >= -5 && e < 9) {
+        /* Fixed notation */
+        point = e + 1;
+        if (point <= 0) {
+            *s++ = '0';
+            *s++ = '.';
+            for (n = 0; n < -point; n++)
+                *s++ = '0';
+            for (n = 0; n < num_digits; n++)
+                *s++ = digits[n];
+        } else {
+            for (n = 0; n < num_digits || n < point; n++) {
+                if (n == point)
+                    *s++ = '.';
+                *s++ = (n < num_digits) ? digits[n] : '0';
+            }
+        }
+    } else {
+        /* Scientific notation */
+        *s++ = digits[0];
+        if (num_digits > 1) {
+            *s++ = '.';
+            for (n = 1; n < num_digits; n++)
+                *s++ = digits[n];
+        }
+        s += sprintf(s, "e%+03d", e);
+    }
+    *s = '\0';
+    return s - buf;
+}
+
+/* Open a writer on path; "-" is stdout and NULL is stderr. Returns NULL on error */
+pso_writer_t *pso_writer_open(const char *path)
+{
+    pso_writer_t *writer;
+
+    writer = (pso_writer_t *)calloc(1, sizeof(pso_writer_t));
+    if (writer == NULL)
+        return NULL;
+    writer->buf = (char *)malloc(WRITER_BUFFER_SIZE);
+    if (writer->buf == NULL) {
+        free((void *)writer);
+        return NULL;
+    }
+
+    if (path == NULL) {
+        fflush(stderr);
+        writer->fd = STDERR_FILENO;
+    } else if (strcmp(path, "-") == 0) {
+        fflush(stdout);
+        writer->fd = STDOUT_FILENO;
+    } else {
+        writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        writer->close_fd = 1;
+        if (writer->fd < 0) {
+            fprintf(stderr, "Could not open output file %s\n", path);
+            free((void *)writer->buf);
+            free((void *)writer);
+            return NULL;
+        }
+    }
+    return writer;
+}
+
+/* Write out buffered data */
+void pso_writer_flush(pso_writer_t *writer)
+{
+    size_t done = 0;
+    ssize_t n;
+
+    while (done < writer->len && !writer->error) {
+        n = write(writer->fd, writer->buf + done, writer->len - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            writer->error = 1;
+        else
+            done += n;
+    }
+    writer->len = 0;
+}
+
+/* Flush and close writer. Return 0 on success, -1 if any write failed */
+int pso_writer_close(pso_writer_t *writer)
+{
+    int status;
+
+    pso_writer_flush(writer);
+    if (writer->close_fd && close(writer->fd) < 0)
+        writer->error = 1;
+    status = writer->error ? -1 : 0;
+    free((void *)writer->buf);
+    free((void *)writer);
+    return status;
+}
+
+void pso_write_bytes(pso_writer_t *writer, const void *data, size_t len)
+{
+    const char *p = (const char *)data;
+    size_t n;
+
+    while (len > 0) {
+        if (writer->len == WRITER_BUFFER_SIZE)
+            pso_writer_flush(writer);
+        n = WRITER_BUFFER_SIZE - writer->len;
+        if (n > len)
+            n = len;
+        memcpy(writer->buf + writer->len, p, n);
+        writer->len += n;
+        p += n;
+        len -= n;
+    }
+}
+
+void pso_write_str(pso_writer_t *writer, const char *s)
+{
+    pso_write_bytes(writer, s, strlen(s));
+}
+
+void pso_write_float(pso_writer_t *writer, float x)
+{
+    if (writer->len + 32 > WRITER_BUFFER_SIZE)
+        pso_writer_flush(writer);
+    writer->len += pso_format_float(writer->buf + writer->len, x);
+}
+
+void pso_write_int(pso_writer_t *writer, long x)
+{
+    if (writer->len + 32 > WRITER_BUFFER_SIZE)
+        pso_writer_flush(writer);
+    writer->len += sprintf(writer->buf + writer->len, "%ld", x);
+}
+
+/* Write n values separated by sep; JSON has no inf or nan so they become null */
+static void pso_write_vector(pso_writer_t *writer, const float *x, int n, const char *sep, int json)
+{
+    int j;
+
+    for (j = 0; j < n; j++) {
+        if (j > 0)
+            pso_write_str(writer, sep);
+        if (json && !isfinite(x[j]))
+            pso_write_str(writer, "null");
+        else
+            pso_write_float(writer, x[j]);
+    }
+}
+
+/* Write particle in the given format */
+void pso_write_particle(pso_writer_t *writer, particle_t *particle, pso_format_t format)
+{
+    int32_t header[2];
+    int i;
+    float zero = 0.0f;
+
+    switch (format) {
+    case PSO_FORMAT_TEXT:
+        pso_write_str(writer, "position: ");
+        pso_write_vector(writer, particle->x, particle->dim, " ", 0);
+        if (particle->v != NULL) {
+            pso_write_str(writer, "\nvelocity: ");
+            pso_write_vector(writer, particle->v, particle->dim, " ", 0);
+        }
+        pso_write_str(writer, "\npbest: ");
+        pso_write_vector(writer, particle->pbest, particle->dim, " ", 0);
+        pso_write_str(writer, "\nfitness: ");
+        pso_write_float(writer, particle->fitness);
+        pso_write_str(writer, "\ng: ");
+        pso_write_int(writer, particle->g);
+        pso_write_str(writer, "\n");
+        break;
+
+    case PSO_FORMAT_CSV:
+        /* One row per vector, field name first */
+        pso_write_str(writer, "position,");
+        pso_write_vector(writer, particle->x, particle->dim, ",", 0);
+        if (particle->v != NULL) {
+            pso_write_str(writer, "\nvelocity,");
+            pso_write_vector(writer, particle->v, particle->dim, ",", 0);
+        }
+        pso_write_str(writer, "\npbest,");
+        pso_write_vector(writer, particle->pbest, particle->dim, ",", 0);
+        pso_write_str(writer, "\nfitness,");
+        pso_write_float(writer, particle->fitness);
+        pso_write_str(writer, "\ng,");
+        pso_write_int(writer, particle->g);
+        pso_write_str(writer, "\n");
+        break;
+
+    case PSO_FORMAT_JSON:
+        pso_write_str(writer, "{\"fitness\":");
+        pso_write_vector(writer, &particle->fitness, 1, "", 1);
+        pso_write_str(writer, ",\"g\":");
+        pso_write_int(writer, particle->g);
+        pso_write_str(writer, ",\"dim\":");
+        pso_write_int(writer, particle->dim);
+        pso_write_str(writer, ",\"position\":[");
+        pso_write_vector(writer, particle->x, particle->dim, ",", 1);
+        if (particle->v != NULL) {
+            pso_write_str(writer, "],\"velocity\":[");
+            pso_write_vector(writer, particle->v, particle->dim, ",", 1);
+        }
+        pso_write_str(writer, "],\"pbest\":[");
+        pso_write_vector(writer, particle->pbest, particle->dim, ",", 1);
+        pso_write_str(writer, "]}\n");
+        break;
+
+    case PSO_FORMAT_BINARY:
+        /* "PSO1", int32 dim, int32 g, float32 fitness, then dim float32 each of
+         * position, velocity (zero without velocities) and pbest, all in host
+         * byte order */
+        pso_write_bytes(writer, "PSO1", 4);
+        header[0] = particle->dim;
+        header[1] = particle->g;
+        pso_write_bytes(writer, header, sizeof(header));
+        pso_write_bytes(writer, &particle->fitness, sizeof(float));
+        pso_write_bytes(writer, particle->x, particle->dim * sizeof(float));
+        if (particle->v != NULL)
+            pso_write_bytes(writer, particle->v, particle->dim * sizeof(float));
+        for (i = 0; particle->v == NULL && i < particle->dim; i++)
+            pso_write_bytes(writer, &zero, sizeof(float));
+        pso_write_bytes(writer, particle->pbest, particle->dim * sizeof(float));
+        break;
+    }
+}
+
+/* Parse format name. Return 0 on success, -1 if unknown */
+int pso_parse_format(const char *name, pso_format_t *format)
+{
+    if (strcmp(name, "text") == 0)
+        *format = PSO_FORMAT_TEXT;
+    else if (strcmp(name, "csv") == 0)
+        *format = PSO_FORMAT_CSV;
+    else if (strcmp(name, "json") == 0)
+        *format = PSO_FORMAT_JSON;
+    else if (strcmp(name, "binary") == 0)
+        *format = PSO_FORMAT_BINARY;
+    else
+        return -1;
+    return 0;
+}
+
+/* Write the solution of a run to the configured destination. Return 0 on
+ * success, -1 otherwise */
+int pso_write_solution(pso_config_t *config, particle_t *particle)
+{
+    pso_writer_t *writer;
+
+    if (config->output_path == NULL && config->output_format == PSO_FORMAT_TEXT)
+        fprintf(stderr, "Solution:\n");
+    writer = pso_writer_open(config->output_path);
+    if (writer == NULL)
+        return -1;
+    pso_write_particle(writer, particle, config->output_format);
+    return pso_writer_close(writer);
+}
+
+/* Write n particles one after another in the format of config; text output
+ * numbers them under the given label */
+int pso_write_solutions(pso_config_t *config, particle_t *particle, int n, const char *label)
+{
+    int i;
+    pso_writer_t *writer;
+
+    writer = pso_writer_open(config->output_path);
+    if (writer == NULL)
+        return -1;
+    for (i = 0; i < n; i++) {
+        if (config->output_format == PSO_FORMAT_TEXT) {
+            pso_write_str(writer, label);
+            pso_write_str(writer, " ");
+            pso_write_int(writer, i + 1);
+            pso_write_str(writer, " of ");
+            pso_write_int(writer, n);
+            pso_write_str(writer, ":\n");
+        }
+        pso_write_particle(writer, &particle[i], config->output_format);
+    }
+    return pso_writer_close(writer);
+}
@@ -0,0 +1,243 @@
+/* Core-partitioning scheduler for concurrent optimizations in one process.
+ *
+ * Every running optimization holds a slot. The cores of the process are
+ * divided among the active slots in proportion to their weights, every slot
+ * getting at least one core, and each slot owns a contiguous range of them.
+ * Shares are recomputed whenever a slot joins or leaves. The OpenMP engine
+ * asks for its share at the start of every iteration and pins its threads to
+ * the slot's cores, so jobs never oversubscribe the machine and pick up the
+ * cores of jobs that finish.
+ *
+ * A serial optimization, such as the reference engine, holds a serial slot:
+ * exactly one core, which the others' shares leave out. Its thread is not
+ * pinned; the other slots' threads are, so the spare core is where it runs.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include "pso.h"
+
+struct pso_sched_slot_s {
+    pso_sched_t *sched;
+    unsigned long id;           /* Unique slot identifier */
+    int weight;
+    int serial;                 /* Exactly one core, whatever the weights */
+    int quota;                  /* Cores beyond the first, while rebalancing */
+    int first_core;             /* Cores [first_core, first_core + num_cores) */
+    int num_cores;
+    unsigned long epoch;        /* Rebalance that last changed this slot's cores */
+    double thread_iters;        /* Sum of threads over iterations run */
+    int iters;
+    struct pso_sched_slot_s *next;
+};
+
+struct pso_sched_s {
+    pthread_mutex_t lock;
+    int num_cores;
+    int *cpu;                   /* CPU number of each core index */
+    cpu_set_t allowed;          /* Affinity of unpinned threads */
+    pso_sched_slot_t *active;   /* Active slots in join order */
+    unsigned long epoch;
+};
+
+/* Slot identifiers, unique across the schedulers of the process so pooled
+ * threads never mistake a new slot for the one they are pinned to */
+static unsigned long pso_sched_ids = 0;
+
+/* Core assignment the calling thread is pinned to; 0 if unpinned */
+static __thread unsigned long pinned_slot = 0, pinned_epoch = 0;
+
+/* Create scheduler for num_cores cores, taken from the CPUs this process may
+ * run on. Returns NULL on error */
+pso_sched_t *pso_sched_create(int num_cores)
+{
+    int i, n;
+    cpu_set_t allowed;
+    pso_sched_t *sched;
+
+    sched = (pso_sched_t *)calloc(1, sizeof(pso_sched_t));
+    if (sched == NULL)
+        return NULL;
+    sched->cpu = (int *)malloc(num_cores * sizeof(int));
+    if (sched->cpu == NULL) {
+        free((void *)sched);
+        return NULL;
+    }
+
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0)
+        for (i = 0; i < num_cores && i < CPU_SETSIZE; i++)
+            CPU_SET(i, &allowed);
+    for (i = 0, n = 0; i < CPU_SETSIZE && n < num_cores; i++)
+        if (CPU_ISSET(i, &allowed))
+            sched->cpu[n++] = i;
+    for (i = 0; n < num_cores; n++, i++)   /* More cores asked for than the process may use */
+        sched->cpu[n] = sched->cpu[i];
+
+    sched->allowed = allowed;
+    sched->num_cores = num_cores;
+    pthread_mutex_init(&sched->lock, NULL);
+    return sched;
+}
+
+void pso_sched_destroy(pso_sched_t *sched)
+{
+    if (sched == NULL)
+        return;
+    pthread_mutex_destroy(&sched->lock);
+    free((void *)sched->cpu);
+    free((void *)sched);
+}
+
+/* Divide cores among active slots. Caller holds sched->lock */
+static void pso_sched_rebalance(pso_sched_t *sched)
+{
+    int num_slots = 0, total_weight = 0, spare, given, first;
+    double rest, best_rest;
+    pso_sched_slot_t *slot, *best;
+
+    for (slot = sched->active; slot != NULL; slot = slot->next) {
+        num_slots++;
+        if (!slot->serial)
+            total_weight += slot->weight;
+    }
+    if (num_slots == 0)
+        return;
+    sched->epoch++;
+
+    /* One core each, the spare cores by weight using largest remainders;
+     * serial slots take no spare cores */
+    spare = (sched->num_cores > num_slots && total_weight > 0) ? sched->num_cores - num_slots : 0;
+    given = 0;
+    for (slot = sched->active; slot != NULL; slot = slot->next) {
+        slot->quota = slot->serial ? 0 : spare * slot->weight / total_weight;
+        given += slot->quota;
+    }
+    while (given < spare) {
+        best = NULL;
+        best_rest = -1.0;
+        for (slot = sched->active; slot != NULL; slot = slot->next) {
+            if (slot->serial)
+                continue;
+            rest = (double)spare * slot->weight / total_weight - slot->quota;
+            if (rest > best_rest) {
+                best_rest = rest;
+                best = slot;
+            }
+        }
+        best->quota++;
+        given++;
+    }
+
+    /* Contiguous core ranges in join order; with more slots than cores the
+     * ranges wrap around and cores are shared */
+    first = 0;
+    for (slot = sched->active; slot != NULL; slot = slot->next) {
+        if (slot->num_cores != 1 + slot->quota || slot->first_core != first % sched->num_cores)
+            slot->epoch = sched->epoch;
+        slot->num_cores = 1 + slot->quota;
+        slot->first_core = first % sched->num_cores;
+        first += slot->num_cores;
+    }
+}
+
+/* Register an optimization with the given weight, or a serial one holding
+ * a single core if weight is 0. Returns NULL on error */
+pso_sched_slot_t *pso_sched_join(pso_sched_t *sched, int weight)
+{
+    pso_sched_slot_t *slot, **tail;
+
+    slot = (pso_sched_slot_t *)calloc(1, sizeof(pso_sched_slot_t));
+    if (slot == NULL)
+        return NULL;
+    slot->sched = sched;
+    slot->weight = (weight > 0) ? weight : 1;
+    slot->serial = (weight == 0);
+    slot->id = __atomic_add_fetch(&pso_sched_ids, 1, __ATOMIC_RELAXED);
+
+    pthread_mutex_lock(&sched->lock);
+    for (tail = &sched->active; *tail != NULL; tail = &(*tail)->next)
+        ;
+    *tail = slot;
+    pso_sched_rebalance(sched);
+    pthread_mutex_unlock(&sched->lock);
+    return slot;
+}
+
+/* Give the slot's cores back to the other optimizations and free it */
+void pso_sched_leave(pso_sched_slot_t *slot)
+{
+    pso_sched_t *sched;
+    pso_sched_slot_t **link;
+
+    if (slot == NULL)
+        return;
+    sched = slot->sched;
+    pthread_mutex_lock(&sched->lock);
+    for (link = &sched->active; *link != NULL; link = &(*link)->next)
+        if (*link == slot) {
+            *link = slot->next;
+            break;
+        }
+    pso_sched_rebalance(sched);
+    pthread_mutex_unlock(&sched->lock);
+    free((void *)slot);
+}
+
+/* Number of threads the slot may run for the next iteration, with the first
+ * core and the epoch of that assignment for pso_sched_pin. Called once per
+ * iteration outside of the parallel region */
+int pso_sched_threads(pso_sched_slot_t *slot, int *first_core, unsigned long *epoch)
+{
+    int num_cores;
+
+    pthread_mutex_lock(&slot->sched->lock);
+    num_cores = slot->num_cores;
+    *first_core = slot->first_core;
+    *epoch = slot->epoch;
+    pthread_mutex_unlock(&slot->sched->lock);
+
+    slot->thread_iters += num_cores;
+    slot->iters++;
+    return num_cores;
+}
+
+/* Restrict the calling thread to the cores of the assignment returned by
+ * pso_sched_threads; a no-op unless the thread's assignment changed. Called
+ * by every thread of the parallel region */
+void pso_sched_pin(pso_sched_slot_t *slot, int first_core, int num_cores, unsigned long epoch)
+{
+    int i;
+    cpu_set_t cores;
+    pso_sched_t *sched = slot->sched;
+
+    if (pinned_slot == slot->id && pinned_epoch == epoch)
+        return;
+
+    CPU_ZERO(&cores);
+    for (i = 0; i < num_cores; i++)
+        CPU_SET(sched->cpu[(first_core + i) % sched->num_cores], &cores);
+    pthread_setaffinity_np(pthread_self(), sizeof(cores), &cores);
+    pinned_slot = slot->id;
+    pinned_epoch = epoch;
+}
+
+/* Let the calling thread run on all cores again if it is pinned to the
+ * slot. Called by the threads of a solve before the slot is left */
+void pso_sched_unpin(pso_sched_slot_t *slot)
+{
+    if (pinned_slot != slot->id)
+        return;
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &slot->sched->allowed);
+    pinned_slot = 0;
+    pinned_epoch = 0;
+}
+
+/* Mean number of threads the slot ran its iterations on */
+float pso_sched_mean_threads(pso_sched_slot_t *slot)
+{
+    return (slot->iters > 0) ? slot->thread_iters / slot->iters : (float)slot->num_cores;
+}
@@ -0,0 +1,404 @@
+/* Optimizer daemon serving requests over a Unix domain socket.
+ *
+ * The worker threads and their swarm storage are created once at startup, so
+ * a request only pays for the optimization itself. Clients send one JSON
+ * object per line:
+ *
+ *   {"op": "run", "id": "r1", "function": "rastrigin", "dim": 30, ...,
+ *    "progress_every": 100}
+ *      Queue an optimization; the remaining fields are those of a batch job
+ *      spec. With progress_every > 0 a progress line
+ *      {"id": "r1", "event": "progress", "iter": 100, "fitness": ...,
+ *       "diversity": ..., "fitness_mean": ..., "fitness_sd": ...}
+ *      is streamed every progress_every iterations, with the best fitness
+ *      and the swarm statistics of that iteration (see pso_stats_t).
+ *   {"op": "cancel", "id": "r1"}
+ *      Cancel a queued or running request of this connection.
+ *
+ * Each request ends with one result line in the format of the batch runner,
+ * with "error": "cancelled" for cancelled requests. Requests of all
+ * connections run concurrently, up to one per core, and share the cores in
+ * proportion to their "weight" fields.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <omp.h>
+#include "pso.h"
+
+/* Client connection; freed when the reader and all of its requests are done */
+typedef struct serve_conn_s {
+    int fd;
+    int refs;                   /* Reader plus requests not yet answered */
+    int closed;                 /* Client hung up or a send failed; cancel its requests. Set under
+                                 * lock, read atomically by the workers */
+    pthread_mutex_t lock;       /* Serializes writes and refs */
+} serve_conn_t;
+
+/* Queued or running request */
+typedef struct serve_request_s {
+    pso_job_t job;
+    serve_conn_t *conn;
+    int progress_every;
+    pso_stats_t stats;          /* Swarm statistics for progress lines */
+    int cancelled;
+    double submitted;           /* Time the request was queued */
+    struct serve_request_s *next;
+} serve_request_t;
+
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static serve_request_t *queue_head = NULL, *queue_tail = NULL;
+static serve_request_t **running_slot;      /* Request of each worker */
+static int num_workers;
+static pso_sched_t *sched;                  /* Divides cores among running requests */
+static unsigned int num_served = 0;         /* Requests of all connections, for default seeds */
+
+/* Send a complete line to the client, ignoring clients that went away */
+static void serve_send(serve_conn_t *conn, const char *buf, size_t len)
+{
+    ssize_t n;
+
+    pthread_mutex_lock(&conn->lock);
+    while (len > 0 && !conn->closed) {
+        n = send(conn->fd, buf, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            __atomic_store_n(&conn->closed, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        buf += n;
+        len -= n;
+    }
+    pthread_mutex_unlock(&conn->lock);
+}
+
+static void serve_release(serve_conn_t *conn)
+{
+    int refs;
+
+    pthread_mutex_lock(&conn->lock);
+    refs = --conn->refs;
+    pthread_mutex_unlock(&conn->lock);
+    if (refs == 0) {
+        close(conn->fd);
+        pthread_mutex_destroy(&conn->lock);
+        free((void *)conn);
+    }
+}
+
+/* Send result line of a finished request */
+static void serve_reply(serve_request_t *request)
+{
+    char *buf = NULL;
+    size_t len = 0;
+    FILE *fp = open_memstream(&buf, &len);
+
+    if (fp == NULL)
+        return;
+    pso_print_job(fp, &request->job);
+    fclose(fp);
+    serve_send(request->conn, buf, len);
+    free((void *)buf);
+}
+
+/* Send an event line {"id": id, ...rest} to the client */
+static void serve_event(serve_conn_t *conn, const char *id, const char *format, ...)
+{
+    char *buf = NULL;
+    size_t len = 0;
+    va_list args;
+    FILE *fp = open_memstream(&buf, &len);
+
+    if (fp == NULL)
+        return;
+    fprintf(fp, "{\"id\":");
+    pso_json_string(fp, id);
+    va_start(args, format);
+    vfprintf(fp, format, args);
+    va_end(args);
+    fprintf(fp, "}\n");
+    fclose(fp);
+    serve_send(conn, buf, len);
+    free((void *)buf);
+}
+
+/* Progress hook: stream progress and stop cancelled requests */
+static int serve_progress(void *arg, int iter, int g, swarm_t *swarm)
+{
+    serve_request_t *request = (serve_request_t *)arg;
+
+    if (__atomic_load_n(&request->cancelled, __ATOMIC_RELAXED)
+        || __atomic_load_n(&request->conn->closed, __ATOMIC_RELAXED))
+        return 1;
+    if (request->progress_every > 0 && iter % request->progress_every == 0)
+        serve_event(request->conn, request->job.id, ",\"event\":\"progress\",\"iter\":%d,\"fitness\":%.9g,"
+                    "\"diversity\":%.6g,\"fitness_mean\":%.9g,\"fitness_sd\":%.6g", iter, swarm->particle[g].fitness,
+                    request->stats.diversity, request->stats.fitness_mean, sqrt(request->stats.fitness_var));
+    return 0;
+}
+
+/* Worker: take requests off the queue and run them on this worker's swarm */
+static void *serve_worker(void *arg)
+{
+    int worker = (int)(long)arg;
+    swarm_t *arena;
+    serve_request_t *request;
+    pso_progress_t progress;
+    double start;
+
+    arena = pso_alloc(NULL, 10, 1000, 1); /* Preallocate for typical requests; grows on demand */
+
+    for (;;) {
+        pthread_mutex_lock(&queue_lock);
+        while (queue_head == NULL)
+            pthread_cond_wait(&queue_cond, &queue_lock);
+        request = queue_head;
+        queue_head = request->next;
+        if (queue_head == NULL)
+            queue_tail = NULL;
+        running_slot[worker] = request;
+        pthread_mutex_unlock(&queue_lock);
+
+        start = omp_get_wtime();
+        if (request->job.status == 0 && !__atomic_load_n(&request->cancelled, __ATOMIC_RELAXED)
+            && !__atomic_load_n(&request->conn->closed, __ATOMIC_RELAXED)) {
+            progress.callback = serve_progress;
+            progress.arg = request;
+            progress.stats = (request->progress_every > 0) ? &request->stats : NULL;
+            progress.stats_every = request->progress_every;
+            progress.elite = NULL;
+            progress.dynamic = NULL;
+            progress.noise = NULL;
+            request->stats.centroid = NULL;
+            /* The reference engine is serial and holds a single core */
+            request->job.config.slot = pso_sched_join(sched, (request->job.config.engine == PSO_ENGINE_OMP)
+                                                             ? request->job.weight : 0);
+            pso_run_job(&request->job, &arena, &progress);
+            pso_sched_leave(request->job.config.slot);
+            request->job.config.slot = NULL;
+        }
+        if (__atomic_load_n(&request->cancelled, __ATOMIC_RELAXED)
+            || __atomic_load_n(&request->conn->closed, __ATOMIC_RELAXED)) {
+            request->job.status = -1;
+            snprintf(request->job.error, sizeof(request->job.error), "cancelled");
+        }
+
+        pthread_mutex_lock(&queue_lock);
+        running_slot[worker] = NULL;
+        pthread_mutex_unlock(&queue_lock);
+
+        serve_reply(request);
+        fprintf(stderr, "Request %s: %s, queued %.3fms, ran %.3fms\n", request->job.id,
+                (request->job.status == 0) ? "ok" : request->job.error,
+                (start - request->submitted) * 1e3, (omp_get_wtime() - start) * 1e3);
+        free((void *)request->job.position);
+        serve_release(request->conn);
+        free((void *)request);
+    }
+    return NULL;
+}
+
+/* Mark the matching queued or running requests of conn as cancelled.
+ * Return number of requests found */
+static int serve_cancel(serve_conn_t *conn, const char *id)
+{
+    int i, found = 0;
+    serve_request_t *request;
+
+    pthread_mutex_lock(&queue_lock);
+    for (request = queue_head; request != NULL; request = request->next)
+        if (request->conn == conn && strcmp(request->job.id, id) == 0) {
+            request->cancelled = 1;
+            found++;
+        }
+    for (i = 0; i < num_workers; i++) {
+        request = running_slot[i];
+        if (request != NULL && request->conn == conn && strcmp(request->job.id, id) == 0) {
+            __atomic_store_n(&request->cancelled, 1, __ATOMIC_RELAXED);
+            found++;
+        }
+    }
+    pthread_mutex_unlock(&queue_lock);
+    return found;
+}
+
+/* Wait until the requests of conn are answered or the client hangs up */
+static void serve_linger(serve_conn_t *conn)
+{
+    struct pollfd pfd;
+    int pending;
+
+    pfd.fd = conn->fd;
+    pfd.events = 0;
+    for (;;) {
+        pthread_mutex_lock(&conn->lock);
+        pending = conn->refs > 1 && !conn->closed;
+        pthread_mutex_unlock(&conn->lock);
+        if (!pending)
+            break;
+        if (poll(&pfd, 1, 100) > 0 && (pfd.revents & (POLLHUP | POLLERR))) {
+            pthread_mutex_lock(&conn->lock);
+            __atomic_store_n(&conn->closed, 1, __ATOMIC_RELAXED);
+            pthread_mutex_unlock(&conn->lock);
+            break;
+        }
+    }
+}
+
+/* Reader: parse requests of one connection */
+static void *serve_connection(void *arg)
+{
+    serve_conn_t *conn = (serve_conn_t *)arg;
+    FILE *fp;
+    char *line = NULL, key[64], value[256], op[16];
+    const char *p;
+    size_t line_len = 0;
+    int status, num_requests = 0;
+    serve_request_t *request;
+
+    fp = fdopen(dup(conn->fd), "r");
+    while (fp != NULL && getline(&line, &line_len, fp) != -1) {
+        request = (serve_request_t *)calloc(1, sizeof(serve_request_t));
+        if (request == NULL)
+            break;
+        pso_job_defaults(&request->job);
+
+        /* Daemon fields are handled here, the rest is a job spec */
+        op[0] = '\0';
+        p = line;
+        while ((status = pso_json_next(&p, key, sizeof(key), value, sizeof(value))) > 0) {
+            if (strcmp(key, "op") == 0)
+                snprintf(op, sizeof(op), "%.15s", value);
+            else if (strcmp(key, "progress_every") == 0)
+                request->progress_every = atoi(value);
+            else if (pso_job_set(&request->job, key, value) < 0)
+                break;
+        }
+        if (status < 0)
+            snprintf(request->job.error, sizeof(request->job.error), "malformed request");
+
+        if (strcmp(op, "cancel") == 0) {
+            if (serve_cancel(conn, request->job.id) == 0)
+                serve_event(conn, request->job.id, ",\"status\":\"error\",\"error\":\"no such request\"");
+            free((void *)request);
+        } else if (strcmp(op, "run") == 0) {
+            if (status == 0 && request->job.error[0] == '\0')
+                pso_job_check(&request->job);
+            request->job.index = num_requests++;
+            if (!request->job.seeded)
+                request->job.config.seed += __atomic_fetch_add(&num_served, 1, __ATOMIC_RELAXED);
+            request->conn = conn;
+            request->submitted = omp_get_wtime();
+
+            pthread_mutex_lock(&conn->lock);
+            conn->refs++;
+            pthread_mutex_unlock(&conn->lock);
+
+            pthread_mutex_lock(&queue_lock);
+            if (queue_tail != NULL)
+                queue_tail->next = request;
+            else
+                queue_head = request;
+            queue_tail = request;
+            pthread_cond_signal(&queue_cond);
+            pthread_mutex_unlock(&queue_lock);
+        } else {
+            serve_event(conn, request->job.id, ",\"status\":\"error\",\"error\":\"unknown op\"");
+            free((void *)request);
+        }
+    }
+    free((void *)line);
+    if (fp != NULL)
+        fclose(fp);
+
+    /* End of requests. A client that only shut down its write side still
+     * waits for its results, so cancel them only once it hangs up */
+    serve_linger(conn);
+    serve_release(conn);
+    return NULL;
+}
+
+/* Serve requests on config->serve_path with config->num_threads workers.
+ * Only returns on error */
+int pso_serve(pso_config_t *config)
+{
+    int fd, client, i;
+    struct sockaddr_un addr;
+    pthread_t thread;
+    serve_conn_t *conn;
+
+    if (strlen(config->serve_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long\n");
+        return -1;
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, config->serve_path);
+    unlink(config->serve_path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 64) < 0) {
+        perror(config->serve_path);
+        close(fd);
+        return -1;
+    }
+
+    num_workers = config->num_threads;
+    running_slot = (serve_request_t **)calloc(num_workers, sizeof(serve_request_t *));
+    sched = pso_sched_create(config->num_threads);
+    if (running_slot == NULL || sched == NULL) {
+        fprintf(stderr, "Malloc error\n");
+        return -1;
+    }
+    for (i = 0; i < num_workers; i++) {
+        if (pthread_create(&thread, NULL, serve_worker, (void *)(long)i) != 0) {
+            fprintf(stderr, "Could not create worker thread\n");
+            return -1;
+        }
+        pthread_detach(thread);
+    }
+    fprintf(stderr, "Serving on %s with %d workers\n", config->serve_path, num_workers);
+
+    for (;;) {
+        client = accept(fd, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("accept");
+            break;
+        }
+        conn = (serve_conn_t *)calloc(1, sizeof(serve_conn_t));
+        if (conn == NULL) {
+            close(client);
+            continue;
+        }
+        conn->fd = client;
+        conn->refs = 1;
+        pthread_mutex_init(&conn->lock, NULL);
+        if (pthread_create(&thread, NULL, serve_connection, conn) != 0) {
+            close(client);
+            pthread_mutex_destroy(&conn->lock);
+            free((void *)conn);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+
+    close(fd);
+    unlink(config->serve_path);
+    return -1;
+}
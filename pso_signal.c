@@ -0,0 +1,425 @@
+/* Live statistics, snapshots, graceful stop and checkpoints of a single run.
+ *
+ * Long runs of the OpenMP engine can be watched and stopped from outside:
+ *
+ *   pso_top            list the running solves with their live statistics
+ *   kill -USR1 <pid>   print the best solution so far and the progress
+ *   kill -INT <pid>    (or Ctrl-C, or SIGTERM) finish the current iteration,
+ *                      write the result as usual and a checkpoint
+ *
+ * After every iteration the solver publishes its progress into a pso_live_t
+ * page: iteration, evaluations and their rate, best fitness and position,
+ * the diversity of the swarm and how busy its threads were (the share of
+ * their time not spent waiting at the barrier after the evaluate pass). The
+ * rates cover windows of a second. The page is the shared memory object
+ * /pso.<pid> (/dev/shm/pso.<pid>) when it can be created, and is removed at
+ * exit, also when the process is killed by a second stop signal, SIGPIPE or
+ * a crash (pso_top removes the pages of processes killed otherwise). It is
+ * written under a sequence lock: the count is odd while the
+ * solver writes, and readers copy the page and retry if the count moved, so
+ * the solver never waits for a reader and takes no lock.
+ *
+ * The three signals are blocked in every thread before the first parallel
+ * region, so the OpenMP team inherits the mask, and a monitor thread takes
+ * them with sigwait(); apart from removing the page and the metrics file on
+ * fatal signals, nothing runs in signal handler context. A stop request is a
+ * flag in the page the solver reads at the end of the iteration. A second
+ * SIGINT or SIGTERM ends the process at once. With --metrics the monitor
+ * also rewrites a Prometheus textfile (for the node exporter's textfile
+ * collector) from the page every --metrics-every seconds; it is written once
+ * more at exit with pso_running 0, and removed if the process is killed.
+ *
+ * A checkpoint holds the whole swarm state after the last completed
+ * iteration: "PSOK", the run's function, dimension, swarm size, bounds,
+ * seed and variant, the iteration count, g and the evaluation counts, then
+ * the fitness of every particle and the position, velocity (if the variant
+ * keeps them) and pbest matrices, all in host byte order. Random numbers are
+ * keyed by seed, iteration and particle, so --resume with the same options
+ * continues the run exactly where it stopped (CLPSO redraws its exemplars).
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include "pso.h"
+
+#define PSO_LIVE_WINDOW 1.0     /* Seconds per window of the rates */
+
+/* Checkpoint header */
+typedef struct pso_checkpoint_s {
+    char magic[4];
+    char function[32];
+    unsigned long long expr;    /* Hash of the --expr text, 0 for registered functions */
+    int dim;
+    int num_particles;
+    int velocity;
+    int variant;
+    float xmin, xmax;
+    unsigned int seed;
+    int num_iters;
+    int g;
+    long num_evals;
+    long num_skipped;
+} pso_checkpoint_t;
+
+static pso_live_t *pso_live = NULL;
+static size_t pso_live_size;
+static char pso_live_name[32];          /* Shared memory object, empty if private */
+static const char *pso_metrics_path;
+static int pso_metrics_every;
+static pthread_mutex_t pso_metrics_lock = PTHREAD_MUTEX_INITIALIZER;     /* Monitor against exit */
+
+/* Seconds since the epoch */
+double pso_live_clock(void)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return now.tv_sec + now.tv_usec * 1e-6;
+}
+
+/* Copy a consistent snapshot of live, including the best position when x is
+ * not NULL, into copy */
+static void pso_live_read(const pso_live_t *live, pso_live_t *copy, float *x)
+{
+    unsigned int before, after;
+
+    do {
+        before = __atomic_load_n(&live->seq, __ATOMIC_ACQUIRE);
+        memcpy(copy, live, sizeof(pso_live_t));
+        if (x != NULL)
+            memcpy(x, live->x, live->dim * sizeof(float));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&live->seq, __ATOMIC_RELAXED);
+    } while ((before & 1) || before != after);
+}
+
+/* Write the page to the Prometheus textfile path, replacing it atomically;
+ * running is 0 for the final export at exit */
+static void pso_live_export(const pso_live_t *live, const char *path, int running)
+{
+    static const struct { const char *name, *type, *help; } metric[] = {
+        { "pso_iteration", "gauge", "Iterations completed." },
+        { "pso_max_iterations", "gauge", "Iterations the run is set to." },
+        { "pso_evaluations_total", "counter", "Objective evaluations." },
+        { "pso_evaluations_per_second", "gauge", "Evaluation rate over the last second." },
+        { "pso_best_fitness", "gauge", "Best fitness found." },
+        { "pso_diversity", "gauge", "RMS distance of the positions to their centroid." },
+        { "pso_thread_busy_ratio", "gauge", "Share of thread time not spent waiting at the barrier." },
+        { "pso_threads", "gauge", "Threads of the solver." },
+        { "pso_start_time_seconds", "gauge", "Start of the run since the epoch." },
+        { "pso_running", "gauge", "1 while the run is in progress, 0 once it has exited." }
+    };
+    pso_live_t copy;
+    double value[10];
+    char tmp[4096];
+    FILE *fp;
+    int k;
+
+    pso_live_read(live, &copy, NULL);
+    value[0] = copy.iter;
+    value[1] = copy.max_iter;
+    value[2] = copy.num_evals;
+    value[3] = copy.evals_per_sec;
+    value[4] = copy.fitness;
+    value[5] = copy.diversity;
+    value[6] = copy.busy;
+    value[7] = copy.num_threads;
+    value[8] = copy.start;
+    value[9] = running;
+    pthread_mutex_lock(&pso_metrics_lock);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    fp = fopen(tmp, "w");
+    if (fp == NULL) {
+        pthread_mutex_unlock(&pso_metrics_lock);
+        return;
+    }
+    for (k = 0; k < 10; k++) {
+        fprintf(fp, "# HELP %s %s\n# TYPE %s %s\n", metric[k].name, metric[k].help, metric[k].name, metric[k].type);
+        fprintf(fp, "%s{pid=\"%d\",function=\"%s\"} %.17g\n", metric[k].name, copy.pid, copy.function, value[k]);
+    }
+    if (fclose(fp) == 0)
+        rename(tmp, path);
+    else
+        unlink(tmp);
+    pthread_mutex_unlock(&pso_metrics_lock);
+}
+
+/* Remove the shared page and the metrics file of a process about to die */
+static void pso_live_remove(void)
+{
+    if (pso_live_name[0] != '\0')
+        shm_unlink(pso_live_name);
+    if (pso_metrics_path != NULL)
+        unlink(pso_metrics_path);
+}
+
+/* Fatal signals: remove the page and the metrics file, then die of the
+ * signal as before (the handler is reset on entry) */
+static void pso_live_fatal(int sig)
+{
+    pso_live_remove();
+    raise(sig);
+}
+
+/* Monitor thread: serve the signals blocked in the solver threads and export
+ * the metrics */
+static void *pso_live_monitor(void *arg)
+{
+    pso_live_t *live = (pso_live_t *)arg;
+    pso_live_t copy;
+    float *x;
+    struct timespec every;
+    sigset_t set;
+    char num[32];
+    int sig, d;
+
+    x = (float *)malloc(live->dim * sizeof(float));
+    every.tv_sec = pso_metrics_every;
+    every.tv_nsec = 0;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    for (;;) {
+        if (pso_metrics_path != NULL) {
+            sig = sigtimedwait(&set, NULL, &every);
+            if (sig < 0) {
+                if (errno == EAGAIN)
+                    pso_live_export(live, pso_metrics_path, 1);
+                continue;
+            }
+        } else if (sigwait(&set, &sig) != 0) {
+            continue;
+        }
+        if (sig != SIGUSR1) {
+            if (__atomic_exchange_n(&live->stop, 1, __ATOMIC_RELAXED)) {
+                fprintf(stderr, "Stopping now\n");
+                pso_live_remove();
+                _exit(128 + sig);
+            }
+            fprintf(stderr, "Stopping after the current iteration (again to stop now)\n");
+            continue;
+        }
+        if (x == NULL)
+            continue;
+        pso_live_read(live, &copy, x);
+        if (copy.time == 0) {
+            fprintf(stderr, "Snapshot: initializing\n");
+            continue;
+        }
+        fprintf(stderr, "Snapshot: iteration %d of %d, %ld evaluations in %.3fs (%.0f/s), best fitness %.9g\n",
+                copy.iter, copy.max_iter, copy.num_evals, copy.time - copy.start, copy.evals_per_sec, copy.fitness);
+        fprintf(stderr, "position:");
+        for (d = 0; d < copy.dim; d++) {
+            pso_format_float(num, x[d]);
+            fprintf(stderr, " %s", num);
+        }
+        fprintf(stderr, "\n");
+    }
+    return NULL;
+}
+
+/* At exit: export the final statistics and remove the shared page */
+static void pso_live_exit(void)
+{
+    if (pso_metrics_path != NULL)
+        pso_live_export(pso_live, pso_metrics_path, 0);
+    if (pso_live_name[0] != '\0')
+        shm_unlink(pso_live_name);
+}
+
+/* Create the live page of config's run, route SIGUSR1, SIGINT and SIGTERM
+ * to a monitor thread and make the solve publish into the page. Call before
+ * the first parallel region. Return 0 on success, -1 otherwise */
+int pso_live_start(pso_config_t *config)
+{
+    static const int fatal[] = { SIGPIPE, SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+    struct sigaction action;
+    pthread_t thread;
+    sigset_t set;
+    int fd, k;
+
+    pso_live_size = sizeof(pso_live_t) + config->dim * sizeof(float);
+    snprintf(pso_live_name, sizeof(pso_live_name), "/pso.%d", (int)getpid());
+    fd = shm_open(pso_live_name, O_CREAT | O_TRUNC | O_RDWR, 0644);
+    if (fd >= 0 && ftruncate(fd, pso_live_size) == 0)
+        pso_live = (pso_live_t *)mmap(NULL, pso_live_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (fd >= 0)
+        close(fd);
+    if (pso_live == NULL || pso_live == MAP_FAILED) {
+        /* No shared memory: keep the page private */
+        if (fd >= 0)
+            shm_unlink(pso_live_name);
+        pso_live_name[0] = '\0';
+        pso_live = (pso_live_t *)calloc(1, pso_live_size);
+        if (pso_live == NULL)
+            return -1;
+    }
+    pso_live->version = PSO_LIVE_VERSION;
+    pso_live->pid = getpid();
+    snprintf(pso_live->function, sizeof(pso_live->function), "%s", config->function);
+    pso_live->dim = config->dim;
+    pso_live->swarm_size = config->swarm_size;
+    pso_live->num_threads = config->num_threads;
+    pso_live->max_iter = config->max_iter;
+    pso_live->diversity = NAN;
+    pso_live->start = pso_live->window_time = pso_live_clock();
+    pso_metrics_path = config->metrics_path;
+    pso_metrics_every = (config->metrics_every > 0) ? config->metrics_every : 10;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(pso_live->magic, "PSOL", 4);
+    atexit(pso_live_exit);
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = pso_live_fatal;
+    action.sa_flags = SA_RESETHAND;
+    sigemptyset(&action.sa_mask);
+    for (k = 0; k < (int)(sizeof(fatal) / sizeof(fatal[0])); k++)
+        sigaction(fatal[k], &action, NULL);
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    if (pthread_sigmask(SIG_BLOCK, &set, NULL) != 0
+        || pthread_create(&thread, NULL, pso_live_monitor, pso_live) != 0) {
+        pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+        return -1;
+    }
+    pthread_detach(thread);
+    config->live = pso_live;
+    return 0;
+}
+
+/* Publish the state of swarm, whose best particle is g, after an iteration
+ * run by num_threads threads that worked for work and waited at the barrier
+ * for wait thread-seconds. stats, if not NULL, holds the swarm statistics of
+ * the iteration. Return nonzero if the run should stop */
+int pso_live_publish(pso_live_t *live, swarm_t *swarm, int g, int num_threads, const pso_stats_t *stats,
+                     double work, double wait)
+{
+    unsigned int seq = live->seq;
+    double now = pso_live_clock();
+
+    __atomic_store_n(&live->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    live->num_threads = num_threads;
+    live->iter = swarm->num_iters;
+    live->num_evals = swarm->num_evals;
+    live->fitness = swarm->particle[g].fitness;
+    if (stats != NULL)
+        live->diversity = stats->diversity;
+    live->time = now;
+    live->window_work += work;
+    live->window_wait += wait;
+    if (now - live->window_time >= PSO_LIVE_WINDOW || live->evals_per_sec == 0) {
+        live->evals_per_sec = (swarm->num_evals - live->window_evals) / (now - live->window_time);
+        if (live->window_work + live->window_wait > 0)
+            live->busy = live->window_work / (live->window_work + live->window_wait);
+        live->window_time = now;
+        live->window_evals = swarm->num_evals;
+        live->window_work = live->window_wait = 0.0;
+    }
+    memcpy(live->x, swarm->particle[g].pbest, live->dim * sizeof(float));
+    __atomic_store_n(&live->seq, seq + 2, __ATOMIC_RELEASE);
+    return __atomic_load_n(&live->stop, __ATOMIC_RELAXED);
+}
+
+/* Write the state of config's swarm to path. Return 0 on success, -1
+ * otherwise */
+int pso_checkpoint_write(const char *path, swarm_t *swarm, pso_config_t *config)
+{
+    pso_checkpoint_t header;
+    size_t size = (size_t)swarm->num_particles * swarm->dim;
+    FILE *fp;
+    int i, ok;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "PSOK", 4);
+    snprintf(header.function, sizeof(header.function), "%s", config->function);
+    header.expr = (config->expr != NULL) ? pso_expr_hash(config->expr) : 0;
+    header.dim = swarm->dim;
+    header.num_particles = swarm->num_particles;
+    header.velocity = (swarm->v != NULL);
+    header.variant = config->variant;
+    header.xmin = config->xmin;
+    header.xmax = config->xmax;
+    header.seed = config->seed;
+    header.num_iters = swarm->num_iters;
+    header.g = swarm->particle[0].g;
+    header.num_evals = swarm->num_evals;
+    header.num_skipped = swarm->num_skipped;
+
+    fp = fopen(path, "wb");
+    if (fp == NULL)
+        return -1;
+    ok = (fwrite(&header, sizeof(header), 1, fp) == 1);
+    for (i = 0; ok && i < swarm->num_particles; i++)
+        ok = (fwrite(&swarm->particle[i].fitness, sizeof(float), 1, fp) == 1);
+    ok = ok && fwrite(swarm->x, sizeof(float), size, fp) == size;
+    ok = ok && (swarm->v == NULL || fwrite(swarm->v, sizeof(float), size, fp) == size);
+    ok = ok && fwrite(swarm->pbest, sizeof(float), size, fp) == size;
+    return (fclose(fp) == 0 && ok) ? 0 : -1;
+}
+
+/* Load the checkpoint at path into swarm, allocated for config's run.
+ * Return 0 on success, -1 if it cannot be read or was written by a run with
+ * other options */
+int pso_checkpoint_read(const char *path, swarm_t *swarm, pso_config_t *config)
+{
+    pso_checkpoint_t header;
+    size_t size = (size_t)swarm->num_particles * swarm->dim;
+    FILE *fp;
+    int i, ok;
+
+    fp = fopen(path, "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "Could not open checkpoint %s\n", path);
+        return -1;
+    }
+    if (fread(&header, sizeof(header), 1, fp) != 1 || memcmp(header.magic, "PSOK", 4) != 0) {
+        fprintf(stderr, "%s is not a checkpoint\n", path);
+        fclose(fp);
+        return -1;
+    }
+    if (header.expr != ((config->expr != NULL) ? pso_expr_hash(config->expr) : 0)) {
+        fprintf(stderr, "Checkpoint %s is of another expression; resume with the same --expr\n", path);
+        fclose(fp);
+        return -1;
+    }
+    if (strncmp(header.function, config->function, sizeof(header.function)) != 0 || header.dim != swarm->dim
+        || header.num_particles != swarm->num_particles || header.velocity != (swarm->v != NULL)
+        || header.variant != (int)config->variant || header.xmin != config->xmin || header.xmax != config->xmax
+        || header.seed != config->seed) {
+        fprintf(stderr, "Checkpoint %s is of %s %d, %d particles in [%g, %g], seed %u; resume with the same options\n",
+                path, header.function, header.dim, header.num_particles, header.xmin, header.xmax, header.seed);
+        fclose(fp);
+        return -1;
+    }
+    ok = (header.g >= 0 && header.g < header.num_particles);
+    for (i = 0; ok && i < swarm->num_particles; i++) {
+        ok = (fread(&swarm->particle[i].fitness, sizeof(float), 1, fp) == 1);
+        swarm->particle[i].g = header.g;
+    }
+    ok = ok && fread(swarm->x, sizeof(float), size, fp) == size;
+    ok = ok && (swarm->v == NULL || fread(swarm->v, sizeof(float), size, fp) == size);
+    ok = ok && fread(swarm->pbest, sizeof(float), size, fp) == size;
+    fclose(fp);
+    if (!ok) {
+        fprintf(stderr, "Checkpoint %s is truncated\n", path);
+        return -1;
+    }
+    swarm->num_iters = header.num_iters;
+    swarm->num_evals = header.num_evals;
+    swarm->num_skipped = header.num_skipped;
+    return 0;
+}
@@ -0,0 +1,143 @@
+/* List the running optimizations and their live statistics.
+ *
+ *   ./pso_top [-1] [-d seconds]
+ *
+ * Every pso process running the OpenMP engine publishes a statistics page
+ * in the shared memory object /pso.<pid> (see pso_signal.c). pso_top maps
+ * the pages it finds in /dev/shm read-only, takes a consistent copy of each
+ * under its sequence lock and prints one line per run, refreshing every
+ * two seconds (-d to change) or once with -1. Pages of a different version
+ * are skipped; those of processes that no longer exist, killed before they
+ * could remove them, are removed.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include "pso.h"
+
+#define PSO_TOP_DIR "/dev/shm"
+
+/* Copy page into copy, retrying while the solver writes it. Return 0 on
+ * success, -1 if the solver kept writing */
+static int top_read(const pso_live_t *page, pso_live_t *copy)
+{
+    unsigned int before, after;
+    int tries;
+
+    for (tries = 0; tries < 1000; tries++) {
+        before = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+        memcpy(copy, page, sizeof(pso_live_t));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&page->seq, __ATOMIC_RELAXED);
+        if (!(before & 1) && before == after)
+            return 0;
+    }
+    return -1;
+}
+
+/* Read the page /dev/shm/name into copy. Return 0 on success, -1 if it is
+ * not the page of a running solve */
+static int top_page(const char *name, pso_live_t *copy)
+{
+    char path[300];
+    struct stat st;
+    void *page;
+    int fd, status;
+
+    snprintf(path, sizeof(path), "%s/%s", PSO_TOP_DIR, name);
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(pso_live_t)) {
+        close(fd);
+        return -1;
+    }
+    page = mmap(NULL, sizeof(pso_live_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED)
+        return -1;
+    status = top_read((const pso_live_t *)page, copy);
+    munmap(page, sizeof(pso_live_t));
+    if (status < 0 || memcmp(copy->magic, "PSOL", 4) != 0 || copy->version != PSO_LIVE_VERSION)
+        return -1;
+    /* Remove pages left behind by killed processes */
+    if (kill(copy->pid, 0) < 0 && errno == ESRCH) {
+        unlink(path);
+        return -1;
+    }
+    return 0;
+}
+
+/* Print one line per running solve. Return the number of solves */
+static int top_list(void)
+{
+    DIR *dir;
+    struct dirent *entry;
+    struct timeval tv;
+    pso_live_t live;
+    double now;
+    int n = 0;
+
+    dir = opendir(PSO_TOP_DIR);
+    if (dir == NULL) {
+        fprintf(stderr, "Could not open %s\n", PSO_TOP_DIR);
+        return -1;
+    }
+    gettimeofday(&tv, NULL);
+    now = tv.tv_sec + tv.tv_usec * 1e-6;
+    printf("%8s %-14s %6s %7s %3s %17s %12s %14s %10s %6s %9s %6s\n", "PID", "FUNCTION", "D", "N", "THR",
+           "ITERATION", "EVALS/S", "BEST", "DIVERSITY", "BUSY%", "ELAPSED", "AGE");
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "pso.", 4) != 0 || top_page(entry->d_name, &live) < 0)
+            continue;
+        printf("%8d %-14.14s %6d %7d %3d %8d/%-8d %12.4g %14.8g %10.4g %6.1f %8.1fs %5.1fs\n", live.pid,
+               live.function, live.dim, live.swarm_size, live.num_threads, live.iter, live.max_iter,
+               live.evals_per_sec, live.fitness, live.diversity, 100.0 * live.busy,
+               ((live.time > 0) ? live.time : now) - live.start, (live.time > 0) ? now - live.time : 0.0);
+        n++;
+    }
+    closedir(dir);
+    return n;
+}
+
+int main(int argc, char **argv)
+{
+    int once = 0, opt, n;
+    double delay = 2.0;
+
+    while ((opt = getopt(argc, argv, "1d:h")) != -1) {
+        switch (opt) {
+        case '1': once = 1; break;
+        case 'd': delay = atof(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-1] [-d seconds]\n", argv[0]);
+            fprintf(stderr, "  -1          print the running optimizations once and exit\n");
+            fprintf(stderr, "  -d SECONDS  refresh interval (default 2)\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (delay <= 0)
+        delay = 2.0;
+    for (;;) {
+        if (!once)
+            printf("\033[H\033[2J");
+        n = top_list();
+        if (n < 0)
+            exit(EXIT_FAILURE);
+        if (once)
+            break;
+        printf("%d running\n", n);
+        fflush(stdout);
+        usleep((useconds_t)(delay * 1e6));
+    }
+    exit(EXIT_SUCCESS);
+}
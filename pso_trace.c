@@ -0,0 +1,154 @@
+/* Timeline tracer for the PSO solver threads.
+ *
+ * Each thread records complete ("X") events for the solver phases into its
+ * own buffer, so recording needs no locking. Only every Nth iteration is
+ * recorded to bound overhead and file size on long runs. At the end of the
+ * run the buffers are written out as a Chrome trace JSON file that can be
+ * opened in Perfetto or chrome://tracing.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "pso.h"
+
+/* One recorded event */
+typedef struct trace_event_s {
+    double start;       /* Start time in microseconds since pso_trace_init */
+    double duration;    /* Duration in microseconds */
+    int phase;          /* Solver phase */
+    int iter;           /* Iteration the event belongs to */
+} trace_event_t;
+
+/* Per-thread event buffer, padded to keep threads off each other's cache lines */
+typedef struct trace_buffer_s {
+    trace_event_t *events;
+    int num_events;
+    int capacity;
+    double open[PSO_NUM_PHASES];  /* Start time of currently open phases */
+    char pad[64];
+} trace_buffer_t;
+
+static const char *phase_names[PSO_NUM_PHASES] = {
+    "update", "evaluate", "reduce", "broadcast", "barrier wait", "niche search", "elite archive"
+};
+
+int pso_trace_on = 0;                   /* Record events for the current iteration */
+static int trace_enabled = 0;           /* Tracer initialized */
+static int trace_every = 1;             /* Sampling interval in iterations */
+static int trace_iter = 0;              /* Current iteration */
+static int trace_num_threads = 0;
+static double trace_t0;
+static char *trace_path = NULL;
+static trace_buffer_t *trace_buffers = NULL;
+
+/* Set up per-thread buffers. Return 0 on success, -1 otherwise */
+int pso_trace_init(const char *path, int num_threads, int sample_every)
+{
+    if (path == NULL || num_threads < 1)
+        return -1;
+
+    trace_buffers = (trace_buffer_t *)calloc(num_threads, sizeof(trace_buffer_t));
+    trace_path = strdup(path);
+    if (trace_buffers == NULL || trace_path == NULL) {
+        fprintf(stderr, "Malloc error\n");
+        return -1;
+    }
+
+    trace_num_threads = num_threads;
+    trace_every = (sample_every > 0) ? sample_every : 1;
+    trace_t0 = omp_get_wtime();
+    trace_enabled = 1;
+    return 0;
+}
+
+/* Mark start of iteration; enables recording on sampled iterations.
+ * Must be called outside of a parallel region.
+ */
+void pso_trace_iter(int iter)
+{
+    trace_iter = iter;
+    pso_trace_on = trace_enabled && (iter % trace_every == 0);
+}
+
+void pso_trace_begin(int phase)
+{
+    int tid = omp_get_thread_num();
+    if (tid >= trace_num_threads)
+        return;
+    trace_buffers[tid].open[phase] = (omp_get_wtime() - trace_t0) * 1e6;
+}
+
+void pso_trace_end(int phase)
+{
+    int tid = omp_get_thread_num();
+    trace_buffer_t *buffer;
+    trace_event_t *event;
+    double now;
+
+    if (tid >= trace_num_threads)
+        return;
+
+    now = (omp_get_wtime() - trace_t0) * 1e6;
+    buffer = &trace_buffers[tid];
+    if (buffer->num_events == buffer->capacity) {
+        int capacity = (buffer->capacity > 0) ? 2 * buffer->capacity : 1024;
+        trace_event_t *events = (trace_event_t *)realloc(buffer->events, capacity * sizeof(trace_event_t));
+        if (events == NULL)
+            return; /* Drop the event rather than disturb the run */
+        buffer->events = events;
+        buffer->capacity = capacity;
+    }
+
+    event = &buffer->events[buffer->num_events++];
+    event->start = buffer->open[phase];
+    event->duration = now - buffer->open[phase];
+    event->phase = phase;
+    event->iter = trace_iter;
+}
+
+/* Write recorded events as Chrome trace JSON and release the buffers.
+ * Return 0 on success, -1 otherwise
+ */
+int pso_trace_finish(void)
+{
+    int i, j, first;
+    FILE *fp;
+    trace_event_t *event;
+
+    if (!trace_enabled)
+        return 0;
+    trace_enabled = 0;
+    pso_trace_on = 0;
+
+    fp = fopen(trace_path, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "Could not open trace file %s\n", trace_path);
+    } else {
+        fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        first = 1;
+        for (i = 0; i < trace_num_threads; i++) {
+            if (trace_buffers[i].num_events == 0)
+                continue;   /* Thread not used by the solve */
+            fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"solver %d\"}}",
+                    first ? "" : ",\n", i, i);
+            first = 0;
+            for (j = 0; j < trace_buffers[i].num_events; j++) {
+                event = &trace_buffers[i].events[j];
+                fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"iter\":%d}}",
+                        phase_names[event->phase], i, event->start, event->duration, event->iter);
+            }
+        }
+        fprintf(fp, "\n]}\n");
+        fclose(fp);
+    }
+
+    for (i = 0; i < trace_num_threads; i++)
+        free((void *)trace_buffers[i].events);
+    free((void *)trace_buffers);
+    free((void *)trace_path);
+    trace_buffers = NULL;
+    trace_path = NULL;
+    return (fp == NULL) ? -1 : 0;
+}
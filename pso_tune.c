@@ -0,0 +1,424 @@
+/* Automatic configuration by racing (F-race).
+ *
+ * The candidates are job specs, one per line as for --jobs, that solve the
+ * same problem (function, dimension and domain) with different parameters:
+ * swarm size and iterations, variant and topology, inertia and pulls,
+ * opposition. Following Birattari, Stuetzle, Paquete and Varrentrapp, "A
+ * racing algorithm for configuring metaheuristics", GECCO 2002, every
+ * surviving candidate is run on one instance after another, instance k
+ * being the run with seed + k, and ranked on each by the best fitness it
+ * found. From the fifth instance on, a Friedman test on the ranks checks
+ * whether the survivors differ; if they do at level 0.05, every candidate
+ * whose rank sum falls behind the best by more than the critical difference
+ * of the Conover post-hoc test is dropped. The race ends when one candidate
+ * is left or the budget of runs is spent, and the survivor with the lowest
+ * rank sum wins. Survivors thus get more runs the longer they last, and
+ * clear losers cost only the first few instances.
+ *
+ * The runs go through the batch runner (see pso_run_batch), so they share
+ * the cores like jobs. To keep the cores busy when few candidates are left,
+ * a batch holds as many instances as it takes to give every core a run, and
+ * the tests are then applied one instance at a time as if the runs had been
+ * made in order; runs of candidates dropped before their instance are
+ * discarded. The outcome therefore does not depend on the number of cores,
+ * only the discarded runs do. The winner is written as a job spec that
+ * pso --config loads.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+#include "pso.h"
+
+#define PSO_RACE_FIRST_TEST 5   /* Instances before the first test */
+#define PSO_RACE_ALPHA 0.05     /* Significance level of the tests */
+
+/* Regularized lower incomplete gamma function P(a, x) */
+static double pso_gamma_p(double a, double x)
+{
+    double sum, term, b, c, d, h, an;
+    int n;
+
+    if (x <= 0)
+        return 0.0;
+    if (x < a + 1) {
+        /* Series */
+        term = sum = 1.0 / a;
+        for (n = 1; n < 500 && fabs(term) > fabs(sum) * 1e-15; n++) {
+            term *= x / (a + n);
+            sum += term;
+        }
+        return sum * exp(-x + a * log(x) - lgamma(a));
+    }
+    /* Continued fraction for Q(a, x) */
+    b = x + 1 - a;
+    c = 1e300;
+    d = 1.0 / b;
+    h = d;
+    for (n = 1; n < 500; n++) {
+        an = -n * (n - a);
+        b += 2;
+        d = an * d + b;
+        d = (fabs(d) < 1e-300) ? 1e-300 : d;
+        c = b + an / c;
+        c = (fabs(c) < 1e-300) ? 1e-300 : c;
+        d = 1.0 / d;
+        h *= d * c;
+        if (fabs(d * c - 1) < 1e-15)
+            break;
+    }
+    return 1.0 - exp(-x + a * log(x) - lgamma(a)) * h;
+}
+
+/* Continued fraction of the regularized incomplete beta function */
+static double pso_beta_cf(double a, double b, double x)
+{
+    double c = 1.0, d = 1.0 - (a + b) * x / (a + 1), h, aa;
+    int m;
+
+    d = 1.0 / ((fabs(d) < 1e-300) ? 1e-300 : d);
+    h = d;
+    for (m = 1; m < 500; m++) {
+        aa = m * (b - m) * x / ((a + 2 * m - 1) * (a + 2 * m));
+        d = 1.0 + aa * d;
+        d = 1.0 / ((fabs(d) < 1e-300) ? 1e-300 : d);
+        c = 1.0 + aa / c;
+        c = (fabs(c) < 1e-300) ? 1e-300 : c;
+        h *= d * c;
+        aa = -(a + m) * (a + b + m) * x / ((a + 2 * m) * (a + 2 * m + 1));
+        d = 1.0 + aa * d;
+        d = 1.0 / ((fabs(d) < 1e-300) ? 1e-300 : d);
+        c = 1.0 + aa / c;
+        c = (fabs(c) < 1e-300) ? 1e-300 : c;
+        h *= d * c;
+        if (fabs(d * c - 1) < 1e-15)
+            break;
+    }
+    return h;
+}
+
+/* Regularized incomplete beta function I_x(a, b) */
+static double pso_beta_i(double a, double b, double x)
+{
+    double front;
+
+    if (x <= 0)
+        return 0.0;
+    if (x >= 1)
+        return 1.0;
+    front = exp(lgamma(a + b) - lgamma(a) - lgamma(b) + a * log(x) + b * log(1 - x));
+    if (x < (a + 1) / (a + b + 2))
+        return front * pso_beta_cf(a, b, x) / a;
+    return 1.0 - front * pso_beta_cf(b, a, 1 - x) / b;
+}
+
+/* Quantile p > 0.5 of Student's t distribution with dof degrees of freedom */
+static double pso_t_quantile(double p, double dof)
+{
+    double lo = 0.0, hi = 1e3, t;
+    int n;
+
+    for (n = 0; n < 100; n++) {
+        t = 0.5 * (lo + hi);
+        if (1.0 - 0.5 * pso_beta_i(dof / 2, 0.5, dof / (dof + t * t)) < p)
+            lo = t;
+        else
+            hi = t;
+    }
+    return 0.5 * (lo + hi);
+}
+
+/* Ranks of the m costs of one instance, ties sharing their mean rank */
+static void pso_rank(const double *cost, int m, double *rank)
+{
+    int i, j, below, equal;
+
+    for (i = 0; i < m; i++) {
+        below = equal = 0;
+        for (j = 0; j < m; j++) {
+            below += cost[j] < cost[i];
+            equal += cost[j] == cost[i];
+        }
+        rank[i] = below + (equal + 1) / 2.0;
+    }
+}
+
+/* Rank sums in sum of the m candidates alive[] over instances 0 to k - 1 of
+ * cost (candidate-major, stride instances). Return the sum of squared ranks */
+static double pso_rank_sums(const double *cost, int stride, const int *alive, int m, int k, double *sum,
+                            double *column, double *rank)
+{
+    double squares = 0.0;
+    int i, c;
+
+    for (c = 0; c < m; c++)
+        sum[c] = 0.0;
+    for (i = 0; i < k; i++) {
+        for (c = 0; c < m; c++)
+            column[c] = cost[(size_t)alive[c] * stride + i];
+        pso_rank(column, m, rank);
+        for (c = 0; c < m; c++) {
+            sum[c] += rank[c];
+            squares += rank[c] * rank[c];
+        }
+    }
+    return squares;
+}
+
+/* Friedman test of the m candidates alive[] over k instances, and Conover's
+ * post-hoc comparisons with the best. Keep the survivors in alive and return
+ * how many there are */
+static int pso_race_test(const double *cost, int stride, int *alive, int m, int k, double *sum,
+                         double *column, double *rank)
+{
+    double squares, c, t_stat, dev = 0.0, p, crit, best;
+    int i, n;
+
+    squares = pso_rank_sums(cost, stride, alive, m, k, sum, column, rank);
+    c = k * m * (m + 1.0) * (m + 1.0) / 4;
+    if (squares - c <= 0)
+        return m;   /* All tied */
+    for (i = 0; i < m; i++)
+        dev += (sum[i] - k * (m + 1.0) / 2) * (sum[i] - k * (m + 1.0) / 2);
+    t_stat = (m - 1) * dev / (squares - c);
+    p = 1.0 - pso_gamma_p((m - 1) / 2.0, t_stat / 2);
+    if (!(p < PSO_RACE_ALPHA))
+        return m;
+    crit = pso_t_quantile(1 - PSO_RACE_ALPHA / 2, (k - 1.0) * (m - 1))
+           * sqrt(2 * k * (1 - t_stat / (k * (m - 1.0))) * (squares - c) / ((k - 1.0) * (m - 1)));
+    best = sum[0];
+    for (i = 1; i < m; i++)
+        best = (sum[i] < best) ? sum[i] : best;
+    for (i = 0, n = 0; i < m; i++)
+        if (sum[i] - best <= crit)
+            alive[n++] = alive[i];
+    return n;
+}
+
+/* Write the configuration of job as a job spec */
+static void pso_write_spec(FILE *fp, pso_job_t *job)
+{
+    pso_config_t *config = &job->config;
+
+    fprintf(fp, "{\"id\":");
+    pso_json_string(fp, job->id);
+    fprintf(fp, ",\"function\":");
+    pso_json_string(fp, config->function);
+    fprintf(fp, ",\"dim\":%d,\"swarm_size\":%d,\"xmin\":%.9g,\"xmax\":%.9g,\"max_iter\":%d,\"engine\":\"%s\"",
+            config->dim, config->swarm_size, config->xmin, config->xmax, config->max_iter,
+            (config->engine == PSO_ENGINE_GOLD) ? "gold" : "omp");
+    if (config->variant == PSO_VARIANT_FIPS)
+        fprintf(fp, ",\"variant\":\"fips\",\"topology\":\"%s\"",
+                (config->topology == PSO_TOPOLOGY_LATTICE) ? "lattice" : "ring");
+    else
+        fprintf(fp, ",\"variant\":\"%s\"", pso_variant_name(config));
+    if (config->inertia > 0)
+        fprintf(fp, ",\"inertia\":%.9g", config->inertia);
+    if (config->c1 > 0)
+        fprintf(fp, ",\"c1\":%.9g", config->c1);
+    if (config->c2 > 0)
+        fprintf(fp, ",\"c2\":%.9g", config->c2);
+    if (config->opposition)
+        fprintf(fp, ",\"opposition\":%.9g", config->jump_rate);
+    if (config->niche_radius > 0)
+        fprintf(fp, ",\"niche_radius\":%.9g", config->niche_radius);
+    fprintf(fp, "}\n");
+}
+
+/* Race the candidate job specs of config->tune_path on config->num_threads
+ * cores for at most config->tune_budget runs and write the winner to
+ * config->tune_out. Return 0 on success, -1 otherwise */
+int pso_tune(pso_config_t *config)
+{
+    pso_job_t *cand, *jobs = NULL;
+    int m, i, j, c, k, q, n, num_alive, stride = 0, used = 0, discarded = 0, batch_alive, winner;
+    int budget, *alive = NULL, *dropped = NULL;
+    double *cost = NULL, *sum = NULL, *column = NULL, *rank = NULL, start, busy = 0.0, ran, best;
+    FILE *fp;
+
+    cand = pso_read_jobs(config->tune_path, &m);
+    if (cand == NULL)
+        return -1;
+    for (c = 0; c < m; c++) {
+        if (cand[c].status < 0) {
+            fprintf(stderr, "Candidate %d: %s\n", c + 1, cand[c].error);
+            free((void *)cand);
+            return -1;
+        }
+        if (strcmp(cand[c].config.function, cand[0].config.function) != 0 || cand[c].config.dim != cand[0].config.dim
+            || cand[c].config.xmin != cand[0].config.xmin || cand[c].config.xmax != cand[0].config.xmax) {
+            fprintf(stderr, "Candidate %d solves a different problem than candidate 1\n", c + 1);
+            free((void *)cand);
+            return -1;
+        }
+        if (cand[c].id[0] == '\0')
+            snprintf(cand[c].id, sizeof(cand[c].id), "%d", c + 1);
+    }
+    if (m < 2) {
+        fprintf(stderr, "Racing needs at least two candidates\n");
+        free((void *)cand);
+        return -1;
+    }
+    budget = (config->tune_budget > 0) ? config->tune_budget : 20 * m;
+    alive = (int *)malloc(m * sizeof(int));
+    dropped = (int *)malloc(m * sizeof(int));
+    sum = (double *)malloc(3 * m * sizeof(double));
+    if (alive == NULL || dropped == NULL || sum == NULL) {
+        fprintf(stderr, "Malloc error\n");
+        free((void *)cand);
+        free((void *)alive);
+        free((void *)dropped);
+        free((void *)sum);
+        return -1;
+    }
+    column = sum + m;
+    rank = column + m;
+    for (c = 0; c < m; c++) {
+        alive[c] = c;
+        dropped[c] = 0;
+    }
+    num_alive = m;
+
+    fprintf(stderr, "Racing %d candidates on %s %d, budget %d runs, seeds from %u\n", m, cand[0].config.function,
+            cand[0].config.dim, budget, config->seed);
+    start = omp_get_wtime();
+    k = 0;
+    while (num_alive > 1 && used + num_alive <= budget) {
+        /* Enough instances to give every core a run, within the budget */
+        q = (config->num_threads + num_alive - 1) / num_alive;
+        if (q > (budget - used) / num_alive)
+            q = (budget - used) / num_alive;
+        if (k + q > stride) {
+            double *grown;
+            int grown_stride = 2 * (k + q);
+
+            grown = (double *)malloc((size_t)m * grown_stride * sizeof(double));
+            if (grown == NULL) {
+                fprintf(stderr, "Malloc error\n");
+                break;
+            }
+            for (c = 0; c < m; c++)
+                for (i = 0; i < k; i++)
+                    grown[(size_t)c * grown_stride + i] = cost[(size_t)c * stride + i];
+            free((void *)cost);
+            cost = grown;
+            stride = grown_stride;
+        }
+        n = q * num_alive;
+        jobs = (pso_job_t *)malloc(n * sizeof(pso_job_t));
+        if (jobs == NULL) {
+            fprintf(stderr, "Malloc error\n");
+            break;
+        }
+        for (i = 0; i < q; i++) {
+            for (j = 0; j < num_alive; j++) {
+                pso_job_t *job = &jobs[i * num_alive + j];
+
+                *job = cand[alive[j]];
+                job->index = i * num_alive + j;
+                job->weight = 1;
+                job->position = NULL;
+                job->config.seed = config->seed + k + i;
+            }
+        }
+        ran = pso_run_batch(jobs, n, config->num_threads, NULL, NULL);
+        if (ran < 0) {
+            fprintf(stderr, "Malloc error\n");
+            free((void *)jobs);
+            jobs = NULL;
+            break;
+        }
+        busy += ran;
+        for (i = 0; i < n; i++) {
+            if (jobs[i].status < 0) {
+                fprintf(stderr, "Candidate %s: %s\n", jobs[i].id, jobs[i].error);
+                free((void *)jobs);
+                jobs = NULL;
+                goto done;
+            }
+            cost[(size_t)alive[i % num_alive] * stride + k + i / num_alive] = jobs[i].fitness;
+            free((void *)jobs[i].position);
+        }
+        free((void *)jobs);
+        jobs = NULL;
+
+        /* Test one instance at a time as a sequential race would */
+        batch_alive = num_alive;
+        for (i = 0; i < q; i++) {
+            if (num_alive == 1 || used + num_alive > budget) {
+                discarded += (q - i) * batch_alive;
+                break;
+            }
+            used += num_alive;
+            discarded += batch_alive - num_alive;
+            k++;
+            if (k >= PSO_RACE_FIRST_TEST) {
+                int before = num_alive;
+
+                num_alive = pso_race_test(cost, stride, alive, num_alive, k, sum, column, rank);
+                if (num_alive < before) {
+                    for (c = 0; c < m; c++)
+                        if (dropped[c] == 0)
+                            dropped[c] = k;
+                    for (c = 0; c < num_alive; c++)
+                        dropped[alive[c]] = 0;
+                }
+            }
+        }
+    }
+
+done:
+    if (k == 0) {
+        fprintf(stderr, "Budget too small for one instance\n");
+        free((void *)cand);
+        free((void *)alive);
+        free((void *)dropped);
+        free((void *)sum);
+        free((void *)cost);
+        return -1;
+    }
+    /* Lowest rank sum of the survivors over all instances */
+    pso_rank_sums(cost, stride, alive, num_alive, k, sum, column, rank);
+    winner = 0;
+    for (c = 1; c < num_alive; c++)
+        if (sum[c] < sum[winner])
+            winner = c;
+    winner = alive[winner];
+
+    fprintf(stderr, "%-16s %9s %14s %14s  %s\n", "candidate", "instances", "mean fitness", "best fitness", "result");
+    for (c = 0; c < m; c++) {
+        n = (dropped[c] > 0) ? dropped[c] : k;
+        best = INFINITY;
+        for (i = 0, column[0] = 0.0; i < n; i++) {
+            column[0] += cost[(size_t)c * stride + i];
+            best = (cost[(size_t)c * stride + i] < best) ? cost[(size_t)c * stride + i] : best;
+        }
+        fprintf(stderr, "%-16.16s %9d %14.6g %14.6g  ", cand[c].id, n, column[0] / n, best);
+        if (c == winner)
+            fprintf(stderr, "winner\n");
+        else if (dropped[c] > 0)
+            fprintf(stderr, "dropped after %d instances\n", dropped[c]);
+        else
+            fprintf(stderr, "survived\n");
+    }
+    fprintf(stderr, "%d runs on %d instances in %.3fs on %d cores (%d more discarded), core utilization %.1f%%\n",
+            used, k, omp_get_wtime() - start, config->num_threads, discarded,
+            100.0 * busy / ((omp_get_wtime() - start) * config->num_threads));
+
+    fp = (config->tune_out != NULL) ? fopen(config->tune_out, "w") : stdout;
+    if (fp == NULL) {
+        fprintf(stderr, "Could not open %s\n", config->tune_out);
+    } else {
+        pso_write_spec(fp, &cand[winner]);
+        if (fp != stdout)
+            fclose(fp);
+    }
+    free((void *)cand);
+    free((void *)alive);
+    free((void *)dropped);
+    free((void *)sum);
+    free((void *)cost);
+    return (fp != NULL) ? 0 : -1;
+}
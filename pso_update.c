@@ -0,0 +1,635 @@
+/* Velocity and position updates of the OpenMP engine's variants.
+ *
+ * The solver updates the swarm one block of particles at a time and leaves
+ * the update rule to the pool of its variant: pso_update_block moves the
+ * particles of a block, a chunk of consecutive rows at a time (see
+ * pso_update_rows). The thread fills its scratch with the chunk's random
+ * numbers, drawn from a key of the chunk's first particle and the iteration,
+ * and updates the chunk as one flat array against gbest repeated once per
+ * row, so results do not depend on the number of threads. Variants that
+ * read other particles' pbests (pso_update_shared) need a barrier between
+ * the update and the evaluate pass that overwrites them.
+ *
+ * The FIPS variant (Mendes, Kennedy and Neves, "The fully informed particle
+ * swarm", IEEE TEC 2004) replaces the pull towards pbest and gbest with the
+ * sum of random pulls towards the pbests of all neighbors, under constriction.
+ * Runs of consecutive particles whose neighbors are also consecutive
+ * particles share one kernel call that streams over shifted rows of the
+ * pbest matrix.
+ *
+ * The CLPSO variant (Liang, Qin, Suganthan and Baskar, "Comprehensive
+ * learning particle swarm optimizer for global optimization of multimodal
+ * functions", IEEE TEC 2006) pulls each dimension of a particle towards the
+ * same dimension of an exemplar pbest picked by tournament, with inertia
+ * falling from 0.9 to 0.4. A particle redraws its exemplars after CLPSO_GAP
+ * iterations without improving its pbest (pso_update_stall); the draw is
+ * keyed like the random numbers of the update. Exemplars are int offsets into
+ * the pbest matrix, one per particle and dimension laid out like x, so the
+ * update reads them sequentially and gathers pbest with one indexed load per
+ * element.
+ *
+ * The bare-bones variant (Kennedy, "Bare bones particle swarms", SIS 2003)
+ * has no velocities: each position is drawn from a normal distribution with
+ * mean (pbest + gbest) / 2 and standard deviation |pbest - gbest|, using
+ * normal numbers keyed like the uniform ones. The swarm may then be
+ * allocated without its velocity matrix.
+ *
+ * The QPSO variant (Sun, Feng and Xu, "Particle swarm optimization with
+ * particles having quantum behavior", CEC 2004) has no velocities either:
+ * x = p +- beta |mbest - x| ln(1/u), where p is a random point between pbest
+ * and gbest, mbest the mean pbest of the swarm and beta falls from 1.0 to
+ * 0.5. mbest is a column sum over the pbest matrix computed in the evaluate
+ * pass: each block sums its freshly updated pbests pairwise next to its
+ * argmin (pso_update_sum), and the reduce adds the block sums pairwise in
+ * block order (pso_update_reduce). The pairwise tree is fixed by particle
+ * index, so mbest does not depend on the thread count or block size.
+ *
+ * The species variant (Li, "Adaptively choosing neighbourhood bests using
+ * species in a particle swarm optimizer for multimodal function
+ * optimization", GECCO 2004) replaces gbest with each particle's species
+ * leader, the best pbest within the niche radius (see pso_niche.c), so the
+ * swarm settles on several optima at once. The leaders are found after the
+ * reduce with a hash grid rebuilt by all threads (pso_update_leaders).
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+#include "pso.h"
+
+/* CLPSO: iterations without pbest improvement before a particle redraws
+ * its exemplars, and acceleration coefficient */
+#define CLPSO_GAP 7
+#define CLPSO_C 1.49445
+
+/* Elements updated per update call when particles are small */
+#define PSO_UPDATE_ELEMS 1024
+
+struct pso_update_pool_s {
+    const pso_kernels_t *kernels;
+    pso_variant_t variant;
+    pso_topology_t topology;
+    unsigned int seed;      /* Hashed run seed, keying the random numbers */
+    int num_particles;
+    int dim;
+    int rows;               /* Particles per update call */
+    int block;
+    int num_blocks;
+    int cols;               /* FIPS lattice columns */
+    int num_neighbors;
+    int num_random;         /* Random numbers per element */
+    int num_tiles;          /* gbest (and mbest) tiles of a chunk */
+    size_t chunk;
+    size_t scratch_size;    /* Per thread: random numbers and tiles of a chunk, pairwise sums of a block */
+    float *scratch;
+    int *exemplar;          /* CLPSO exemplars */
+    int *stall;             /*   and iterations without improvement */
+    float *mbest;           /* QPSO mean pbest */
+    float *block_sum;       /*   block sums */
+    float *partial;         /*   and their pairwise partial sums */
+    int *leader;            /* Species leader of each particle */
+    pso_grid_t *grid;
+    float origin, radius;   /* Species grid origin and niche radius */
+};
+
+/* Particles per update call for dimension dim: a power of two so chunks
+ * start at the same particles for every block size */
+int pso_update_rows(int dim)
+{
+    int rows = 1;
+
+    while (2 * rows * dim <= PSO_UPDATE_ELEMS && 2 * rows <= PSO_BLOCK)
+        rows *= 2;
+    return rows;
+}
+
+/* Parse name of a velocity update rule. Return 0 on success, -1 if unknown */
+int pso_parse_variant(const char *name, pso_config_t *config)
+{
+    if (strcmp(name, "gbest") == 0)
+        config->variant = PSO_VARIANT_GBEST;
+    else if (strcmp(name, "fips") == 0)
+        config->variant = PSO_VARIANT_FIPS;
+    else if (strcmp(name, "clpso") == 0)
+        config->variant = PSO_VARIANT_CLPSO;
+    else if (strcmp(name, "barebones") == 0)
+        config->variant = PSO_VARIANT_BAREBONES;
+    else if (strcmp(name, "qpso") == 0)
+        config->variant = PSO_VARIANT_QPSO;
+    else if (strcmp(name, "species") == 0)
+        config->variant = PSO_VARIANT_SPECIES;
+    else
+        return -1;
+    return 0;
+}
+
+/* Parse name of a neighborhood. Return 0 on success, -1 if unknown */
+int pso_parse_topology(const char *name, pso_config_t *config)
+{
+    if (strcmp(name, "ring") == 0)
+        config->topology = PSO_TOPOLOGY_RING;
+    else if (strcmp(name, "lattice") == 0)
+        config->topology = PSO_TOPOLOGY_LATTICE;
+    else
+        return -1;
+    return 0;
+}
+
+/* Name of the configured variant, with its neighborhood if it uses one */
+const char *pso_variant_name(pso_config_t *config)
+{
+    if (config->variant == PSO_VARIANT_FIPS)
+        return (config->topology == PSO_TOPOLOGY_LATTICE) ? "fips-lattice" : "fips-ring";
+    if (config->variant == PSO_VARIANT_CLPSO)
+        return "clpso";
+    if (config->variant == PSO_VARIANT_BAREBONES)
+        return "barebones";
+    if (config->variant == PSO_VARIANT_QPSO)
+        return "qpso";
+    if (config->variant == PSO_VARIANT_SPECIES)
+        return "species";
+    return "gbest";
+}
+
+/* Whether the configured variant keeps velocities */
+int pso_variant_velocity(pso_config_t *config)
+{
+    return config->variant != PSO_VARIANT_BAREBONES && config->variant != PSO_VARIANT_QPSO;
+}
+
+/* Neighbors of particle i, itself first, in a swarm of n particles. The
+ * lattice is a torus of rows of cols particles whose last row may be short.
+ * Return number of neighbors */
+static int pso_neighbors(pso_topology_t topology, int i, int n, int cols, int *neighbor)
+{
+    int row_start, row_len;
+
+    neighbor[0] = i;
+    if (topology == PSO_TOPOLOGY_RING) {
+        neighbor[1] = (i + n - 1) % n;
+        neighbor[2] = (i + 1) % n;
+        return 3;
+    }
+    row_start = i - i % cols;
+    row_len = (n - row_start < cols) ? n - row_start : cols;
+    neighbor[1] = row_start + (i - row_start + row_len - 1) % row_len;    /* West */
+    neighbor[2] = row_start + (i - row_start + 1) % row_len;              /* East */
+    neighbor[3] = (i + n - cols) % n;                                     /* North */
+    neighbor[4] = (i + cols) % n;                                         /* South */
+    return 5;
+}
+
+/* Number of particles from i, up to limit, whose neighbors are those of
+ * i shifted by their distance from i, with the neighbors of i in neighbor.
+ * The neighbors' offsets only change at the ends of the ring and at the
+ * edges of the lattice's rows and columns, so only the particles there are
+ * compared */
+static int pso_neighbor_run(pso_topology_t topology, int i, int n, int cols, int limit, int *neighbor)
+{
+    int next[5], candidate[6];
+    int c, j, m, row_end, run = limit;
+    int num_neighbors = pso_neighbors(topology, i, n, cols, neighbor);
+
+    row_end = ((i / cols + 1) * cols < n) ? (i / cols + 1) * cols - 1 : n - 1;
+    candidate[0] = i + 1;
+    candidate[1] = cols;
+    candidate[2] = n - cols;
+    candidate[3] = row_end;
+    candidate[4] = row_end + 1;
+    candidate[5] = n - 1;
+    for (c = 0; c < 6; c++) {
+        j = candidate[c];
+        if (j <= i || j - i >= run)
+            continue;
+        pso_neighbors(topology, j, n, cols, next);
+        for (m = 0; m < num_neighbors && next[m] == neighbor[m] + (j - i); m++)
+            ;
+        if (m < num_neighbors)
+            run = j - i;
+    }
+    return run;
+}
+
+/* Tournament of two particles other than i picked by the uniform numbers u
+ * and w; return the one with the better pbest */
+static int pso_tournament(swarm_t *swarm, int i, float u, float w)
+{
+    int n = swarm->num_particles;
+    int a = (int)((double)u * (n - 1));
+    int b = (int)((double)w * (n - 1));
+
+    a += (a >= i);
+    b += (b >= i);
+    return (swarm->particle[b].fitness < swarm->particle[a].fitness) ? b : a;
+}
+
+/* Draw the CLPSO exemplars of particle i: in each dimension, with the
+ * particle's learning probability, the fitter of two other particles,
+ * otherwise the particle itself; a particle that drew only itself learns one
+ * random dimension from another. Exemplars are stored as offsets into the
+ * pbest matrix, so own dimensions read the particle's own row */
+static void pso_clpso_exemplars(swarm_t *swarm, const pso_kernels_t *kernels, int i, unsigned int key,
+                                float *r, int *exemplar)
+{
+    int d, learned = 0, n = swarm->num_particles, dim = swarm->dim;
+    float pc;
+
+    for (d = 0; d < dim; d++)
+        exemplar[d] = i * dim + d;
+    if (n < 2)
+        return;
+    /* Learning probability from 0.05 for particle 0 to 0.5 for the last one */
+    pc = 0.05 + 0.45 * expm1(10.0 * i / (n - 1)) / expm1(10.0);
+    kernels->uniform(r, 3 * dim, key);
+    for (d = 0; d < dim; d++) {
+        if (r[3 * d] < pc) {
+            exemplar[d] = pso_tournament(swarm, i, r[3 * d + 1], r[3 * d + 2]) * dim + d;
+            learned = 1;
+        }
+    }
+    if (!learned) {
+        d = pso_hash(key) % dim;
+        exemplar[d] = pso_tournament(swarm, i, r[3 * d + 1], r[3 * d + 2]) * dim + d;
+    }
+}
+
+/* Add row number count of a pairwise sum of rows of dim elements. The sum
+ * is kept as a binary counter: while bit l of count is set, level l of
+ * partial holds the sum of the last complete aligned group of 2^l rows */
+static void pso_pairwise_push(float *partial, int count, const float *row, int dim)
+{
+    int j, l;
+    float *level;
+
+    if (!(count & 1)) {
+        memcpy(partial, row, dim * sizeof(float));
+        return;
+    }
+    /* Merge completed groups, left group first */
+    for (j = 0; j < dim; j++)
+        partial[j] += row[j];
+    for (l = 1; count & (1 << l); l++) {
+        level = partial + (size_t)l * dim;
+        for (j = 0; j < dim; j++)
+            level[j] += level[j - dim];
+    }
+    memcpy(partial + (size_t)l * dim, partial + (size_t)(l - 1) * dim, dim * sizeof(float));
+}
+
+/* Sum of the count rows pushed into partial, as if count were padded with
+ * zero rows to a power of two, so the sum of an aligned group of rows does
+ * not depend on how the rows were split between calls */
+static void pso_pairwise_sum(float *partial, int count, int dim, float *sum)
+{
+    int j, l;
+    const float *level;
+
+    for (l = 0; l < 31 && !(count & (1 << l)); l++)
+        ;
+    if (count == 0) {
+        memset(sum, 0, dim * sizeof(float));
+        return;
+    }
+    memcpy(sum, partial + (size_t)l * dim, dim * sizeof(float));
+    for (l++; l < 31; l++) {
+        if (!(count & (1 << l)))
+            continue;
+        level = partial + (size_t)l * dim;
+        for (j = 0; j < dim; j++)
+            sum[j] = level[j] + sum[j];
+    }
+}
+
+/* Sum of the first n rows of the n x dim matrix x */
+static void pso_block_sum(const float *x, int n, int dim, float *partial, float *sum)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        pso_pairwise_push(partial, i, x + (size_t)i * dim, dim);
+    pso_pairwise_sum(partial, n, dim, sum);
+}
+
+/* Pool for config's variant over swarm, updated in blocks of block
+ * particles on up to max_threads threads. Return NULL on allocation failure */
+pso_update_pool_t *pso_update_pool_create(pso_config_t *config, swarm_t *swarm, int block, int max_threads)
+{
+    pso_update_pool_t *pool = (pso_update_pool_t *)calloc(1, sizeof(pso_update_pool_t));
+    int i, num_levels = 1, dim = swarm->dim;
+
+    if (pool == NULL)
+        return NULL;
+    pool->kernels = pso_kernels;
+    pool->variant = config->variant;
+    pool->topology = config->topology;
+    pool->seed = pso_hash(config->seed);
+    pool->num_particles = swarm->num_particles;
+    pool->dim = dim;
+    pool->rows = pso_update_rows(dim);
+    pool->block = block;
+    pool->num_blocks = (swarm->num_particles + block - 1) / block;
+    pool->cols = 1;
+    pool->num_random = 3;
+    pool->num_tiles = (pool->rows > 1 || config->variant == PSO_VARIANT_SPECIES) ? 1 : 0;
+    pool->chunk = (size_t)pool->rows * dim;
+    if (config->variant == PSO_VARIANT_FIPS) {
+        while ((pool->cols + 1) * (pool->cols + 1) <= swarm->num_particles)
+            pool->cols++;
+        pool->num_neighbors = (config->topology == PSO_TOPOLOGY_LATTICE) ? 5 : 3;
+        pool->num_random = pool->num_neighbors;
+    }
+    if (config->variant == PSO_VARIANT_QPSO) {
+        while ((1 << (num_levels - 1)) < PSO_BLOCK)
+            num_levels++;
+        if (pool->rows > 1)
+            pool->num_tiles = 2;
+    } else {
+        num_levels = 0;
+    }
+    pool->scratch_size = ((pool->num_random + pool->num_tiles) * pool->chunk + (size_t)num_levels * dim + 15)
+                         & ~(size_t)15;
+    pool->scratch = (float *)malloc(max_threads * pool->scratch_size * sizeof(float));
+    if (pool->scratch == NULL) {
+        pso_update_pool_destroy(pool);
+        return NULL;
+    }
+
+    if (config->variant == PSO_VARIANT_CLPSO) {
+        pool->exemplar = (int *)malloc((size_t)swarm->num_particles * dim * sizeof(int));
+        pool->stall = (int *)malloc(swarm->num_particles * sizeof(int));
+        if (pool->exemplar == NULL || pool->stall == NULL) {
+            pso_update_pool_destroy(pool);
+            return NULL;
+        }
+        /* Every particle draws its exemplars in the first iteration */
+        for (i = 0; i < swarm->num_particles; i++)
+            pool->stall[i] = CLPSO_GAP;
+    }
+    if (config->variant == PSO_VARIANT_QPSO) {
+        pool->mbest = (float *)malloc(dim * sizeof(float));
+        pool->block_sum = (float *)malloc((size_t)pool->num_blocks * dim * sizeof(float));
+        pool->partial = (float *)malloc(32 * (size_t)dim * sizeof(float));
+        if (pool->mbest == NULL || pool->block_sum == NULL || pool->partial == NULL) {
+            pso_update_pool_destroy(pool);
+            return NULL;
+        }
+    }
+    if (config->variant == PSO_VARIANT_SPECIES) {
+        pool->leader = (int *)malloc(swarm->num_particles * sizeof(int));
+        pool->grid = pso_grid_create(swarm->num_particles, dim);
+        pool->origin = config->xmin;
+        pool->radius = pso_niche_radius(config);
+        if (pool->leader == NULL || pool->grid == NULL) {
+            pso_update_pool_destroy(pool);
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+void pso_update_pool_destroy(pso_update_pool_t *pool)
+{
+    if (pool == NULL)
+        return;
+    free((void *)pool->scratch);
+    free((void *)pool->exemplar);
+    free((void *)pool->stall);
+    free((void *)pool->mbest);
+    free((void *)pool->block_sum);
+    free((void *)pool->partial);
+    free((void *)pool->leader);
+    pso_grid_destroy(pool->grid);
+    free((void *)pool);
+}
+
+/* Initial coefficients of the variant's update in param, from config */
+void pso_update_param(pso_update_pool_t *pool, pso_config_t *config, pso_update_t *param)
+{
+    if (pool->variant == PSO_VARIANT_FIPS) {
+        param->w = 0.7298;                      /* Constriction coefficient for phi = 4.1 */
+        param->c1 = 4.1 / pool->num_neighbors;  /* Total acceleration phi shared by the neighbors */
+        param->c2 = 0;
+    } else if (pool->variant == PSO_VARIANT_CLPSO) {
+        param->c1 = CLPSO_C;
+        param->c2 = 0;
+    } else {
+        param->w = (config->inertia > 0) ? config->inertia : 0.79;
+        param->c1 = (config->c1 > 0) ? config->c1 : 1.49;
+        param->c2 = (config->c2 > 0) ? config->c2 : 1.49;
+    }
+    param->vmax = fabsf(config->xmax - config->xmin);
+    if (pool->variant == PSO_VARIANT_CLPSO)
+        param->vmax *= 0.2;
+    param->xmin = config->xmin;
+    param->xmax = config->xmax;
+}
+
+/* Coefficients of iteration iter of max_iter for the variants whose
+ * coefficients change over the run */
+void pso_update_iteration(pso_update_pool_t *pool, pso_update_t *param, int iter, int max_iter)
+{
+    if (pool->variant == PSO_VARIANT_CLPSO)
+        param->w = 0.9 - 0.5 * iter / max_iter;
+    else if (pool->variant == PSO_VARIANT_QPSO)
+        param->w = 1.0 - 0.5 * iter / max_iter;     /* Contraction-expansion coefficient beta */
+}
+
+/* Whether the update reads other particles' pbests, so a barrier must
+ * separate it from the evaluate pass */
+int pso_update_shared(pso_update_pool_t *pool)
+{
+    return pool->variant == PSO_VARIANT_FIPS || pool->variant == PSO_VARIANT_CLPSO
+        || pool->variant == PSO_VARIANT_SPECIES;
+}
+
+/* Species leaders and QPSO mean pbest of the pbests of swarm before the
+ * first iteration, on num_threads threads */
+void pso_update_start(pso_update_pool_t *pool, swarm_t *swarm, int num_threads)
+{
+    int b, d;
+
+    if (pool->leader != NULL) {
+#pragma omp parallel num_threads(num_threads)
+    {
+        int i;
+
+        pso_grid_build(pool->grid, swarm, pool->origin, pool->radius);
+        #pragma omp for schedule(static)
+        for (i = 0; i < swarm->num_particles; i++)
+            pool->leader[i] = pso_grid_leader(pool->grid, swarm, i);
+    }
+    }
+    if (pool->mbest != NULL) {
+        for (b = 0; b < pool->num_blocks; b++)
+            pso_block_sum(swarm->pbest + (size_t)b * pool->block * pool->dim,
+                          (b == pool->num_blocks - 1) ? swarm->num_particles - b * pool->block : pool->block,
+                          pool->dim, pool->partial, pool->block_sum + (size_t)b * pool->dim);
+        pso_block_sum(pool->block_sum, pool->num_blocks, pool->dim, pool->partial, pool->mbest);
+        for (d = 0; d < pool->dim; d++)
+            pool->mbest[d] /= swarm->num_particles;
+    }
+}
+
+/* gbest and mbest tiles of thread tid: the vectors repeated once per row of
+ * a chunk, or the vectors themselves when chunks are single rows */
+static float *pso_update_tile(pso_update_pool_t *pool, int tid, const float *gbest_x, int k)
+{
+    float *r = pool->scratch + tid * pool->scratch_size;
+
+    if (k == 0)
+        return (pool->num_tiles > 0) ? r + pool->num_random * pool->chunk : (float *)gbest_x;
+    return (pool->rows > 1) ? r + (pool->num_random + 1) * pool->chunk : pool->mbest;
+}
+
+/* Fill thread tid's gbest (and mbest) tiles for this iteration's update */
+void pso_update_begin(pso_update_pool_t *pool, int tid, const float *gbest_x)
+{
+    float *gbest_tile = pso_update_tile(pool, tid, gbest_x, 0);
+    float *mbest_tile = pso_update_tile(pool, tid, gbest_x, 1);
+    int k, dim = pool->dim;
+
+    if (pool->variant != PSO_VARIANT_GBEST && pool->variant != PSO_VARIANT_BAREBONES
+        && pool->variant != PSO_VARIANT_QPSO)
+        return;
+    for (k = 0; pool->rows > 1 && k < pool->rows; k++) {
+        memcpy(gbest_tile + k * dim, gbest_x, dim * sizeof(float));
+        if (pool->variant == PSO_VARIANT_QPSO)
+            memcpy(mbest_tile + k * dim, pool->mbest, dim * sizeof(float));
+    }
+}
+
+/* Update the particles of block b of swarm in iteration iter on thread tid,
+ * pulled towards gbest_x as the variant has it */
+void pso_update_block(pso_update_pool_t *pool, int tid, swarm_t *swarm, int b, int iter, const float *gbest_x,
+                      const pso_update_t *param)
+{
+    const pso_kernels_t *kernels = pool->kernels;
+    unsigned int seed = pool->seed;
+    int i, k, m, block = pool->block, rows = pool->rows, dim = pool->dim;
+    int n = (b == pool->num_blocks - 1) ? swarm->num_particles - b * block : block;
+    int neighbor[5];
+    const float *neighbor_pbest[5];
+    float *r = pool->scratch + tid * pool->scratch_size;    /* Random numbers of one chunk */
+    float *gbest_tile = pso_update_tile(pool, tid, gbest_x, 0);
+    float *mbest_tile = pso_update_tile(pool, tid, gbest_x, 1);
+    size_t offset;
+
+    switch (pool->variant) {
+    case PSO_VARIANT_FIPS:
+        for (i = b * block; i < b * block + n; i += k) {
+            /* Extend the chunk while the neighbors stay consecutive */
+            k = (b * block + n - i < rows - i % rows) ? b * block + n - i : rows - i % rows;
+            k = pso_neighbor_run(pool->topology, i, swarm->num_particles, pool->cols, k, neighbor);
+            offset = (size_t)i * dim;
+            for (m = 0; m < pool->num_neighbors; m++)
+                neighbor_pbest[m] = swarm->pbest + (size_t)neighbor[m] * dim;
+            kernels->uniform(r, pool->num_neighbors * k * dim, pso_hash(seed + pso_hash(iter * swarm->num_particles + i)));
+            kernels->fips_update(swarm->x + offset, swarm->v + offset, neighbor_pbest, pool->num_neighbors,
+                                 r, k * dim, param);
+        }
+        break;
+    case PSO_VARIANT_CLPSO:
+        for (i = b * block; i < b * block + n; i += k) {
+            k = (b * block + n - i < rows) ? b * block + n - i : rows;
+            offset = (size_t)i * dim;
+            for (m = i; m < i + k; m++) {
+                if (pool->stall[m] >= CLPSO_GAP) {
+                    pso_clpso_exemplars(swarm, kernels, m, pso_hash(~seed + pso_hash(iter * swarm->num_particles + m)),
+                                        r, pool->exemplar + (size_t)m * dim);
+                    pool->stall[m] = 0;
+                }
+            }
+            kernels->uniform(r, k * dim, pso_hash(seed + pso_hash(iter * swarm->num_particles + i)));
+            kernels->clpso_update(swarm->x + offset, swarm->v + offset, swarm->pbest,
+                                  pool->exemplar + offset, r, k * dim, param);
+        }
+        break;
+    case PSO_VARIANT_BAREBONES:
+        for (i = b * block; i < b * block + n; i += k) {
+            k = (b * block + n - i < rows) ? b * block + n - i : rows;
+            offset = (size_t)i * dim;
+            kernels->normal(r, k * dim, pso_hash(seed + pso_hash(iter * swarm->num_particles + i)));
+            kernels->barebones_update(swarm->x + offset, swarm->pbest + offset, gbest_tile, r, k * dim, param);
+        }
+        break;
+    case PSO_VARIANT_SPECIES:
+        for (i = b * block; i < b * block + n; i += k) {
+            k = (b * block + n - i < rows) ? b * block + n - i : rows;
+            offset = (size_t)i * dim;
+            /* Leaders' pbests in place of gbest */
+            for (m = 0; m < k; m++)
+                memcpy(gbest_tile + m * dim, swarm->pbest + (size_t)pool->leader[i + m] * dim, dim * sizeof(float));
+            kernels->uniform(r, 3 * k * dim, pso_hash(seed + pso_hash(iter * swarm->num_particles + i)));
+            kernels->update(swarm->x + offset, swarm->v + offset, swarm->pbest + offset,
+                            gbest_tile, r, k * dim, param);
+        }
+        break;
+    case PSO_VARIANT_QPSO:
+        for (i = b * block; i < b * block + n; i += k) {
+            k = (b * block + n - i < rows) ? b * block + n - i : rows;
+            offset = (size_t)i * dim;
+            kernels->uniform(r, 3 * k * dim, pso_hash(seed + pso_hash(iter * swarm->num_particles + i)));
+            kernels->qpso_update(swarm->x + offset, swarm->pbest + offset, gbest_tile, mbest_tile,
+                                 r, k * dim, param);
+        }
+        break;
+    default:
+        for (i = b * block; i < b * block + n; i += k) {
+            k = (b * block + n - i < rows) ? b * block + n - i : rows;
+            offset = (size_t)i * dim;
+            /* Different key for each chunk and iteration */
+            kernels->uniform(r, 3 * k * dim, pso_hash(seed + pso_hash(iter * swarm->num_particles + i)));
+            kernels->update(swarm->x + offset, swarm->v + offset, swarm->pbest + offset,
+                            gbest_tile, r, k * dim, param);
+        }
+        break;
+    }
+}
+
+/* CLPSO: count the iterations particle m went without improving its pbest */
+void pso_update_stall(pso_update_pool_t *pool, int m, int improved)
+{
+    if (pool->stall != NULL)
+        pool->stall[m] = improved ? 0 : pool->stall[m] + 1;
+}
+
+/* QPSO: column sums of the new pbests of block b on thread tid */
+void pso_update_sum(pso_update_pool_t *pool, int tid, swarm_t *swarm, int b)
+{
+    int block = pool->block;
+    int n = (b == pool->num_blocks - 1) ? swarm->num_particles - b * block : block;
+    float *block_partial = pool->scratch + tid * pool->scratch_size + (pool->num_random + pool->num_tiles) * pool->chunk;
+
+    if (pool->block_sum != NULL)
+        pso_block_sum(swarm->pbest + (size_t)b * block * pool->dim, n, pool->dim, block_partial,
+                      pool->block_sum + (size_t)b * pool->dim);
+}
+
+/* QPSO: mean pbest from the block sums, after the evaluate pass */
+void pso_update_reduce(pso_update_pool_t *pool, swarm_t *swarm)
+{
+    int d;
+
+    if (pool->mbest == NULL)
+        return;
+    pso_block_sum(pool->block_sum, pool->num_blocks, pool->dim, pool->partial, pool->mbest);
+    for (d = 0; d < pool->dim; d++)
+        pool->mbest[d] /= swarm->num_particles;
+}
+
+/* Species: leaders of the new pbests, by all threads of the team */
+void pso_update_leaders(pso_update_pool_t *pool, swarm_t *swarm)
+{
+    int i;
+
+    if (pool->leader == NULL)
+        return;
+    PSO_TRACE_BEGIN(PSO_PHASE_NICHE);
+    pso_grid_build(pool->grid, swarm, pool->origin, pool->radius);
+    #pragma omp for schedule(static)
+    for (i = 0; i < swarm->num_particles; i++)
+        pool->leader[i] = pso_grid_leader(pool->grid, swarm, i);
+    PSO_TRACE_END(PSO_PHASE_NICHE);
+}
@@ -12,7 +12,7 @@
 float uniform(float min, float max)
 {
     float normalized; 
-    normalized = (float)rand()/(float)RAND_MAX;
+    normalized = (float)pso_gold_rand()/(float)RAND_MAX;
     return (min + normalized * (max - min));
 }
 
@@ -71,7 +71,7 @@ float pso_eval_schwefel(particle_t *particle)
  */
 float pso_eval_holder_table(particle_t *particle)
 {
-    return -fabsf(sin(particle->x[0]) * cos(particle->x[1]) * exp(fabsf(1 - sqrt(pow(particle->x[0], 2) + pow(particle->x[1], 2))/M_PI)));
+    return -fabs(sin(particle->x[0]) * cos(particle->x[1]) * exp(fabs(1 - sqrt(pow(particle->x[0], 2) + pow(particle->x[1], 2))/M_PI)));
 }
     
 /* Evaluate the Rastrigin function:
@@ -104,35 +104,49 @@ float pso_eval_booth(particle_t *particle)
            + pow((2 * particle->x[0] + particle->x[1] - 5), 2);
 }
 
-/* Evaluate particle's fitness using provided function. Return 0 on success, -1 otherwise */ 
-int pso_eval_fitness(char *function, particle_t *particle, float *fitness)
+/* Registry of test functions with their default dimension and search domain */
+const pso_objective_t pso_objectives[] = {
+    /* name           eval function           dim  min_dim  xmin      xmax    fmin       batch */
+    { "booth",        pso_eval_booth,         2,   2,       -10.0,    10.0,   0.0,       NULL },
+    { "rastrigin",    pso_eval_rastrigin,     10,  1,       -5.12,    5.12,   0.0,       NULL },
+    { "holder_table", pso_eval_holder_table,  2,   2,       -10.0,    10.0,   -19.2085,  NULL },
+    { "eggholder",    pso_eval_eggholder,     2,   2,       -512.0,   512.0,  -959.6407, NULL },
+    { "schwefel",     pso_eval_schwefel,      10,  1,       -500.0,   500.0,  0.0,       NULL },
+    { NULL,           NULL,                   0,   0,       0.0,      0.0,    0.0,       NULL }
+};
+
+/* Return registry entry of named function, NULL if unknown */
+const pso_objective_t *pso_find_objective(const char *function)
 {
-    if (strcmp(function, "booth") == 0) {
-        *fitness = pso_eval_booth(particle);
-        return 0;
-    }
+    const pso_objective_t *objective;
+
+    for (objective = pso_objectives; objective->name != NULL; objective++)
+        if (strcmp(function, objective->name) == 0)
+            return objective;
+    if (pso_expr_objective != NULL && strcmp(function, pso_expr_objective->name) == 0)
+        return pso_expr_objective;
+    return NULL;
+}
 
-    if (strcmp(function, "rastrigin") == 0) {
-        *fitness = pso_eval_rastrigin(particle);
-        return 0;
-    }
+/* Return the batch objective of a registry entry: its own, or the kernel of
+ * the selected instruction set */
+void (*pso_objective_batch(const pso_objective_t *objective))(const float *, int, int, float *)
+{
+    if (objective->batch != NULL)
+        return objective->batch;
+    return pso_kernels->eval[objective - pso_objectives];
+}
 
-    if (strcmp(function, "holder_table") == 0) {
-        *fitness = pso_eval_holder_table(particle);
-        return 0;
-    }
+/* Evaluate particle's fitness using provided function. Return 0 on success, -1 otherwise */ 
+int pso_eval_fitness(char *function, particle_t *particle, float *fitness)
+{
+    const pso_objective_t *objective = pso_find_objective(function);
 
-    if (strcmp(function, "eggholder") == 0) {
-        *fitness = pso_eval_eggholder(particle);
-        return 0;
-    }
-    
-    if (strcmp(function, "schwefel") == 0) {
-        *fitness = pso_eval_schwefel(particle);
-        return 0;
-    }
+    if (objective == NULL)
+        return -1;
 
-    return -1;
+    *fitness = objective->eval(particle);
+    return 0;
 }
 
 /* Return index of best performing particle */
@@ -159,9 +173,12 @@ int pso_get_best_fitness_omp(swarm_t *swarm, int num_threads)
     int local_g[num_threads]; /* Each thread will store its local best g */
     int global_g = -1;
     float local_fitness[num_threads]; /* Each thread will store its local best fitness */
-    // Init local fitness of each thread to infinity
-    for (int i = 0; i < num_threads; i++)
+    // Init local fitness of each thread to infinity; particle 0 stands in
+    // when no fitness is finite, as an expression's may not be
+    for (int i = 0; i < num_threads; i++) {
         local_fitness[i] = INFINITY;
+        local_g[i] = 0;
+    }
     float fitness;
     particle_t *particle;
 
@@ -208,39 +225,87 @@ float min(float * input, int length){
 /* Free swarm data structure */
 void pso_free(swarm_t *swarm)
 {
-    int i;
-    particle_t *particle;
-    for (i = 0; i < swarm->num_particles; i++) { /* Free particle structures */
-        particle = &(swarm->particle[i]);
-        free((void *)particle->x);
-        free((void *)particle->v);
-        free((void *)particle->pbest);
-    }
-    
+    if (swarm == NULL)
+        return;
+    free((void *)swarm->mem);
+    free((void *)swarm->particle);
     free((void *)swarm);
     return;
 }
 
-/* Print current state of swarm */
-void pso_print_particle(particle_t *particle)
+/* Allocate storage for swarm_size particles of dimension dim. Positions,
+ * velocities and best positions are kept as contiguous swarm_size x dim
+ * matrices and the particle vectors point into them; without velocity the
+ * velocity matrix is left out and v is NULL. An existing swarm is reused
+ * when its storage is large enough, so repeated runs do not go back to the
+ * allocator. Returns NULL on allocation failure.
+ */
+swarm_t *pso_alloc(swarm_t *swarm, int dim, int swarm_size, int velocity)
 {
-    int j; 
+    int i;
+    size_t size = (size_t)swarm_size * dim;
+    particle_t *particle;
 
-    fprintf(stderr, "position: ");
-    for (j = 0; j < particle->dim; j++)
-        fprintf(stderr, "%.2f ", particle->x[j]);
+    if (swarm == NULL) {
+        swarm = (swarm_t *)calloc(1, sizeof(swarm_t));
+        if (swarm == NULL)
+            return NULL;
+    }
 
-    fprintf(stderr, "\nvelocity: ");
-    for (j = 0; j < particle->dim; j++)
-        fprintf(stderr, "%.2f ", particle->v[j]);
+    if (size > swarm->capacity || (velocity && !swarm->velocity)) {
+        free((void *)swarm->mem);
+        swarm->mem = (float *)malloc((velocity ? 3 : 2) * size * sizeof(float));
+        swarm->capacity = (swarm->mem != NULL) ? size : 0;
+        swarm->velocity = velocity;
+    }
+    if (swarm_size > swarm->max_particles) {
+        free((void *)swarm->particle);
+        swarm->particle = (particle_t *)malloc(swarm_size * sizeof(particle_t));
+        swarm->max_particles = (swarm->particle != NULL) ? swarm_size : 0;
+    }
+    if (swarm->mem == NULL || swarm->particle == NULL) {
+        fprintf(stderr, "Malloc error\n");
+        pso_free(swarm);
+        return NULL;
+    }
 
-    fprintf(stderr, "\npbest: ");
-    for (j = 0; j < particle->dim; j++)
-        fprintf(stderr, "%.2f ", particle->pbest[j]);
+    swarm->num_particles = swarm_size;
+    swarm->dim = dim;
+    swarm->x = swarm->mem;
+    swarm->pbest = swarm->mem + size;
+    swarm->v = velocity ? swarm->mem + 2 * size : NULL;
+    for (i = 0; i < swarm_size; i++) {
+        particle = &swarm->particle[i];
+        particle->dim = dim;
+        particle->x = swarm->x + (size_t)i * dim;
+        particle->v = velocity ? swarm->v + (size_t)i * dim : NULL;
+        particle->pbest = swarm->pbest + (size_t)i * dim;
+    }
+    return swarm;
+}
+
+/* Mix the bits of x (MurmurHash3 finalizer). Used to derive independent
+ * rand_r() seeds from a run seed, iteration and particle index */
+unsigned int pso_hash(unsigned int x)
+{
+    x ^= x >> 16;
+    x *= 0x85ebca6bu;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35u;
+    x ^= x >> 16;
+    return x;
+}
 
-    fprintf(stderr, "\nfitness: %.4f", particle->fitness);
-    fprintf(stderr, "\ng: %d\n", particle->g);
+/* Print current state of particle to stderr at full precision */
+void pso_print_particle(particle_t *particle)
+{
+    pso_writer_t *writer;
 
+    writer = pso_writer_open(NULL);
+    if (writer == NULL)
+        return;
+    pso_write_particle(writer, particle, PSO_FORMAT_TEXT);
+    pso_writer_close(writer);
     return;
 }
 
@@ -268,27 +333,21 @@ swarm_t *pso_init(char *function, int dim, int swarm_size,
     swarm_t *swarm;
     particle_t *particle;
 
-    swarm = (swarm_t *)malloc(sizeof(swarm_t));
-    swarm->num_particles = swarm_size;
-    swarm->particle = (particle_t *)malloc(swarm_size * sizeof(particle_t));
-    if (swarm->particle == NULL)
+    swarm = pso_alloc(NULL, dim, swarm_size, 1);
+    if (swarm == NULL)
         return NULL;
 
     for (i = 0; i < swarm->num_particles; i++) {
         particle = &swarm->particle[i];
-        particle->dim = dim; 
         /* Generate random particle position */
-        particle->x = (float *)malloc(dim * sizeof(float));
         for (j = 0; j < dim; j++)
            particle->x[j] = uniform(xmin, xmax);
 
        /* Generate random particle velocity */ 
-        particle->v = (float *)malloc(dim * sizeof(float));
         for (j = 0; j < dim; j++)
             particle->v[j] = uniform(-fabsf(xmax - xmin), fabsf(xmax - xmin));
 
         /* Initialize best position for particle */
-        particle->pbest = (float *)malloc(dim * sizeof(float));
         for (j = 0; j < dim; j++)
             particle->pbest[j] = particle->x[j];
 
@@ -296,6 +355,7 @@ swarm_t *pso_init(char *function, int dim, int swarm_size,
         status = pso_eval_fitness(function, particle, &fitness);
         if (status < 0) {
             fprintf(stderr, "Could not evaluate fitness. Unknown function provided.\n");
+            pso_free(swarm);
             return NULL;
         }
         particle->fitness = fitness;
@@ -314,71 +374,102 @@ swarm_t *pso_init(char *function, int dim, int swarm_size,
     return swarm;
 }
 
-/* PSO init with parallel omp */
-swarm_t *pso_init_omp(char *function, int dim, int swarm_size, 
-                  float xmin, float xmax, int num_threads)
+/* Initialize an allocated swarm in parallel. Each particle draws from its
+ * own seed derived from seed and its index, so the initial swarm does not
+ * depend on the number of threads. Return 0 on success, -1 otherwise */
+int pso_init_swarm_omp(swarm_t *swarm, char *function, float xmin, float xmax,
+                       int num_threads, unsigned int seed)
 {
     int g;
-    int status;
-    float fitness;
-    unsigned int seed = time(NULL);
-    swarm_t *swarm;
+    int dim = swarm->dim;
+    float vmax = fabsf(xmax - xmin);
     particle_t *particle;
+    const pso_objective_t *objective = pso_find_objective(function);
+    void (*eval)(const float *, int, int, float *);
 
-    swarm = (swarm_t *)malloc(sizeof(swarm_t));
-    swarm->num_particles = swarm_size;
-    swarm->particle = (particle_t *)malloc(swarm_size * sizeof(particle_t));
-    if (swarm->particle == NULL) {
-        fprintf(stderr, "Malloc error\n");
-        return NULL;
+    if (objective == NULL) {
+        fprintf(stderr, "Could not evaluate fitness. Unknown function provided.\n");
+        return -1;
     }
+    eval = pso_objective_batch(objective); /* Same kernel as pso_solve_omp */
+
 // Start parallel section
-#pragma omp parallel num_threads(num_threads) private(particle, status, fitness)
+#pragma omp parallel num_threads(num_threads) private(particle)
 {
     int i, j;
+    unsigned int particle_seed;
     #pragma omp for
     for (i = 0; i < swarm->num_particles; i++) {
-        seed += i; /* Get different seed for each thread*/
+        particle_seed = pso_hash(seed + pso_hash(i)); /* Different seed for each particle */
         particle = &swarm->particle[i];
-        particle->dim = dim; 
         /* Generate random particle position */
-        particle->x = (float *)malloc(dim * sizeof(float));
         for (j = 0; j < dim; j++)
-           particle->x[j] = uniform_omp(xmin, xmax, &seed);   // Pass different seed to uniform_omp()
+           particle->x[j] = uniform_omp(xmin, xmax, &particle_seed);   // Pass different seed to uniform_omp()
 
        /* Generate random particle velocity */ 
-        particle->v = (float *)malloc(dim * sizeof(float));
-        for (j = 0; j < dim; j++)
-            particle->v[j] = uniform_omp(-fabsf(xmax - xmin), fabsf(xmax - xmin), &seed);
+        for (j = 0; particle->v != NULL && j < dim; j++)
+            particle->v[j] = uniform_omp(-vmax, vmax, &particle_seed);
 
         /* Initialize best position for particle */
-        particle->pbest = (float *)malloc(dim * sizeof(float));
         for (j = 0; j < dim; j++)
             particle->pbest[j] = particle->x[j];
 
         /* Initialize particle fitness */
-        status = pso_eval_fitness(function, particle, &fitness);
-        if (status < 0) {
-            fprintf(stderr, "Could not evaluate fitness. Unknown function provided.\n");
-            exit (EXIT_FAILURE);
-        }
-        particle->fitness = fitness;
+        eval(particle->x, 1, dim, &particle->fitness);
 
         /* Initialize index of best performing particle */
         particle->g = -1;
     }
-    
+}
+
+    swarm->num_evals = swarm->num_particles;
+    swarm->num_skipped = 0;
+    swarm->num_iters = 0;
 
-    /* One thread does extra work to get index of particle with best fitness */
-#pragma omp single
+    /* Get index of particle with best fitness */
     g = pso_get_best_fitness_omp(swarm, num_threads);
-#pragma omp for /* Parallel loop. Independent particles */
-    for (i = 0; i < swarm->num_particles; i++) {
+#pragma omp parallel for num_threads(num_threads) private(particle) /* Independent particles */
+    for (int i = 0; i < swarm->num_particles; i++) {
         particle = &swarm->particle[i];
         particle->g = g;
     }
+
+    return 0;
 }
 
+/* PSO init with parallel omp */
+swarm_t *pso_init_omp(char *function, int dim, int swarm_size, 
+                  float xmin, float xmax, int num_threads, unsigned int seed)
+{
+    swarm_t *swarm;
+
+    swarm = pso_alloc(NULL, dim, swarm_size, 1);
+    if (swarm == NULL)
+        return NULL;
+
+    if (pso_init_swarm_omp(swarm, function, xmin, xmax, num_threads, seed) < 0) {
+        pso_free(swarm);
+        return NULL;
+    }
     return swarm;
 }
 
+/* CPU model name from /proc/cpuinfo */
+void pso_cpu_model(char *model, size_t len)
+{
+    FILE *fp = fopen("/proc/cpuinfo", "r");
+    char line[256], *p;
+
+    snprintf(model, len, "unknown");
+    if (fp == NULL)
+        return;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (strncmp(line, "model name", 10) == 0 && (p = strchr(line, ':')) != NULL) {
+            p += strspn(p + 1, " \t") + 1;
+            p[strcspn(p, "\n")] = '\0';
+            snprintf(model, len, "%s", p);
+            break;
+        }
+    }
+    fclose(fp);
+}